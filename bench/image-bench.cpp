@@ -0,0 +1,392 @@
+// std
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <zlib.h>
+
+#define private public
+#define protected public
+#include <image/image.hpp>
+
+// Benchmark of built-in Scanline::deflate against zlib on every compression level.
+// Usage: image-bench [--data <dir>] [--json <file>] [--min-time <seconds>]
+// Images from data directory (resources/ by default) are compressed the way PNG encoder
+// does it (filtered scanlines), synthetic corpora are compressed as is.
+// Scaled and region decoding of large synthetic PNG is checked to take little more heap
+// than its map.
+
+namespace {
+
+// Heap usage, counted by replaced operator new/delete and zlib allocators, which are
+// also called from worker threads of parallel compression
+std::atomic<size_t> current_bytes {0};
+std::atomic<size_t> peak_bytes {0};
+
+void* tracked_alloc(size_t size) {
+    // size is stored in front of the block, 16 bytes keep alignment of the result
+    auto block = static_cast<std::uint8_t*>(std::malloc(size + 16));
+    if (!block) {
+        return nullptr;
+    }
+    std::memcpy(block, &size, sizeof(size));
+    size_t current {current_bytes.fetch_add(size) + size};
+    size_t peak {peak_bytes.load()};
+    while (peak < current && !peak_bytes.compare_exchange_weak(peak, current)) {
+    }
+    return block + 16;
+}
+
+void tracked_free(void* pointer) {
+    if (!pointer) {
+        return;
+    }
+    auto block = static_cast<std::uint8_t*>(pointer) - 16;
+    size_t size;
+    std::memcpy(&size, block, sizeof(size));
+    current_bytes.fetch_sub(size);
+    std::free(block);
+}
+
+voidpf zlib_alloc(voidpf, uInt items, uInt size) {
+    return tracked_alloc(static_cast<size_t>(items) * size);
+}
+
+void zlib_free(voidpf, voidpf address) {
+    tracked_free(address);
+}
+
+struct corpus {
+    std::string name;
+    std::vector<std::uint8_t> data;
+};
+
+struct result {
+    std::string corpus;
+    std::string encoder;
+    int level;
+    size_t input;
+    size_t output;
+    double seconds;     // best time of one run
+    size_t peak;        // peak heap usage of one run
+    bool valid;         // output decompresses to input
+};
+
+// Runs job until min_time passes (at least 3 times), returns best time of one run
+// and peak heap usage above the usage before the first run.
+double measure(const std::function<void()>& job, double min_time, size_t& peak) {
+    double best {1e30}, total {0};
+    size_t base {current_bytes.load()};
+    peak_bytes = base;
+    for (int run {0}; run < 3 || total < min_time; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        job();
+        std::chrono::duration<double> elapsed {std::chrono::steady_clock::now() - start};
+        best = std::min(best, elapsed.count());
+        total += elapsed.count();
+    }
+    peak = peak_bytes - base;
+    return best;
+}
+
+bool check_stream(const std::vector<std::uint8_t>& stream, const std::vector<std::uint8_t>& data) {
+    std::vector<std::uint8_t> decoded(data.size() + 1);
+    uLongf decoded_size {decoded.size()};
+    auto status = uncompress(decoded.data(), &decoded_size, stream.data(), stream.size());
+    return status == Z_OK && decoded_size == data.size() &&
+           std::equal(data.begin(), data.end(), decoded.begin());
+}
+
+result run_builtin(const corpus& input, int level, double min_time) {
+    result res {input.name, "built-in", level, input.data.size(), 0, 0, 0, false};
+    std::vector<std::uint8_t> stream;
+    int status {0};
+    res.seconds = measure([&] {
+        stream.assign(input.data.size() + input.data.size() / 8 + 1024, 0);
+        int size_out {static_cast<int>(stream.size())};
+        status = img::Image::Scanline::deflate(reinterpret_cast<char*>(stream.data()), size_out,
+                                               const_cast<char*>(reinterpret_cast<const char*>(
+                                                   input.data.data())),
+                                               static_cast<int>(input.data.size()), level);
+        stream.resize(size_out);
+    }, min_time, res.peak);
+    res.output = stream.size();
+    res.valid = !status && check_stream(stream, input.data);
+    return res;
+}
+
+result run_zlib(const corpus& input, int level, double min_time) {
+    result res {input.name, "zlib", level, input.data.size(), 0, 0, 0, false};
+    std::vector<std::uint8_t> stream;
+    int status {Z_OK};
+    res.seconds = measure([&] {
+        z_stream state {};
+        state.zalloc = zlib_alloc;
+        state.zfree = zlib_free;
+        status = deflateInit2(&state, level, Z_DEFLATED, 15, 8, Z_DEFAULT_STRATEGY);
+        if (status != Z_OK) {
+            return;
+        }
+        stream.assign(deflateBound(&state, input.data.size()), 0);
+        state.next_in = const_cast<std::uint8_t*>(input.data.data());
+        state.avail_in = input.data.size();
+        state.next_out = stream.data();
+        state.avail_out = stream.size();
+        status = ::deflate(&state, Z_FINISH);
+        stream.resize(state.total_out);
+        deflateEnd(&state);
+    }, min_time, res.peak);
+    res.output = stream.size();
+    res.valid = status == Z_STREAM_END && check_stream(stream, input.data);
+    return res;
+}
+
+// Filtered scanlines of image, exactly what PNG encoder compresses
+std::vector<std::uint8_t> filtered_data(img::PixelMap& map) {
+    img::PNGImage png {};
+    png.get_map() = map;
+    std::unique_ptr<std::uint8_t[]> buffer;
+    size_t size;
+    png.assemble_8b_truecolor(buffer, size);
+    return {buffer.get(), buffer.get() + size};
+}
+
+std::vector<corpus> load_images(const std::filesystem::path& directory) {
+    std::vector<corpus> corpora;
+    std::vector<std::filesystem::path> files;
+    for (auto& entry : std::filesystem::directory_iterator(directory)) {
+        auto extension = entry.path().extension();
+        if (entry.is_regular_file() && (extension == ".png" || extension == ".ppm") &&
+            entry.path().filename().string().rfind("result", 0)) {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    for (auto& file : files) {
+        std::unique_ptr<img::Image> image;
+        if (file.extension() == ".png") {
+            image = std::make_unique<img::PNGImage>();
+        } else {
+            image = std::make_unique<img::PPMImage>();
+        }
+        try {
+            image->read(file.string());
+        } catch (const std::exception&) {
+            // broken images are part of test data
+            continue;
+        }
+        if (image->get_map().rows() && image->get_map().columns()) {
+            corpora.push_back({file.filename().string(), filtered_data(image->get_map())});
+        }
+    }
+    return corpora;
+}
+
+std::vector<corpus> synthetic_corpora() {
+    constexpr size_t size {1024 * 1024};
+    std::vector<corpus> corpora;
+    std::uint32_t state {1};
+    auto next = [&] {
+        state = state * 1103515245 + 12345;
+        return state >> 16;
+    };
+    corpus noise {"synthetic-noise", std::vector<std::uint8_t>(size)};
+    for (auto& byte : noise.data) {
+        byte = static_cast<std::uint8_t>(next());
+    }
+    corpora.push_back(std::move(noise));
+    corpus flat {"synthetic-flat", std::vector<std::uint8_t>(size)};
+    for (size_t i {0}; i < size; ++i) {
+        flat.data[i] = (i % 3001 < 1500) ? 0 : static_cast<std::uint8_t>(i / 65536);
+    }
+    corpora.push_back(std::move(flat));
+    img::PixelMap gradient_map {512, 682};
+    for (size_t row {0}; row < gradient_map.rows(); ++row) {
+        for (size_t column {0}; column < gradient_map.columns(); ++column) {
+            int noise_value = next() % 5;
+            gradient_map.at(row, column) = img::Color{static_cast<int>(row / 2),
+                                                      static_cast<int>(column / 3 + noise_value),
+                                                      static_cast<int>((row + column) / 5)};
+        }
+    }
+    corpora.push_back({"synthetic-gradient", filtered_data(gradient_map)});
+    const std::string words[] {"image ", "pixel ", "deflate ", "scanline ", "filter ",
+                               "chunk ", "the ", "of ", "and ", "compression "};
+    corpus text {"synthetic-text", {}};
+    while (text.data.size() < size) {
+        auto& word = words[next() % 10];
+        text.data.insert(text.data.end(), word.begin(), word.end());
+    }
+    corpora.push_back(std::move(text));
+    return corpora;
+}
+
+// Decodes PNG scaled down or its region, result is valid if peak heap usage is close to
+// the size of map: decoder keeps only a few rows and deflate window, file is allowed to be
+// read to memory
+result run_decode(const std::string& path, unsigned scale, img::PNGImage::Region region,
+                  double min_time) {
+    size_t file_size {std::filesystem::file_size(path)};
+    result res {"synthetic-png", region.rows ? "region" : "decode", static_cast<int>(scale),
+                file_size, 0, 0, 0, false};
+    res.seconds = measure([&] {
+        img::PNGImage png {};
+        auto options = png.decode_options();
+        options.scale = scale;
+        options.region = region;
+        png.decode_options(options);
+        png.read(path);
+        res.output = png.get_map().rows() * (png.get_map().columns() * sizeof(img::Color) +
+                                             sizeof(std::vector<img::Color>));
+    }, min_time, res.peak);
+    res.valid = res.peak <= res.output + file_size + (1 << 20);
+    return res;
+}
+
+std::string write_decode_image() {
+    img::PNGImage png {};
+    auto& map = png.get_map();
+    map.expand(img::Side::bottom, 3000);
+    map.expand(img::Side::right, 3000);
+    for (size_t row {0}; row < map.rows(); ++row) {
+        for (size_t column {0}; column < map.columns(); ++column) {
+            map.at(row, column) = img::Color{static_cast<int>(row * column % 256),
+                                             static_cast<int>((row + column * 3) % 256),
+                                             static_cast<int>((row ^ column) % 256)};
+        }
+    }
+    auto path = (std::filesystem::temp_directory_path() / "image-bench-decode.png").string();
+    png.write(path);
+    return path;
+}
+
+std::string json_escape(const std::string& value) {
+    std::string escaped;
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+}
+
+void* operator new(size_t size) {
+    if (auto pointer = tracked_alloc(size)) {
+        return pointer;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* pointer) noexcept {
+    tracked_free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    tracked_free(pointer);
+}
+
+int main(int argc, char** argv) {
+    std::filesystem::path data_dir {"resources"};
+    std::string json_path {"image-bench.json"};
+    double min_time {0.2};
+    for (int i {1}; i + 1 < argc; i += 2) {
+        std::string option {argv[i]};
+        if (option == "--data") {
+            data_dir = argv[i + 1];
+        } else if (option == "--json") {
+            json_path = argv[i + 1];
+        } else if (option == "--min-time") {
+            min_time = std::atof(argv[i + 1]);
+        } else {
+            std::cerr << "unknown option: " << option << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<corpus> corpora;
+    if (std::filesystem::is_directory(data_dir)) {
+        corpora = load_images(data_dir);
+    } else {
+        std::cerr << "data directory " << data_dir << " is not found, images are skipped"
+                  << std::endl;
+    }
+    for (auto& synthetic : synthetic_corpora()) {
+        corpora.push_back(std::move(synthetic));
+    }
+
+    std::vector<result> results;
+    std::cout << std::left << std::setw(22) << "corpus" << std::right
+              << std::setw(10) << "input" << std::setw(10) << "encoder" << std::setw(7) << "level"
+              << std::setw(10) << "output" << std::setw(8) << "ratio" << std::setw(10) << "MB/s"
+              << std::setw(12) << "peak KiB" << std::setw(7) << "valid" << std::endl;
+    for (auto& input : corpora) {
+        for (int level {0}; level <= 9; ++level) {
+            for (auto run : {run_builtin, run_zlib}) {
+                auto res = run(input, level, min_time);
+                std::cout << std::left << std::setw(22) << res.corpus << std::right
+                          << std::setw(10) << res.input << std::setw(10) << res.encoder
+                          << std::setw(7) << res.level << std::setw(10) << res.output
+                          << std::setw(8) << std::fixed << std::setprecision(3)
+                          << static_cast<double>(res.input) / std::max<size_t>(res.output, 1)
+                          << std::setw(10) << std::setprecision(1)
+                          << res.input / res.seconds / 1e6
+                          << std::setw(12) << res.peak / 1024
+                          << std::setw(7) << (res.valid ? "yes" : "NO") << std::endl;
+                results.push_back(res);
+            }
+        }
+    }
+
+    // raw image data of the whole image is 27 MB, decoded maps are 36 MB to 0.6 MB, region
+    // of 10 rows is 120 KB
+    auto decode_path = write_decode_image();
+    std::pair<unsigned, img::PNGImage::Region> decodes[] {
+        {1, {}}, {2, {}}, {4, {}}, {8, {}}, {1, {1500, 0, 10, 0}}};
+    for (auto [scale, region] : decodes) {
+        auto res = run_decode(decode_path, scale, region, min_time);
+        std::cout << std::left << std::setw(22) << res.corpus << std::right
+                  << std::setw(10) << res.input << std::setw(10) << res.encoder
+                  << std::setw(7) << res.level << std::setw(10) << res.output
+                  << std::setw(8) << "-" << std::setw(10) << std::setprecision(1)
+                  << res.input / res.seconds / 1e6
+                  << std::setw(12) << res.peak / 1024
+                  << std::setw(7) << (res.valid ? "yes" : "NO") << std::endl;
+        results.push_back(res);
+    }
+    std::filesystem::remove(decode_path);
+
+    std::ofstream json {json_path};
+    json << "[\n";
+    for (size_t i {0}; i < results.size(); ++i) {
+        auto& res = results[i];
+        json << "  {\"corpus\": \"" << json_escape(res.corpus) << "\", \"encoder\": \""
+             << res.encoder << "\", \"level\": " << res.level << ", \"input_bytes\": "
+             << res.input << ", \"output_bytes\": " << res.output << ", \"ratio\": "
+             << static_cast<double>(res.input) / std::max<size_t>(res.output, 1)
+             << ", \"mb_per_s\": " << res.input / res.seconds / 1e6
+             << ", \"peak_bytes\": " << res.peak << ", \"valid\": "
+             << (res.valid ? "true" : "false") << "}" << (i + 1 < results.size() ? "," : "")
+             << "\n";
+    }
+    json << "]\n";
+    std::cout << "JSON report is written to " << json_path << std::endl;
+    bool valid {std::all_of(results.begin(), results.end(), [](auto& res) { return res.valid; })};
+    return valid ? 0 : 1;
+}
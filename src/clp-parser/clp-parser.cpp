@@ -252,6 +252,8 @@ clpp::Command::Command(std::string& command)
 	else if (first_part == "reflect_y") { _command = clpp::CommandType::reflect_y; }
 	else if (first_part == "version")   { _command = clpp::CommandType::version;   }
 	else if (first_part == "help")      { _command = clpp::CommandType::help;      }
+	else if (first_part == "fast")      { _command = clpp::CommandType::fast;      }
+	else if (first_part == "small")     { _command = clpp::CommandType::small;     }
 }
 
 clpp::Command::~Command()
@@ -497,7 +499,7 @@ void clpp::help()
 					<< "----------------------------------------------------------------------------------------------------" << std::endl
 					<< "|   FORMAT:     |  --insert=x/y#path_to_new                                                        |" << std::endl
 					<< "----------------------------------------------------------------------------------------------------" << std::endl
-					<< "|   convert     |   new_format      |   one of the valid options: ppm or png   |   unavailable     |" << std::endl
+					<< "|   convert     |   new_format      |   ppm, png, pgm, pbm, pam or qoi         |   unavailable     |" << std::endl
 					<< "----------------------------------------------------------------------------------------------------" << std::endl
                     << "|   FORMAT:     |  --convert_to=new_format                                                         |" << std::endl
 					<< "----------------------------------------------------------------------------------------------------" << std::endl
@@ -516,6 +518,14 @@ void clpp::help()
 					<< "|   help        |   -               |   show help message                      |   h               |" << std::endl
 					<< "----------------------------------------------------------------------------------------------------" << std::endl
 					<< "|   FORMAT:     |  --help or -h                                                                    |" << std::endl
+					<< "----------------------------------------------------------------------------------------------------" << std::endl
+					<< "|   fast        |   -               |   fastest PNG compression (level 1, RLE) |   unavailable     |" << std::endl
+					<< "----------------------------------------------------------------------------------------------------" << std::endl
+					<< "|   FORMAT:     |  --fast                                                                          |" << std::endl
+					<< "----------------------------------------------------------------------------------------------------" << std::endl
+					<< "|   small       |   -               |   maximum PNG compression (level 9)      |   unavailable     |" << std::endl
+					<< "----------------------------------------------------------------------------------------------------" << std::endl
+					<< "|   FORMAT:     |  --small                                                                         |" << std::endl
 					<< "----------------------------------------------------------------------------------------------------" << std::endl;
 		std::cerr << std::endl;
 		std::cerr << rang::fg::green 
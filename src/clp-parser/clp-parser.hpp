@@ -22,7 +22,7 @@ namespace clpp {
     // Code for CLI parser.
     inline std::string global_Path; ///< Path to main image
     inline bool cerr_disabled = false; ///< Permission to display
-    inline std::vector<std::string> allowed_Format = {"ppm", "png"}; ///< Allowed file formats
+    inline std::vector<std::string> allowed_Format = {"ppm", "png", "pgm", "pbm", "pam", "qoi"}; ///< Allowed file formats
 
     /** \brief Help function
      * \details This function show help message with allowed command and rules for writing them.
@@ -48,7 +48,9 @@ namespace clpp {
         reflect_x = 6, // x
         reflect_y = 7, // y
         version = 8, // v
-        help = 9 // h
+        help = 9, // h
+        fast = 10, // PNG output preset: fastest compression
+        small = 11 // PNG output preset: maximum compression
     };
 
     /** \brief A class for storing information about the command that can be executed on an image. 
@@ -267,7 +269,7 @@ namespace clpp {
         const std::vector<std::string> _correct_long_commands = {"crop", "rotate", "resize",
                                                      "negative", "insert", "convert_to",
                                                      "reflect_x", "reflect_y", "version",
-                                                     "help"}; ///< Vector with correct long command
+                                                     "help", "fast", "small"}; ///< Vector with correct long command
         std::vector<std::string> _tokens; ///< Vector with tokens
         std::vector<std::string> _line_of_command; ///< Vector with commands
         std::queue<Command> _queue_of_command; ///< Queue with commands
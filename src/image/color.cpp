@@ -3,6 +3,7 @@
 int img::Color::R() const { return (_data & red) >> red_shift; }
 int img::Color::G() const { return (_data & green) >> green_shift; }
 int img::Color::B() const { return (_data & blue) >> blue_shift; }
+int img::Color::A() const { return 255 - static_cast<int>((_data & alpha) >> alpha_shift); }
 img::Color::Color() : _data{0x00000000} {}
 
 bool img::Color::operator==(Color other) const { return other._data == _data; }
@@ -25,9 +26,19 @@ void img::Color::B(int value) {
     _data = (_data & ~blue) | new_value;
 }
 
+void img::Color::A(int value) {
+    data32_t new_value {static_cast<data32_t>(255 - value)};
+    new_value = (new_value << alpha_shift) & alpha;
+    _data = (_data & ~alpha) | new_value;
+}
+
 img::Color::Color(int r, int g, int b) {
     _data = 0;
     _data |= (static_cast<data32_t>(r) << red_shift) & red;
     _data |= (static_cast<data32_t>(g) << green_shift) & green;
     _data |= (static_cast<data32_t>(b) << blue_shift) & blue;
 }
+
+img::Color::Color(int r, int g, int b, int a) : Color(r, g, b) {
+    A(a);
+}
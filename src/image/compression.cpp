@@ -1,235 +1,623 @@
 // std headers
 #include <cstddef>
-#include <list>
 #include <algorithm>
-#include <bitset>
 #include <iostream>
-#include <cmath>
 #include <climits>
 
 #include "image.hpp"
 
 using i = img::Image;
 
-char* i::Scanline::buffer_start {nullptr};
-char* i::Scanline::buffer_end   {nullptr};
-
-uint32_t i::Scanline::adler32(std::uint8_t* data, size_t len) {
-    uint32_t a {1}, b {0};
-    size_t index;
-    for (index = 0; index < len; ++index)
-    {
-        a = (a + data[index]) % mod_adler;
-        b = (b + a) % mod_adler;
+uint32_t i::Scanline::adler32(std::uint8_t* data, size_t len, uint32_t adler) {
+    // sums do not overflow 32 bits within 5552 bytes, so modulo is taken once per run
+    constexpr size_t run {5552};
+    uint32_t a {adler & 0xFFFF}, b {adler >> 16};
+    while (len) {
+        size_t part {std::min(len, run)};
+        for (size_t index {0}; index < part; ++index) {
+            a += data[index];
+            b += a;
+        }
+        a %= mod_adler;
+        b %= mod_adler;
+        data += part;
+        len -= part;
     }
     return (b << 16) | a;
 }
 
-std::uint8_t* i::Scanline::move_buffer(std::uint8_t* data, std::int32_t number) {
-    if (number < 0) {
-        return data - std::min<std::int32_t>(abs(number),
-                                             data - reinterpret_cast<std::uint8_t*&>(buffer_start));
+std::uint32_t i::Scanline::hash3(const std::uint8_t* data) {
+    std::uint32_t value {static_cast<std::uint32_t>(data[0]) << 16 |
+                         static_cast<std::uint32_t>(data[1]) << 8 |
+                         static_cast<std::uint32_t>(data[2])};
+    // multiplicative hashing, top bits are the best mixed
+    return (value * 2654435761u) >> (32 - hash_bits);
+}
+
+i::Scanline::triplet i::Scanline::find_match(const hash_chains& chains, const std::uint8_t* data,
+                                             std::uint32_t position, std::uint32_t size,
+                                             std::uint32_t window_size,
+                                             std::uint32_t prev_length,
+                                             const match_params& params) {
+    triplet best {data[position], 0, 0};
+    std::uint32_t best_length {std::max(prev_length, min_match - 1)};
+    std::uint32_t max_length {std::min(max_match, size - position)};
+    if (max_length < min_match || best_length >= max_length) {
+        return best;
     }
-    return data + std::min<std::int32_t>(number,
-                                         reinterpret_cast<std::uint8_t*&>(buffer_end) - data);
+    std::uint32_t chain {params.max_chain};
+    if (prev_length >= params.good_length) {
+        chain >>= 2;
+    }
+    std::uint32_t nice_length {std::min(params.nice_length, max_length)};
+    std::int64_t limit {static_cast<std::int64_t>(position) - window_size};
+    std::int32_t candidate {chains.head[hash3(data + position)]};
+    const std::uint8_t* current {data + position};
+    while (candidate >= 0 && candidate > limit && chain--) {
+        const std::uint8_t* match {data + candidate};
+        // cheap rejection: the byte that would make match longer must be equal
+        if (match[best_length] == current[best_length] && match[0] == current[0]) {
+            std::uint32_t length {0};
+            while (length < max_length && match[length] == current[length]) {
+                ++length;
+            }
+            if (length > best_length) {
+                best_length = length;
+                best = {0, position - candidate, length};
+                if (length >= nice_length) {
+                    break;
+                }
+            }
+        }
+        std::int32_t next {chains.prev[candidate & (window_size - 1)]};
+        // link was overwritten by a newer position, so the rest of the chain is gone
+        if (next >= candidate) {
+            break;
+        }
+        candidate = next;
+    }
+    return best;
 }
 
-i::Scanline::triplet i::Scanline::find_match(std::uint8_t* sliding_window, int size) {
-    std::uint32_t i {0};
-    while (sliding_window[i] != sliding_window[size] && i < size)
-    { ++i; }
-    // match not found
-    if (i >= size) {
-        return {sliding_window[size], 0, 0};
+void i::Scanline::lz77_reset(lz77_state& state, const std::uint64_t window_size) {
+    state.chains.head.assign(1 << hash_bits, -1);
+    state.chains.prev.assign(window_size, -1);
+    state.position = 0;
+    state.previous = {0, 0, 0};
+    state.pending = false;
+}
+
+bool i::Scanline::lz77_run(lz77_state& state, const std::uint8_t* data, std::uint32_t size,
+                           const std::uint64_t window_size, const match_params& params,
+                           std::vector<triplet>& result, size_t limit) {
+    auto& chains = state.chains;
+    auto insert = [&](std::uint32_t position) {
+        if (position + min_match <= size) {
+            auto hash = hash3(data + position);
+            chains.prev[position & (window_size - 1)] = chains.head[hash];
+            chains.head[hash] = position;
+        }
+    };
+    // lazy matching: match found at previous position is emitted only if
+    // the current position does not have a longer one
+    std::uint32_t position {state.position};
+    triplet previous {state.previous};
+    bool pending {state.pending};
+    // every step appends at most one node
+    while (position < size && result.size() < limit) {
+        triplet current {data[position], 0, 0};
+        if (params.max_chain && previous.length < params.lazy_length) {
+            current = find_match(chains, data, position, size, window_size,
+                                 previous.length, params);
+        }
+        insert(position);
+        if (previous.length >= min_match && current.length <= previous.length) {
+            result.push_back(previous);
+            std::uint32_t end {position - 1 + previous.length};
+            while (++position < end) {
+                insert(position);
+            }
+            previous = {0, 0, 0};
+            pending = false;
+            continue;
+        }
+        if (pending) {
+            result.push_back({data[position - 1], 0, 0});
+        }
+        previous = current;
+        pending = true;
+        ++position;
     }
-    std::uint32_t offset {size - i};
-    while (sliding_window + (i - (size - offset) + size) <
-               reinterpret_cast<std::uint8_t*&>(buffer_end) &&
-           sliding_window[i] == sliding_window[i - (size - offset) + size] &&
-           i < size)
-    { ++i; }
-    std::uint32_t length {offset - (size - i)};
-    if (length < 3) {
-        return {sliding_window[size], 0, 0};
+    state.position = position;
+    state.previous = previous;
+    state.pending = pending;
+    if (position < size || (pending && result.size() >= limit)) {
+        return false;
     }
-    // buffer reached the end
-    if (sliding_window + (i - (size - offset) + size) >=
-        reinterpret_cast<std::uint8_t*&>(buffer_end)) {
-        return {0, offset, length};
+    if (pending) {
+        result.push_back({data[position - 1], 0, 0});
+        state.pending = false;
     }
-    return {sliding_window[i - (size - offset) + size], offset, length};
+    return true;
 }
 
-std::list<i::Scanline::triplet> i::Scanline::lz77(std::uint8_t* data, int size,
-                                                  const std::uint64_t window_size) {
-    std::list<triplet> result {};
-    std::uint32_t position {0};
-    while (position < size) {
-        auto node = find_match(move_buffer(data, -(window_size)),
-                               data - move_buffer(data, -window_size));
-        data += node.length + 1;
-        position += node.length + 1;
-        result.push_back(node);
+void i::Scanline::lz77(const std::uint8_t* data, std::uint32_t size,
+                       const std::uint64_t window_size, const match_params& params,
+                       std::vector<triplet>& result) {
+    result.clear();
+    lz77_state state;
+    lz77_reset(state, window_size);
+    lz77_run(state, data, size, window_size, params, result, SIZE_MAX);
+}
+
+i::Scanline::bit_writer::bit_writer(char* dest, size_t capacity, size_t position)
+    : _dest(reinterpret_cast<std::uint8_t*>(dest)), _capacity(capacity), _position(position) {}
+
+void i::Scanline::bit_writer::write_word() {
+    if (_position + 4 > _capacity) {
+        _overflow = true;
+    } else {
+        _dest[_position]     = static_cast<std::uint8_t>(_accumulator);
+        _dest[_position + 1] = static_cast<std::uint8_t>(_accumulator >> 8);
+        _dest[_position + 2] = static_cast<std::uint8_t>(_accumulator >> 16);
+        _dest[_position + 3] = static_cast<std::uint8_t>(_accumulator >> 24);
+        _position += 4;
     }
-    return result;
+    _accumulator >>= 32;
+    _count -= 32;
 }
 
-void img::Image::Scanline::add_bits(std::bitset<block_size * 128>& source, std::uint32_t bits, int& pos, int number) {
-    number -= 1;
-    while (number >= 0) {
-        source.set(pos, (bits >> number) & 1);
-        ++pos;
-        --number;
+void i::Scanline::bit_writer::align() {
+    int bytes {(_count + 7) / 8};
+    if (_position + bytes > _capacity) {
+        _overflow = true;
+    } else {
+        for (int b {0}; b < bytes; ++b) {
+            _dest[_position++] = static_cast<std::uint8_t>(_accumulator >> (b * 8));
+        }
     }
+    _accumulator = 0;
+    _count = 0;
 }
 
-std::uint32_t i::Scanline::match_offset(std::uint32_t offset, int& out_len) {
-    int dist {1};
-    if (offset <= 4) {
-        out_len = 0;
-        return offset - dist;
-    }
-    std::uint32_t counter     {0};
-    std::uint32_t curr_offset {4};
-    std::uint32_t number      {3};
-    while (curr_offset + dist <= offset) {
-        curr_offset += dist;
-        number += 1;
-        if (!counter) {
-            counter = 1;
-            dist *= 2;
-        } else {
-            counter -= 1;
+void i::Scanline::bit_writer::copy(const char* data, size_t size) {
+    if (_position + size > _capacity) {
+        _overflow = true;
+        return;
+    }
+    std::copy(data, data + size, _dest + _position);
+    _position += size;
+}
+
+i::Scanline::block_stats& i::Scanline::block_stats::operator+=(const block_stats& other) {
+    for (int s {0}; s < litlen_symbols; ++s) {
+        litlen_freq[s] += other.litlen_freq[s];
+    }
+    for (int s {0}; s < dist_symbols; ++s) {
+        dist_freq[s] += other.dist_freq[s];
+    }
+    extra_bits += other.extra_bits;
+    bytes += other.bytes;
+    tokens += other.tokens;
+    return *this;
+}
+
+void i::Scanline::huffman_lengths(const std::uint32_t* freq, int count, int max_length,
+                                  std::uint8_t* lengths) {
+    std::fill(lengths, lengths + count, 0);
+    std::vector<int> symbols;
+    for (int s {0}; s < count; ++s) {
+        if (freq[s]) {
+            symbols.push_back(s);
         }
     }
-    std::uint32_t result {number};
-    out_len = std::round(std::log2(dist));
-//    std::cout << "inside: " << offset << ' ' << curr_offset << std::endl;
-    std::uint32_t added_bits {offset - curr_offset}, resulting {0};
-    for (int p {0}; p < out_len; ++p) {
-        resulting += ((added_bits >> (out_len - 1 - p)) & 1) << p;
+    // single used symbol still needs a complete code, so it gets a neighbour
+    if (symbols.size() < 2) {
+        int used {symbols.empty() ? 0 : symbols[0]};
+        lengths[used] = 1;
+        lengths[used ? 0 : 1] = 1;
+        return;
+    }
+    std::stable_sort(symbols.begin(), symbols.end(),
+                     [&](int a, int b) { return freq[a] < freq[b]; });
+    // Huffman tree with two queues: sorted leaves and internal nodes (sorted by construction)
+    size_t leaves {symbols.size()};
+    std::vector<std::uint64_t> weight(2 * leaves - 1);
+    std::vector<std::uint32_t> parent(2 * leaves - 1);
+    for (size_t n {0}; n < leaves; ++n) {
+        weight[n] = freq[symbols[n]];
+    }
+    size_t next_leaf {0}, next_node {leaves};
+    size_t created {leaves};
+    for (; created < weight.size(); ++created) {
+        size_t picked[2];
+        for (auto& node : picked) {
+            if (next_leaf < leaves &&
+                (next_node >= created || weight[next_leaf] <= weight[next_node])) {
+                node = next_leaf++;
+            } else {
+                node = next_node++;
+            }
+        }
+        weight[created] = weight[picked[0]] + weight[picked[1]];
+        parent[picked[0]] = parent[picked[1]] = created;
+    }
+    // depths: parents are always created after their children
+    std::vector<int> depth(weight.size(), 0);
+    for (size_t n {weight.size() - 1}; n-- > 0;) {
+        depth[n] = depth[parent[n]] + 1;
+    }
+    // limit lengths and repair Kraft inequality by moving leaves deeper
+    std::vector<std::uint32_t> length_count(std::max(max_length, 1) + 1, 0);
+    for (size_t n {0}; n < leaves; ++n) {
+        ++length_count[std::min(depth[n], max_length)];
+    }
+    std::uint64_t total {0};
+    for (int l {1}; l <= max_length; ++l) {
+        total += static_cast<std::uint64_t>(length_count[l]) << (max_length - l);
+    }
+    while (total > (std::uint64_t{1} << max_length)) {
+        --length_count[max_length];
+        for (int l {max_length - 1}; l > 0; --l) {
+            if (length_count[l]) {
+                --length_count[l];
+                length_count[l + 1] += 2;
+                break;
+            }
+        }
+        --total;
+    }
+    // the least frequent symbols get the longest codes
+    size_t n {0};
+    for (int l {max_length}; l > 0; --l) {
+        for (std::uint32_t c {0}; c < length_count[l]; ++c) {
+            lengths[symbols[n++]] = l;
+        }
     }
-    result |= (resulting) << 5;
-    return result;
 }
 
-std::uint32_t i::Scanline::match_length(std::uint32_t length, int& out_len) {
-    int dist {1};
-    if (length == 258) {
-        out_len = 0;
-        return 285;
-    }
-    if (length <= 10) {
-        out_len = 0;
-        return length - dist + 257 - 2;
-    }
-    std::uint32_t counter     {0};
-    std::uint32_t curr_length {10};
-    std::uint32_t number      {264};
-    while (curr_length + dist <= length) {
-        curr_length += dist;
-        number += 1;
-        if (!counter) {
-            counter = 3;
-            dist *= 2;
+void i::Scanline::huffman_codes(const std::uint8_t* lengths, int count, std::uint32_t* codes) {
+    std::uint32_t length_count[max_code_length + 1] {};
+    for (int s {0}; s < count; ++s) {
+        ++length_count[lengths[s]];
+    }
+    length_count[0] = 0;
+    std::uint32_t next_code[max_code_length + 1] {};
+    std::uint32_t code {0};
+    for (int bits {1}; bits <= max_code_length; ++bits) {
+        code = (code + length_count[bits - 1]) << 1;
+        next_code[bits] = code;
+    }
+    for (int s {0}; s < count; ++s) {
+        if (!lengths[s]) {
+            codes[s] = 0;
+            continue;
+        }
+        // Huffman codes are packed starting with the most significant bit
+        std::uint32_t value {next_code[lengths[s]]++}, reversed {0};
+        for (int b {0}; b < lengths[s]; ++b) {
+            reversed = (reversed << 1) | ((value >> b) & 1);
+        }
+        codes[s] = reversed;
+    }
+}
+
+void i::Scanline::fixed_trees(const block_stats& stats, block_trees& trees) {
+    for (int s {0}; s < litlen_symbols; ++s) {
+        trees.litlen_lengths[s] = (s < 144) ? 8 : (s < 256) ? 9 : (s < 280) ? 7 : 8;
+    }
+    trees.dist_lengths.fill(5);
+    trees.cost = 3 + stats.extra_bits;
+    for (int s {0}; s < litlen_symbols; ++s) {
+        trees.cost += static_cast<std::uint64_t>(stats.litlen_freq[s]) * trees.litlen_lengths[s];
+    }
+    for (int s {0}; s < dist_symbols; ++s) {
+        trees.cost += static_cast<std::uint64_t>(stats.dist_freq[s]) * 5;
+    }
+}
+
+void i::Scanline::dynamic_trees(const block_stats& stats, block_trees& trees) {
+    huffman_lengths(stats.litlen_freq.data(), litlen_symbols, max_code_length,
+                    trees.litlen_lengths.data());
+    huffman_lengths(stats.dist_freq.data(), dist_symbols, max_code_length,
+                    trees.dist_lengths.data());
+    trees.hlit = litlen_symbols;
+    while (trees.hlit > 257 && !trees.litlen_lengths[trees.hlit - 1]) {
+        --trees.hlit;
+    }
+    trees.hdist = dist_symbols;
+    while (trees.hdist > 1 && !trees.dist_lengths[trees.hdist - 1]) {
+        --trees.hdist;
+    }
+    // run-length encoding of both code length sequences at once
+    std::vector<std::uint8_t> sequence(trees.litlen_lengths.begin(),
+                                       trees.litlen_lengths.begin() + trees.hlit);
+    sequence.insert(sequence.end(), trees.dist_lengths.begin(),
+                    trees.dist_lengths.begin() + trees.hdist);
+    trees.codelens.clear();
+    for (size_t pos {0}; pos < sequence.size();) {
+        std::uint8_t value {sequence[pos]};
+        size_t run {1};
+        while (pos + run < sequence.size() && sequence[pos + run] == value) {
+            ++run;
+        }
+        pos += run;
+        if (value == 0) {
+            while (run >= 11) {
+                size_t part {std::min<size_t>(run, 138)};
+                trees.codelens.push_back({18, static_cast<std::uint8_t>(part - 11)});
+                run -= part;
+            }
+            if (run >= 3) {
+                trees.codelens.push_back({17, static_cast<std::uint8_t>(run - 3)});
+                run = 0;
+            }
         } else {
-            counter -= 1;
+            trees.codelens.push_back({value, 0});
+            --run;
+            while (run >= 3) {
+                size_t part {std::min<size_t>(run, 6)};
+                trees.codelens.push_back({16, static_cast<std::uint8_t>(part - 3)});
+                run -= part;
+            }
         }
+        while (run--) {
+            trees.codelens.push_back({value, 0});
+        }
+    }
+    std::uint32_t codelen_freq[codelen_symbols] {};
+    for (auto& codelen : trees.codelens) {
+        ++codelen_freq[codelen.first];
+    }
+    huffman_lengths(codelen_freq, codelen_symbols, max_codelen_length,
+                    trees.codelen_lengths.data());
+    trees.hclen = codelen_symbols;
+    while (trees.hclen > 4 && !trees.codelen_lengths[codelen_order[trees.hclen - 1]]) {
+        --trees.hclen;
     }
-    std::uint32_t result {number};
-    out_len = std::round(std::log2(dist));
-//    std::cout << "inside: " << length << ' ' << curr_length << std::endl;
-    // bits are not inverted, so we invert them now to nullify the effect
-    std::uint32_t added_bits {length - curr_length}, resulting {0};
-    for (int p {0}; p < out_len; ++p) {
-        resulting += ((added_bits >> (out_len - 1 - p)) & 1) << p;
+    // cost: block header, tree description and data
+    trees.cost = 3 + 5 + 5 + 4 + 3 * trees.hclen + stats.extra_bits;
+    for (auto& codelen : trees.codelens) {
+        trees.cost += trees.codelen_lengths[codelen.first];
+        trees.cost += (codelen.first == 16) ? 2 : (codelen.first == 17) ? 3 :
+                      (codelen.first == 18) ? 7 : 0;
     }
-    result |= (resulting) << 9;
-    return result;
+    for (int s {0}; s < litlen_symbols; ++s) {
+        trees.cost += static_cast<std::uint64_t>(stats.litlen_freq[s]) * trees.litlen_lengths[s];
+    }
+    for (int s {0}; s < dist_symbols; ++s) {
+        trees.cost += static_cast<std::uint64_t>(stats.dist_freq[s]) * trees.dist_lengths[s];
+    }
+}
+
+std::uint64_t i::Scanline::stored_cost(std::uint64_t bytes) {
+    // every stored block holds up to 65535 bytes and costs header, padding and LEN/NLEN
+    std::uint64_t blocks {std::max<std::uint64_t>((bytes + 65534) / 65535, 1)};
+    return blocks * (3 + 7 + 32) + bytes * 8;
+}
+
+void i::Scanline::put_stored(bit_writer& writer, const char* data, std::uint64_t size,
+                             bool last) {
+    // stored blocks: header, padding to byte, LEN and NLEN, raw bytes
+    do {
+        std::uint32_t length {static_cast<std::uint32_t>(std::min<std::uint64_t>(size, 65535))};
+        size -= length;
+        writer.put(last && !size, 1);
+        writer.put(static_cast<int>(block_type::stored), 2);
+        writer.align();
+        writer.put(length | (~length & 0xFFFF) << 16, 32);
+        writer.copy(data, length);
+        data += length;
+    } while (size);
 }
 
-int img::Image::Scanline::deflate(char* dest, int& size_out, char* const data, int size) {
-    buffer_start = data;
-    buffer_end = data + size;
+namespace {
+    // Base values of length symbols 257 - 285 and distance symbols 0 - 29 (RFC 1951, 3.2.5)
+    constexpr std::uint16_t length_base[29] {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+    constexpr std::uint8_t length_extra[29] {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+    };
+    constexpr std::uint16_t dist_base[30] {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+    };
+    constexpr std::uint8_t dist_extra[30] {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+    };
+    // Length symbol (minus 257) for every match length 3 - 258
+    constexpr auto length_symbol = [] {
+        std::array<std::uint8_t, 259> table {};
+        for (int s {0}; s < 29; ++s) {
+            int end {(s + 1 < 29) ? length_base[s + 1] : 259};
+            for (int l {length_base[s]}; l < end; ++l) {
+                table[l] = s;
+            }
+        }
+        return table;
+    }();
+    // Distance symbol for distances 1 - 256 at [d - 1] and for the rest at [256 + ((d - 1) >> 7)]
+    constexpr auto dist_symbol = [] {
+        std::array<std::uint8_t, 512> table {};
+        for (int s {0}; s < 30; ++s) {
+            int end {(s + 1 < 30) ? dist_base[s + 1] : 32769};
+            for (int d {dist_base[s]}; d < end; ++d) {
+                if (d <= 256) {
+                    table[d - 1] = s;
+                } else {
+                    table[256 + ((d - 1) >> 7)] = s;
+                }
+            }
+        }
+        return table;
+    }();
+}
+
+std::uint32_t i::Scanline::match_offset(std::uint32_t offset, int& out_len) {
+    std::uint32_t symbol {dist_symbol[(offset <= 256) ? offset - 1 : 256 + ((offset - 1) >> 7)]};
+    out_len = dist_extra[symbol];
+    return symbol | ((offset - dist_base[symbol]) << 5);
+}
+
+std::uint32_t i::Scanline::match_length(std::uint32_t length, int& out_len) {
+    std::uint32_t symbol {length_symbol[length]};
+    out_len = length_extra[symbol];
+    return (symbol + 257) | ((length - length_base[symbol]) << 9);
+}
+
+int img::Image::Scanline::deflate(char* dest, int& size_out, char* const data, int size,
+                                  int level) {
+    // size_out holds capacity of dest on input
+    const int capacity {size_out};
+    if (capacity < 2 + 4) {
+        return -1;
+    }
     dest[0] = 0b01111000;
     dest[1] = 0b11011010;
-    std::vector<std::list<triplet>> blocks {};
-    std::uint32_t curr_offset {0};
-    while (curr_offset < size) {
-        auto curr_data = data + curr_offset;
-        auto optimized = lz77(reinterpret_cast<std::uint8_t*>(curr_data),
-                              std::min<std::uint32_t>(size - curr_offset, block_size),
-                              window_size);
-        blocks.push_back(optimized);
-        curr_offset += block_size;
-    }
-//    for (int i {1}; i < 200; i += 20) {
-//        auto res = match_offset(i);
-//        std::cout << i << ' ' << (res >> 5) << ' ' << (res & 0b11111) << std::endl;
-//    }
-//    return 0;
-//    for (int i {3}; i < 30; i += 1) {
-//        auto res = match_length(i);
-//        std::cout << i << ' ' << (res >> 9) << ' ' << (res & 0b111111111) << std::endl;
-//    }
-//    return 0;
-    int position_byte {2};
-    int position_bit  {0};
-    int index         {1};
-    // encode with Huffman
-    for (auto& list : blocks) {
-        std::bitset<block_size * 128> bits;
-        if (index++ == blocks.size()) {
-            bits.set(position_bit++);
-            bits.set(position_bit++);
-            ++position_bit;
-        } else {
-            ++position_bit;
-            bits.set(position_bit++);
-            ++position_bit;
-        }
-        int local_index {1};
-        for (auto& triple : list) {
-            std::uint64_t encoded_value = {0};
-            // case (length + offset)
-            if (triple.length != 0) {
-                int offset_len, length_len;
-                auto length = match_length(triple.length, length_len);
-                auto offset = match_offset(triple.offset, offset_len);
-                if (triple.length < 115) {
-                    add_bits(bits, length & 0b111111111 - 256, position_bit, 7);
-                } else if (triple.length >= 115) {
-                    add_bits(bits, length & 0b111111111 - 280 + 0b11000000, position_bit, 8);
+    // space for checksum is kept at the end
+    bit_writer writer {dest, static_cast<size_t>(capacity - 4), 2};
+    if (level <= 0) {
+        // no match search, data is only split into stored blocks (FLEVEL of header is 0)
+        dest[1] = 0b00000001;
+        put_stored(writer, data, size, true);
+        return finish_stream(dest, size_out, writer, data, size);
+    }
+    // nodes are taken from LZ77 in batches, buffers keep their memory between calls
+    thread_local deflate_state state;
+    auto& tokens = state.tokens;
+    auto& coded = state.coded;
+    auto& blocks = state.blocks;
+    auto block_cost = [](const block_stats& stats) {
+        block_trees trees;
+        fixed_trees(stats, trees);
+        auto cost = std::min(trees.cost, stored_cost(stats.bytes));
+        dynamic_trees(stats, trees);
+        return std::min(cost, trees.cost);
+    };
+    lz77_reset(state.lz77, window_size);
+    std::uint64_t data_position {0};
+    for (bool done {false}; !done;) {
+        tokens.clear();
+        done = lz77_run(state.lz77, reinterpret_cast<std::uint8_t*>(data), size, window_size,
+                        level_params[std::clamp(level, 0, 9)], tokens, batch_tokens);
+        // map nodes to deflate symbols once, end of block is added to every block
+        coded.clear();
+        for (auto& triple : tokens) {
+            if (triple.length == 0) {
+                coded.push_back({triple.byte, 0, 0, 0, 0, 0, 1});
+                continue;
+            }
+            int offset_len, length_len;
+            auto length = match_length(triple.length, length_len);
+            auto offset = match_offset(triple.offset, offset_len);
+            coded.push_back({static_cast<std::uint16_t>(length & 0x1FF),
+                             static_cast<std::uint16_t>(length >> 9),
+                             static_cast<std::uint8_t>(length_len),
+                             static_cast<std::uint8_t>(offset & 0x1F),
+                             static_cast<std::uint16_t>(offset >> 5),
+                             static_cast<std::uint8_t>(offset_len),
+                             static_cast<std::uint16_t>(triple.length)});
+        }
+        // block splitting: adjacent segments are merged while one block is cheaper than two
+        blocks.clear();
+        for (size_t first {0}; first < coded.size() || blocks.empty(); first += split_granularity) {
+            block_stats segment {};
+            segment.litlen_freq[256] = 1;
+            size_t end {std::min<size_t>(first + split_granularity, coded.size())};
+            for (size_t t {first}; t < end; ++t) {
+                auto& token = coded[t];
+                ++segment.litlen_freq[token.symbol];
+                if (token.symbol > 256) {
+                    ++segment.dist_freq[token.dist_symbol];
                 }
-                length >>= 9;
-                add_bits(bits, length, position_bit, length_len);
-                add_bits(bits, offset & 0b11111, position_bit, 5);
-                add_bits(bits, offset >> 5, position_bit, offset_len);
-                if (local_index == list.size()) {
-                    break;
+                segment.extra_bits += token.length_bits + token.dist_bits;
+                segment.bytes += token.bytes;
+                ++segment.tokens;
+            }
+            if (!blocks.empty() && blocks.back().tokens + segment.tokens <= block_size) {
+                block_stats merged {blocks.back()};
+                merged += segment;
+                --merged.litlen_freq[256];
+                if (block_cost(merged) <= block_cost(blocks.back()) + block_cost(segment)) {
+                    blocks.back() = merged;
+                    continue;
                 }
             }
-            // case (literal)
-            if (triple.byte < 144) {
-                add_bits(bits, triple.byte + 48, position_bit, 8);
-            } else if (143 < triple.byte) {
-                add_bits(bits, triple.byte + 0b110010000 - 144, position_bit, 9);
+            blocks.push_back(segment);
+        }
+
+        size_t token_index {0};
+        for (size_t b {0}; b < blocks.size(); ++b) {
+            auto& stats = blocks[b];
+            bool last {done && b + 1 == blocks.size()};
+            block_trees fixed, dynamic;
+            fixed_trees(stats, fixed);
+            dynamic_trees(stats, dynamic);
+            auto stored = stored_cost(stats.bytes);
+            if (stored < fixed.cost && stored < dynamic.cost) {
+                put_stored(writer, data + data_position, stats.bytes, last);
+                data_position += stats.bytes;
+                token_index += stats.tokens;
+            } else {
+                auto& trees = (fixed.cost <= dynamic.cost) ? fixed : dynamic;
+                writer.put(last, 1);
+                if (&trees == &fixed) {
+                    writer.put(static_cast<int>(block_type::fixed), 2);
+                } else {
+                    writer.put(static_cast<int>(block_type::dynamic), 2);
+                    writer.put(trees.hlit - 257, 5);
+                    writer.put(trees.hdist - 1, 5);
+                    writer.put(trees.hclen - 4, 4);
+                    for (int c {0}; c < trees.hclen; ++c) {
+                        writer.put(trees.codelen_lengths[codelen_order[c]], 3);
+                    }
+                    std::uint32_t codelen_codes[codelen_symbols];
+                    huffman_codes(trees.codelen_lengths.data(), codelen_symbols, codelen_codes);
+                    for (auto& codelen : trees.codelens) {
+                        writer.put(codelen_codes[codelen.first],
+                                   trees.codelen_lengths[codelen.first]);
+                        int extra {(codelen.first == 16) ? 2 : (codelen.first == 17) ? 3 :
+                                   (codelen.first == 18) ? 7 : 0};
+                        writer.put(codelen.second, extra);
+                    }
+                }
+                std::uint32_t litlen_codes[litlen_symbols], dist_codes[dist_symbols];
+                huffman_codes(trees.litlen_lengths.data(), litlen_symbols, litlen_codes);
+                huffman_codes(trees.dist_lengths.data(), dist_symbols, dist_codes);
+                for (std::uint32_t t {0}; t < stats.tokens; ++t) {
+                    auto& token = coded[token_index++];
+                    writer.put(litlen_codes[token.symbol], trees.litlen_lengths[token.symbol]);
+                    if (token.symbol > 256) {
+                        // extra bits of length and distance code are written at once
+                        writer.put(token.length_extra |
+                                       dist_codes[token.dist_symbol] << token.length_bits,
+                                   token.length_bits + trees.dist_lengths[token.dist_symbol]);
+                        writer.put(token.dist_extra, token.dist_bits);
+                    }
+                    data_position += token.bytes;
+                }
+                // end of block
+                writer.put(litlen_codes[256], trees.litlen_lengths[256]);
             }
-            local_index++;
-        }
-        position_bit += 8;
-        // inverse order of all bits in bytes (docs say so) and write to dest
-        int i;
-        for (i = 0; i < position_bit; i += 8) {
-            std::uint8_t byte {0};
-            for (int p {0}; p < 8; ++p) {
-                byte += bits[i + p] << p;
+            if (writer.overflow()) {
+                return -1;
             }
-            dest[position_byte++] = reinterpret_cast<char&>(byte);
         }
-        // fill space before the next byte
-        position_bit += (position_bit - i);
     }
+    return finish_stream(dest, size_out, writer, data, size);
+}
+
+int i::Scanline::finish_stream(char* dest, int& size_out, bit_writer& writer, char* const data,
+                               int size) {
+    writer.align();
+    if (writer.overflow()) {
+        return -1;
+    }
+    int position_byte {static_cast<int>(writer.position())};
     auto check_sum = adler32(reinterpret_cast<std::uint8_t* const>(data), size);
     std::uint8_t byte = (check_sum & 0xFF000000) >> 24;
     dest[position_byte++] = reinterpret_cast<std::uint8_t&>(byte);
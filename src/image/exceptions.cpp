@@ -6,6 +6,7 @@
 
 using img::PPMImage;
 using img::PNGImage;
+using img::QOIImage;
 
 // PPM Exceptions.
 img::PPMImage::DecoderError::DecoderError(ErrorType error_type, std::string actual) {
@@ -25,6 +26,21 @@ img::PPMImage::DecoderError::DecoderError(ErrorType error_type, std::string actu
     }
 }
 
+// QOI Exceptions.
+img::QOIImage::DecoderError::DecoderError(ErrorType error_type, std::string actual) {
+    switch (error_type) {
+    case ErrorType::BadSignature:
+        m_error = std::format(fmt_bad_signature, actual);
+        break;
+    case ErrorType::BadImageSize:
+        m_error = std::format(fmt_bad_size, actual);
+        break;
+    case ErrorType::BadImageData:
+        m_error = std::format(fmt_bad_data, actual);
+        break;
+    }
+}
+
 // PNG Exceptions.
 // General exceptions.
 img::PNGImage::DecoderError::DecoderError(ErrorType error_type, std::string actual) {
@@ -75,6 +91,10 @@ const char * img::PPMImage::DecoderError::what() const noexcept {
     return m_error.data();
 }
 
+const char * img::QOIImage::DecoderError::what() const noexcept {
+    return m_error.data();
+}
+
 const char * img::PNGImage::DecoderError::what() const noexcept {
     return m_error.data();
 }
@@ -6,6 +6,22 @@
 #include <algorithm>
 #include <memory>
 #include <cmath>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <filesystem>
+#include <stdexcept>
+#include <format>
+
+// in-kernel file copy
+#if __has_include(<sys/sendfile.h>)
+#define GGPEG_HAS_SENDFILE
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
 
 // Definitions for image class and its supportive structures.
 
@@ -14,6 +30,34 @@ bool img::Image::good() { return _status; }
 void img::Image::read(std::string_view path) {}
 void img::Image::write(std::string_view path) {}
 
+void img::Image::parallel_for(size_t count, unsigned threads,
+                              const std::function<void(size_t)>& job) {
+    if (!threads) {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    threads = std::min<size_t>(threads, count);
+    if (threads <= 1) {
+        for (size_t index {0}; index < count; ++index) {
+            job(index);
+        }
+        return;
+    }
+    std::atomic<size_t> next {0};
+    auto worker = [&] {
+        for (size_t index {next++}; index < count; index = next++) {
+            job(index);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned t {1}; t < threads; ++t) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : workers) {
+        thread.join();
+    }
+}
+
 
 img::ImageType img::get_type(std::string_view path) {
     char buff[8];
@@ -28,22 +72,216 @@ img::ImageType img::get_type(std::string_view path) {
 
     if (Image::Scanline::_cmp_chunks(buff, 8, PNGImage::_signature, 8)) {
         return ImageType::PNG;
-    } else if (Image::Scanline::_cmp_chunks(buff, 2, PPMImage::_binary_magic_number, 2)) {
+    } else if (Image::Scanline::_cmp_chunks(buff, 2, PPMImage::_binary_magic_number, 2) ||
+               Image::Scanline::_cmp_chunks(buff, 2, PPMImage::_ascii_magic_number, 2)) {
         return ImageType::PPM;
+    } else if (Image::Scanline::_cmp_chunks(buff, 2, PPMImage::_gray_magic_number, 2)) {
+        return ImageType::PGM;
+    } else if (Image::Scanline::_cmp_chunks(buff, 2, PPMImage::_bitmap_magic_number, 2)) {
+        return ImageType::PBM;
+    } else if (Image::Scanline::_cmp_chunks(buff, 2, PPMImage::_arbitrary_magic_number, 2)) {
+        return ImageType::PAM;
+    } else if (Image::Scanline::_cmp_chunks(buff, 4, QOIImage::_signature, 4)) {
+        return ImageType::QOI;
     }
     return ImageType::Unknown;
 }
 
-img::Image img::convert(img::Image& img, img::ImageType new_type) {
-    if (new_type == img::ImageType::PNG) {
-        PNGImage new_img {};
-        new_img.get_map() = img.get_map();
-        return new_img;
-    } else if (new_type == img::ImageType::PPM) {
-        PPMImage new_img {};
-        new_img.get_map() = img.get_map();
-        return new_img;
-    } else {
+img::ImageInfo img::probe(std::string_view path) {
+    ImageInfo info {};
+    std::ifstream file {path.data(), std::ios::in | std::ios::binary};
+    // signature, length and type of IHDR, its 13 bytes and CRC
+    char header[33];
+    file.read(header, 8);
+    if (file.fail()) {
+        return info;
+    }
+
+    if (Image::Scanline::_cmp_chunks(header, 8, PNGImage::_signature, 8)) {
+        file.read(header + 8, 25);
+        if (file.fail() || Image::Scanline::_load_be32(header + 8) != 13 ||
+            !Image::Scanline::_cmp_chunks(header + 12, 4, PNGImage::_ihdr_name, 4) ||
+            Image::Scanline::_crc(header + 12, 17) != Image::Scanline::_load_be32(header + 29)) {
+            return info;
+        }
+        info.width = Image::Scanline::_load_be32(header + 16);
+        info.height = Image::Scanline::_load_be32(header + 20);
+        info.bit_depth = static_cast<std::uint8_t>(header[24]);
+        info.color_type = static_cast<std::uint8_t>(header[25]);
+        info.interlaced = header[28] != 0;
+        info.type = ImageType::PNG;
+    } else if (Image::Scanline::_cmp_chunks(header, 4, QOIImage::_signature, 4)) {
+        // signature, width, height, channels and colorspace
+        file.read(header + 8, QOIImage::_header_size - 8);
+        int channels {header[12]};
+        if (file.fail() || (channels != 3 && channels != 4)) {
+            return info;
+        }
+        info.width = Image::Scanline::_load_be32(header + 4);
+        info.height = Image::Scanline::_load_be32(header + 8);
+        info.bit_depth = 8;
+        info.color_type = (channels == 4) ? 6 : 2;
+        info.type = ImageType::QOI;
+    } else if (header[0] == 'P') {
+        // header is parsed in place by the same parser as PPMImage::read() uses, only its
+        // pages of mapped file are read
+        file.close();
+        Image::Scanline scline {path, Image::ScanMode::read};
+        PPMImage::Header ppm_header;
+        try {
+            ppm_header = PPMImage::read_header(scline.view_all());
+        } catch (const PPMImage::DecoderError&) {
+            return info;
+        }
+        // depth (samples per pixel) maps to PNG color types 0, 4, 2 and 6
+        constexpr int color_types[4] {0, 4, 2, 6};
+        info.width = ppm_header.width;
+        info.height = ppm_header.height;
+        info.bit_depth = (ppm_header.format == PPMImage::_bitmap_magic_number[1]) ? 1 : 8;
+        info.color_type = color_types[ppm_header.depth - 1];
+        char format {ppm_header.format};
+        info.type = (format == PPMImage::_gray_magic_number[1]) ? ImageType::PGM :
+                    (format == PPMImage::_bitmap_magic_number[1]) ? ImageType::PBM :
+                    (format == PPMImage::_arbitrary_magic_number[1]) ? ImageType::PAM :
+                    ImageType::PPM;
+    }
+    return info;
+}
+
+bool img::verify(std::string_view path) {
+    try {
+        Image::Scanline scline {path, Image::ScanMode::read};
+        auto file = scline.view_all();
+        if (file.size() >= 8 && Image::Scanline::_cmp_chunks(file.data(), 8,
+                                                             PNGImage::_signature, 8)) {
+            // IHDR goes first, chunk reader throws if a chunk does not fit into file
+            PNGImage::ChunkReader reader {file.subspan(8)};
+            PNGImage::ChunkView view;
+            for (bool first {true}; reader.next(view); first = false) {
+                if ((first && (view.chunk != PNGImage::Chunk::IHDR ||
+                               view.payload.size() != 13)) ||
+                    !PNGImage::check_crc(view)) {
+                    return false;
+                }
+                // fields the decoder would reject (check_ihdr throws)
+                if (first) {
+                    PNGImage::check_ihdr(view.payload.data());
+                }
+                if (view.chunk == PNGImage::Chunk::IEND) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        if (file.size() >= 4 && Image::Scanline::_cmp_chunks(file.data(), 4,
+                                                             QOIImage::_signature, 4)) {
+            constexpr size_t marker {sizeof(QOIImage::_end_marker)};
+            return file.size() >= QOIImage::_header_size + marker &&
+                   Image::Scanline::_cmp_chunks(file.data() + file.size() - marker, marker,
+                                                QOIImage::_end_marker, marker);
+        }
+        auto header = PPMImage::read_header(file);
+        size_t samples {static_cast<size_t>(header.width) * header.height * header.depth};
+        if (header.format == PPMImage::_ascii_magic_number[1]) {
+            size_t position {header.data};
+            for (size_t sample {0}; sample < samples; ++sample) {
+                std::uint32_t value;
+                position = PPMImage::skip_space(file, position);
+                if (!PPMImage::read_number(file, position, value) || value > header.max_color) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        size_t size {(header.format == PPMImage::_bitmap_magic_number[1])
+                         ? (header.width + 7) / 8 * static_cast<size_t>(header.height)
+                         : samples};
+        return file.size() >= header.data && file.size() - header.data >= size;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+std::unique_ptr<img::Image> img::make_image(img::ImageType type) {
+    switch (type) {
+    case ImageType::PNG:
+        return std::make_unique<PNGImage>();
+    case ImageType::PPM:
+        return std::make_unique<PPMImage>();
+    case ImageType::PGM:
+        return std::make_unique<PGMImage>();
+    case ImageType::PBM:
+        return std::make_unique<PBMImage>();
+    case ImageType::PAM:
+        return std::make_unique<PAMImage>();
+    case ImageType::QOI:
+        return std::make_unique<QOIImage>();
+    default:
+        return nullptr;
+    }
+}
+
+std::unique_ptr<img::Image> img::convert(img::Image& img, img::ImageType new_type) {
+    auto new_img = make_image(new_type);
+    if (!new_img) {
         throw std::runtime_error("Invalid type; cannot perform conversion");
     }
+    new_img->get_map() = img.get_map();
+    return new_img;
+}
+
+void img::copy_file(std::string_view from, std::string_view to) {
+    std::string source {from}, target {to};
+    std::error_code error;
+    // file is already in place (opening target would truncate it)
+    if (std::filesystem::equivalent(source, target, error)) {
+        return;
+    }
+#ifdef GGPEG_HAS_SENDFILE
+    int input {open(source.c_str(), O_RDONLY)};
+    struct stat status {};
+    if (input >= 0 && !fstat(input, &status)) {
+        int output {open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)};
+        if (output < 0) {
+            close(input);
+            throw std::runtime_error(std::format("Cannot open file for writing: {}", target));
+        }
+        off_t left {status.st_size};
+        // copy_file_range may be refused for the pair of file systems, sendfile is tried then
+        bool ranges {true};
+        while (left > 0) {
+            ssize_t copied {-1};
+            if (ranges) {
+                copied = copy_file_range(input, nullptr, output, nullptr, left, 0);
+                if (copied < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+                                   errno == EOPNOTSUPP)) {
+                    ranges = false;
+                    continue;
+                }
+            } else {
+                copied = sendfile(output, input, nullptr, left);
+            }
+            // file is shorter than it was (0) or copy failed
+            if (copied <= 0) {
+                break;
+            }
+            left -= copied;
+        }
+        close(input);
+        close(output);
+        if (left > 0) {
+            throw std::runtime_error(std::format("Cannot copy file {} to {}", source, target));
+        }
+        return;
+    }
+    if (input >= 0) {
+        close(input);
+    }
+#endif
+    std::filesystem::copy_file(source, target, std::filesystem::copy_options::overwrite_existing,
+                               error);
+    if (error) {
+        throw std::runtime_error(std::format("Cannot copy file {} to {}: {}", source, target,
+                                             error.message()));
+    }
 }
@@ -6,9 +6,10 @@
 #include <fstream>
 #include <memory>
 #include <stdexcept>
-#include <bitset>
-#include <list>
 #include <climits>
+#include <array>
+#include <functional>
+#include <span>
 
 // Header guard.
 #pragma once
@@ -53,12 +54,18 @@ namespace img {
         static constexpr data32_t red    {0x00ff0000};
         static constexpr data32_t green  {0x0000ff00};
         static constexpr data32_t blue   {0x000000ff};
+        // Transparency (255 - alpha), so that zero bits are opaque.
+        static constexpr data32_t alpha  {0xff000000};
         // Offset of color bits.
         static constexpr data32_t red_shift   {8 * 2};
         static constexpr data32_t green_shift {8 * 1};
         static constexpr data32_t blue_shift      {0};
-        // Single 4-byte variable, where RGB data is stored.
+        static constexpr data32_t alpha_shift {8 * 3};
+        // Single 4-byte variable, where RGBA data is stored.
         data32_t _data;
+        // For scanning of packed colors.
+        friend class PNGImage;
+        friend class QOIImage;
     public:
         /** \brief Get red component of the color.
          * \return value in range [0, 256) which represents
@@ -75,6 +82,10 @@ namespace img {
          * blue component in the color.
          */
         int B() const;
+        /** \brief Get alpha (opacity) of the color.
+         * \return value in range [0, 256), 255 is opaque.
+         */
+        int A() const;
         /** \brief Set red component of the color.
          * \param value number in range [0, 256) to be set.
          * \details This method does not perform range-checking for \a value, which
@@ -96,18 +107,42 @@ namespace img {
          * blue color component into unspecified state.
          */
         void B(int value);
+        /** \brief Set alpha (opacity) of the color.
+         * \param value number in range [0, 256) to be set, 255 is opaque.
+         * \details This method does not perform range-checking for \a value, which
+         * means that passing this value outside of valid range puts
+         * alpha into unspecified state.
+         */
+        void A(int value);
         bool operator==(Color other) const;
         /** \brief Default constructor.
-         * Initializes black color (0x000000).
+         * Initializes opaque black color (0x000000).
          */
         Color();
         /** \brief Constructor with three color components.
          * \param r red component.
          * \param g green component.
          * \param b blue component.
-         * \details Initializes color from three color components.
+         * \details Initializes opaque color from three color components.
          */
         Color(int r, int g, int b);
+        /** \brief Constructor with three color components and alpha.
+         * \param r red component.
+         * \param g green component.
+         * \param b blue component.
+         * \param a alpha, 255 is opaque.
+         */
+        Color(int r, int g, int b, int a);
+    };
+
+    /** \brief Enumeration that represents storage format of \a PixelMap.
+     * Pixels are kept in the format of decoded image, so that processing does not
+     * convert them.
+     */
+    enum class PixelFormat {
+        rgba,   ///< 8-bit RGBA, \a Color for every pixel.
+        rgba16, ///< 16-bit RGBA samples (for ex. of 16-bit PNG), 8 bytes per pixel.
+        gray    ///< 8-bit opaque gray (for ex. of PGM or PBM), 1 byte per pixel.
     };
 
     /** \brief Class representing matrix of pixels.
@@ -115,9 +150,20 @@ namespace img {
      *  alongside default element and dimension access.
      */
     class PixelMap {
+    public:
+        /** \brief RGBA samples of pixel at depth of map format (255 or 65535 is the maximum).
+         */
+        using samples_t = std::array<std::uint16_t, 4>;
+    private:
         using pixel_map_t = std::vector<std::vector<Color>>;
         // Map of pixels.
         pixel_map_t _map;
+        // Maps of pixels in PixelFormat::rgba16 and PixelFormat::gray, only the map of
+        // current format is not empty.
+        std::vector<std::vector<samples_t>> _wide;
+        std::vector<std::vector<std::uint8_t>> _gray;
+        // Format of pixels.
+        PixelFormat _format {PixelFormat::rgba};
         // Dimensions of pixel map.
         size_t _width;
         size_t _height;
@@ -162,9 +208,62 @@ namespace img {
          * \param row row of the pixel.
          * \param column column of the pixel.
          * \return Reference to \a Color object.
-         * For performance reasons this function does not perform range checks.
+         * For performance reasons this function does not perform range checks. Map of other
+         * format is converted to PixelFormat::rgba first.
          */
         Color& at(int row, int column);
+        /** \brief Quick access to gray pixel at (row, column).
+         * \param row row of the pixel.
+         * \param column column of the pixel.
+         * \return Reference to gray value of the pixel.
+         * This function does not perform range checks either. Map of other format is
+         * converted to PixelFormat::gray first.
+         */
+        std::uint8_t& gray(int row, int column);
+        /** \brief Get color of pixel at (row, column) in any format.
+         * \param row row of the pixel.
+         * \param column column of the pixel.
+         * \return Color of the pixel, 16-bit samples are rounded to 8 bits.
+         */
+        Color color(int row, int column) const;
+        /** \brief Get samples of pixel at (row, column) at depth of map format.
+         * \param row row of the pixel.
+         * \param column column of the pixel.
+         * \return RGBA samples of the pixel.
+         */
+        samples_t samples(int row, int column) const;
+        /** \brief Set samples of pixel at (row, column) at depth of map format.
+         * \param row row of the pixel.
+         * \param column column of the pixel.
+         * \param samples RGBA samples not greater than max_sample().
+         * \details Map of PixelFormat::gray keeps luma of the samples (ITU-R BT.601), alpha
+         * is dropped.
+         */
+        void samples(int row, int column, const samples_t& samples);
+        /** \brief Copy pixel of another map to (row, column).
+         * \param row row of the pixel.
+         * \param column column of the pixel.
+         * \param from map to copy pixel from.
+         * \param from_row row of the pixel in \a from.
+         * \param from_column column of the pixel in \a from.
+         * \details Pixels of maps of the same format are copied as they are, otherwise samples
+         * are scaled to depth of this map.
+         */
+        void copy(int row, int column, const PixelMap& from, int from_row, int from_column);
+        /** \brief Get the maximum sample of map format.
+         * \return 255 or 65535 for PixelFormat::rgba16.
+         */
+        std::uint16_t max_sample() const;
+        /** \brief Get format of pixels.
+         * \return Current format of map.
+         */
+        PixelFormat format() const;
+        /** \brief Convert pixels to another format.
+         * \param format new format of map.
+         * \details Pixels are copied as by copy(), so conversion to PixelFormat::gray keeps
+         * only luma of them.
+         */
+        void format(PixelFormat format);
         /** \brief Get number of rows the map has.
          * \return Number of rows in the map.
          */
@@ -176,20 +275,50 @@ namespace img {
         /** \brief Constructs pixel map of designated width and height.
          * \param width number of rows
          * \param height number of columns
+         * \param format format of pixels
          */
-        PixelMap(size_t width, size_t height);
+        PixelMap(size_t width, size_t height, PixelFormat format = PixelFormat::rgba);
     };
 
     // Type of image
     enum class ImageType {
         PPM,
         PNG,
+        PGM,
+        PBM,
+        PAM,
+        QOI,
         Unknown
     };
 
     // Checks type of image at the following path
     ImageType get_type(std::string_view path);
 
+    // Properties of image, that are stored in its header
+    struct ImageInfo {
+        ImageType type {ImageType::Unknown};
+        std::uint32_t width {0};
+        std::uint32_t height {0};
+        int bit_depth {0};          // bits per sample
+        int color_type {0};         // PNG color type (2 - true color, which is the case for PPM)
+        bool interlaced {false};
+    };
+
+    // Reads only header of image at the following path (signature and IHDR for PNG, header
+    // for netpbm formats) without decoding it. Type is Unknown if the file is missing,
+    // unsupported or its header is broken.
+    ImageInfo probe(std::string_view path);
+
+    // Checks structure of image file without decoding pixels: chunks of PNG up to IEND with
+    // their CRCs, size of netpbm image data (samples of ASCII one) and end marker of QOI.
+    // Returns false if the file is missing, unsupported or broken.
+    bool verify(std::string_view path);
+
+    // Copies file from one path to another inside of kernel (copy_file_range, then sendfile)
+    // where it is supported, so that its data is never read into memory. Throws
+    // std::runtime_error if the file cannot be copied.
+    void copy_file(std::string_view from, std::string_view to);
+
     /** \brief Base image class.
      *  Provides basic interface for image class usage.
      */
@@ -216,41 +345,212 @@ namespace img {
             size_t _buffer_size {0};
             // Scanline mode (See ScanMode enum).
             ScanMode _mode;
-            // CRC table
-            static std::unique_ptr<std::uint32_t[]> _crc_lookup_table;
+            // CRC register of the chunk being written.
+            std::uint32_t _chunk_crc {0xFFFFFFFF};
+            // Path of the file (for memory mapping).
+            std::string _path {};
+            // Whole file mapped into memory by view_all() (nullptr if it is not mapped).
+            void* _mapping {nullptr};
+            size_t _mapping_size {0};
+            // Whole file read by view_all() where mapping is not available.
+            std::vector<char> _file_data {};
+            // CRC table, built at compile time so that it is never mutated at runtime
+            static constexpr std::array<std::uint32_t, 256> _crc_lookup_table = [] {
+                std::array<std::uint32_t, 256> table {};
+                for (std::uint32_t n {0}; n < 256; ++n) {
+                    std::uint32_t curr {n};
+                    for (int k {0}; k < 8; ++k) {
+                        curr = (curr & 1) ? 0xedb88320L ^ (curr >> 1) : curr >> 1;
+                    }
+                    table[n] = curr;
+                }
+                return table;
+            }();
             // Window size
             static constexpr std::uint64_t window_size  {1024 * 32};
             // Single Block size
             static constexpr std::uint64_t block_size   {1024 * 32 - 1};
-            // Default compression level
-            static constexpr int default_compression    {3};
-            // Data node for LZ77 algorithm
+            // Data node for LZ77 algorithm: literal byte if length is 0, otherwise a match
+            // of length bytes, that starts offset bytes behind the current position
             struct triplet {
                 std::uint8_t byte {0};
                 std::uint32_t offset;
                 std::uint32_t length;
             };
-            // Needed for range checking
-            static char* buffer_start;
-            static char* buffer_end;
+            // Shortest and longest match allowed by deflate
+            static constexpr std::uint32_t min_match {3};
+            static constexpr std::uint32_t max_match {258};
+            // Number of bits in hash of 3 bytes, that starts a hash chain
+            static constexpr int hash_bits {15};
+            // Limits of match search (same meaning as in zlib configuration table)
+            struct match_params {
+                std::uint32_t good_length;  // reduce chain search if previous match is this long
+                std::uint32_t lazy_length;  // do not look for better match if current is this long
+                std::uint32_t nice_length;  // stop search once match is this long
+                std::uint32_t max_chain;    // max number of positions checked in hash chain
+            };
+            // Match search limits for compression levels 0 - 9 (level 0 only stores data)
+            static constexpr match_params level_params[10] {
+                {0, 0, 0, 0},
+                {4, 4, 8, 4},
+                {4, 5, 16, 8},
+                {4, 6, 32, 32},
+                {4, 4, 16, 16},
+                {8, 16, 32, 32},
+                {8, 16, 128, 128},
+                {8, 32, 128, 256},
+                {32, 128, 258, 1024},
+                {32, 258, 258, 4096}
+            };
+            // Hash chains: head of chain for every hash and link to previous position
+            // with the same hash for every position in the window
+            struct hash_chains {
+                std::vector<std::int32_t> head;
+                std::vector<std::int32_t> prev;
+            };
             // Constant for Adler32 checksum
             static constexpr uint32_t mod_adler {65521};
-            // Calculates Adler32 checksum
-            static uint32_t adler32(std::uint8_t* data, size_t len);
-            // Gets moved buffer after range check
-            static std::uint8_t* move_buffer(std::uint8_t* data, std::int32_t number);
-            // Finds string match in window and return LZ77 node
-            static triplet find_match(std::uint8_t* sliding_window, int size);
-            // Performs initial compression in Deflate algorithm
-            static std::list<triplet> lz77(std::uint8_t* data, int size,
-                                           const std::uint64_t window_size);
-            // Matches offset to static Huffman code
+            // Calculates Adler32 checksum, adler is the checksum of preceding data
+            static uint32_t adler32(std::uint8_t* data, size_t len, uint32_t adler = 1);
+            // Hash of 3 bytes at data
+            static std::uint32_t hash3(const std::uint8_t* data);
+            // Finds the longest match for position in hash chain, that is longer than prev_length
+            static triplet find_match(const hash_chains& chains, const std::uint8_t* data,
+                                      std::uint32_t position, std::uint32_t size,
+                                      std::uint32_t window_size, std::uint32_t prev_length,
+                                      const match_params& params);
+            // Progress of LZ77 over one input, so that its nodes can be taken in batches
+            struct lz77_state {
+                hash_chains chains;
+                std::uint32_t position {0};     // next position of input to look at
+                triplet previous {0, 0, 0};     // match (or literal) waiting for lazy matching
+                bool pending {false};
+            };
+            // Prepares state for a new input, memory of hash chains is reused
+            static void lz77_reset(lz77_state& state, const std::uint64_t window_size);
+            // Continues LZ77 of data, appending nodes to tokens until there are limit of them;
+            // returns true once the whole input is processed
+            static bool lz77_run(lz77_state& state, const std::uint8_t* data, std::uint32_t size,
+                                 const std::uint64_t window_size, const match_params& params,
+                                 std::vector<triplet>& tokens, size_t limit);
+            // Performs initial compression in Deflate algorithm, nodes are written to tokens
+            // (buffer is cleared first, so its memory is reused between calls)
+            static void lz77(const std::uint8_t* data, std::uint32_t size,
+                             const std::uint64_t window_size, const match_params& params,
+                             std::vector<triplet>& tokens);
+            // Matches offset to distance symbol (low 5 bits) and its extra bits (the rest)
             static std::uint32_t match_offset(std::uint32_t offset, int& out_len);
-            // Matches length to static Huffman code
+            // Matches length to literal/length symbol (low 9 bits) and its extra bits (the rest)
             static std::uint32_t match_length(std::uint32_t length, int& out_len);
-            // Adds a number to bitset, also moving current pointer by number of bits inserted.
-            static void add_bits(std::bitset<block_size * 128>& source, std::uint32_t bits,
-                                 int& pos, int number);
+            // Streaming writer of deflate bit stream: bits are gathered least significant first
+            // in 64-bit accumulator and written to destination by whole 32-bit words
+            class bit_writer {
+            public:
+                bit_writer(char* dest, size_t capacity, size_t position);
+                // Appends count (up to 32) low bits of value
+                void put(std::uint64_t value, int count) {
+                    _accumulator |= value << _count;
+                    _count += count;
+                    if (_count >= 32) {
+                        write_word();
+                    }
+                }
+                // Pads stream with zero bits to byte boundary and writes out all pending bytes
+                void align();
+                // Copies raw bytes to aligned stream
+                void copy(const char* data, size_t size);
+                // Position of the next byte in destination (stream must be aligned)
+                size_t position() const { return _position; }
+                // True if destination was too small for the stream
+                bool overflow() const { return _overflow; }
+            private:
+                void write_word();
+
+                std::uint8_t* _dest;
+                size_t _capacity;
+                size_t _position;
+                std::uint64_t _accumulator {0};
+                int _count {0};
+                bool _overflow {false};
+            };
+            // Sizes of deflate alphabets: literal/length, distance and code length ones
+            static constexpr int litlen_symbols  {288};
+            static constexpr int dist_symbols    {30};
+            static constexpr int codelen_symbols {19};
+            // Order in which code length tree is stored in block header
+            static constexpr int codelen_order[codelen_symbols]
+                {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+            // Maximum length of Huffman code in literal/length (and distance) and code length trees
+            static constexpr int max_code_length    {15};
+            static constexpr int max_codelen_length {7};
+            // Number of LZ77 nodes in the smallest block considered by block splitting
+            static constexpr std::uint32_t split_granularity {2048};
+            // LZ77 node mapped to deflate symbols
+            struct coded_token {
+                std::uint16_t symbol;       // literal/length symbol
+                std::uint16_t length_extra; // extra bits of length
+                std::uint8_t length_bits;   // number of extra bits of length
+                std::uint8_t dist_symbol;   // distance symbol
+                std::uint16_t dist_extra;   // extra bits of distance
+                std::uint8_t dist_bits;     // number of extra bits of distance
+                std::uint16_t bytes;        // number of input bytes the node stands for
+            };
+            // Symbol statistics of a block (can be summed up for adjacent blocks)
+            struct block_stats {
+                std::array<std::uint32_t, litlen_symbols> litlen_freq {};
+                std::array<std::uint32_t, dist_symbols> dist_freq {};
+                std::uint64_t extra_bits {0};   // total number of extra bits of lengths and distances
+                std::uint64_t bytes {0};        // number of input bytes
+                std::uint32_t tokens {0};       // number of LZ77 nodes
+                block_stats& operator+=(const block_stats& other);
+            };
+            // Huffman trees of a block and their cost
+            struct block_trees {
+                std::array<std::uint8_t, litlen_symbols> litlen_lengths {};
+                std::array<std::uint8_t, dist_symbols> dist_lengths {};
+                std::array<std::uint8_t, codelen_symbols> codelen_lengths {};
+                // code length symbols with their extra values (run-length encoded lengths)
+                std::vector<std::pair<std::uint8_t, std::uint8_t>> codelens {};
+                int hlit {257};
+                int hdist {1};
+                int hclen {4};
+                std::uint64_t cost {0}; // size of the whole block in bits
+            };
+            // Type of deflate block
+            enum class block_type {
+                stored = 0,
+                fixed = 1,
+                dynamic = 2
+            };
+            // Builds Huffman code lengths not longer than max_length for given frequencies
+            static void huffman_lengths(const std::uint32_t* freq, int count, int max_length,
+                                        std::uint8_t* lengths);
+            // Assigns canonical Huffman codes to code lengths, codes are bit-reversed
+            // to be written by bit_writer
+            static void huffman_codes(const std::uint8_t* lengths, int count, std::uint32_t* codes);
+            // Fills trees with fixed Huffman codes and calculates cost of the block with them
+            static void fixed_trees(const block_stats& stats, block_trees& trees);
+            // Builds dynamic Huffman trees for statistics and calculates cost of the block
+            static void dynamic_trees(const block_stats& stats, block_trees& trees);
+            // Calculates cost of storing bytes as stored blocks
+            static std::uint64_t stored_cost(std::uint64_t bytes);
+            // Number of LZ77 nodes deflated at once (the longest block made of whole segments),
+            // so that memory of deflate does not depend on size of input
+            static constexpr size_t batch_tokens {block_size / split_granularity *
+                                                  split_granularity};
+            // Buffers of built-in deflate, they are kept between calls by every thread
+            struct deflate_state {
+                lz77_state lz77;
+                std::vector<triplet> tokens;
+                std::vector<coded_token> coded;
+                std::vector<block_stats> blocks;
+            };
+            // Writes size bytes of data as stored blocks, last marks the final block of stream
+            static void put_stored(bit_writer& writer, const char* data, std::uint64_t size,
+                                   bool last);
+            // Aligns deflate stream, appends Adler32 of data and sets size_out (-1 on overflow)
+            static int finish_stream(char* dest, int& size_out, bit_writer& writer,
+                                     char* const data, int size);
         public:
             /** \brief Resets buffer by a number of bytes.
              * \param number defines [0; number) interval to be removed
@@ -280,10 +580,39 @@ namespace img {
              * \param number number of bytes to read
              */
             void call_read(size_t number);
+            /** \brief Reads the rest of the file in one call, bypassing internal buffer.
+             * \param dest vector to fill, its previous contents are replaced
+             */
+            void read_all(std::vector<char>& dest);
+            /** \brief Gives read-only view of the whole file.
+             * \return View, that is valid while Scanline exists.
+             * \details The file is mapped into memory where the platform allows it, so that
+             * pages, which are never accessed, are never read from disk. Otherwise the file is
+             * read in one call.
+             */
+            std::span<const char> view_all();
             /** \brief Flushes bytes and resets written bytes in the internal buffer.
              * \param number number of bytes to flush and reset
              */
             void call_write(size_t number);
+            /** \brief Writes bytes straight to the file, bypassing internal buffer.
+             * \param data bytes to write
+             * \param size number of bytes
+             */
+            void write_bytes(const char* data, size_t size);
+            /** \brief Starts a chunk (PNG layout): writes its length and type, resets CRC.
+             * \param type 4-byte chunk type
+             * \param size size of chunk payload, that follows
+             */
+            void begin_chunk(const char* type, std::uint32_t size);
+            /** \brief Writes part of payload of the current chunk, updating its CRC on the fly.
+             * \param data payload bytes
+             * \param size number of bytes
+             */
+            void write_chunk_data(const char* data, size_t size);
+            /** \brief Finishes the current chunk by writing CRC of its type and payload.
+             */
+            void end_chunk();
             /** \brief Returns byte at specified position.
              * \param index position of the byte
              * \return Byte at \a index position.
@@ -327,15 +656,94 @@ namespace img {
              * \return 4-byte CRC.
              */
             static std::uint32_t _crc(const char* buffer, size_t size);
+            /** \brief Continues CRC calculation with next bytes.
+             * \param crc CRC register (0xFFFFFFFF before the first byte, result is inverted)
+             * \param buffer next bytes
+             * \param size number of bytes
+             * \return Updated CRC register.
+             */
+            static std::uint32_t _crc_update(std::uint32_t crc, const char* buffer, size_t size);
+            /** \brief Stores number as 4 big-endian bytes.
+             * \param dest buffer to store to
+             * \param value number to store
+             */
+            static void _store_be32(char* dest, std::uint32_t value);
+            /** \brief Loads number stored as 4 big-endian bytes.
+             * \param bytes buffer to load from (no alignment required)
+             * \return Loaded number.
+             */
+            static std::uint32_t _load_be32(const char* bytes);
             /** \brief Assembles chunk of bytes with value \a value.
              * \param value value of a new buffer
              * \param size size of new buffer
              * \return Pointer to the buffer, which holds value \a value.
              */
             static std::unique_ptr<char[]> _set_chunk(std::uint64_t value, size_t size);
-            // Compression
-            static int deflate(char* dest, int& size_out, char* const data, int size);
+            // Compression (built-in deflate, level is in range [0; 9], 0 stores data as zlib does)
+            static int deflate(char* dest, int& size_out, char* const data, int size,
+                               int level = 6);
+            // Size of the input block deflated by one worker in parallel_deflate()
+            static constexpr std::uint64_t parallel_block_size {1024 * 128};
+            // Parameters of zlib deflate (see deflateInit2() in zlib manual)
+            struct zlib_params {
+                int level       {6};    // 0 (store) - 9 (best compression)
+                int strategy    {0};    // Z_DEFAULT_STRATEGY, Z_RLE etc.
+                int mem_level   {8};    // 1 - 9, memory used for internal state
+                int window_bits {15};   // 9 - 15, base two logarithm of window size
+            };
+            /** \brief Compresses data into zlib stream using several threads.
+             * \param dest buffer to store the stream into (resized by the function)
+             * \param data data to compress
+             * \param size size of data
+             * \param threads number of worker threads
+             * \param params zlib parameters of compression
+             * \return zlib status of the compression.
+             * \details Data is split into blocks of \a parallel_block_size bytes, each block is
+             * deflated independently with the previous window as dictionary and terminated with
+             * sync flush, then Adler32 checksums of blocks are combined. Block boundaries do not
+             * depend on \a threads, so the output is the same for any number of threads.
+             */
+            static int parallel_deflate(std::vector<std::uint8_t>& dest, const std::uint8_t* data,
+                                        size_t size, unsigned threads, const zlib_params& params);
+            // Called for every inflated row with its index, inflation stops if it returns false
+            using row_callback = std::function<bool(const std::uint8_t* row, size_t index)>;
+            /** \brief Decompresses zlib stream and hands back decoded data row by row.
+             * \param data zlib stream
+             * \param size size of the stream
+             * \param row_size size of one row of decompressed data
+             * \param rows number of rows, stream must decompress to exactly row_size * rows bytes
+             * \param on_row function, that is called for every row as soon as it is complete
+             * \return True if the whole stream was decoded, false if on_row stopped decoding.
+             * \details Built-in decoder with two-level lookup tables (pairs of short literals
+             * are decoded with one lookup) and 64-bit bit buffer. Only 32 KiB window and the row
+             * being decoded are kept, so row passed to on_row is valid until it returns. Throws
+             * std::runtime_error if the stream is corrupted or its size does not match.
+             */
+            static bool inflate(const std::uint8_t* data, size_t size, size_t row_size,
+                                size_t rows, const row_callback& on_row);
+            /** \brief Decompresses zlib stream made of rows of different sizes.
+             * \param data zlib stream
+             * \param size size of the stream
+             * \param row_sizes sizes of rows, stream must decompress to exactly their sum
+             * \param on_row function, that is called for every row as soon as it is complete
+             * \return True if the whole stream was decoded, false if on_row stopped decoding.
+             * \details Same as the other overload, used for interlaced images.
+             */
+            static bool inflate(const std::uint8_t* data, size_t size,
+                                const std::vector<size_t>& row_sizes, const row_callback& on_row);
+        private:
+            // State of inflate()
+            class inflater;
         };
+        /** \brief Runs a job for every index in [0; count) on several threads.
+         * \param count number of jobs
+         * \param threads maximum number of threads, 0 stands for hardware concurrency
+         * \param job function that is called with index of the job
+         * \details Jobs are distributed dynamically, so the order in which they are run is
+         * unspecified. The function returns after all jobs are done.
+         */
+        static void parallel_for(size_t count, unsigned threads,
+                                 const std::function<void(size_t)>& job);
         // Map of pixels.
         PixelMap _map {0, 0};
         // Status of the last IO operation.
@@ -362,19 +770,58 @@ namespace img {
         bool good();
         virtual ~Image() = default;
 
-        // For access to signature
+        // For access to signature and structure of file
         friend ImageType get_type(std::string_view path);
+        friend ImageInfo probe(std::string_view path);
+        friend bool verify(std::string_view path);
     };
 
+    /** \brief PPM image (P6, reads ASCII P3 too).
+     *  Reading is shared by the whole netpbm family: PGM, PBM and PAM files are read by it as
+     *  well, derived classes only write their own format.
+     */
     class PPMImage : public Image {
-    private:
+    protected:
         // Probably useless.
         constexpr static std::uint_fast64_t _size_limit {5000};
         // PPM file signatures.
         constexpr static char _binary_magic_number[3] {"P6"};
         constexpr static char _ascii_magic_number[3] {"P3"};
+        // Signatures of the rest of netpbm formats.
+        constexpr static char _gray_magic_number[3] {"P5"};
+        constexpr static char _bitmap_magic_number[3] {"P4"};
+        constexpr static char _arbitrary_magic_number[3] {"P7"};
         // Max allowed color value.
         int _max_color {255};
+        // Fields of netpbm header.
+        struct Header {
+            char format {0};                // digit of magic number ('3' - '7')
+            std::uint32_t width {0};
+            std::uint32_t height {0};
+            std::uint32_t max_color {0};    // 1 for PBM
+            std::uint32_t depth {0};        // samples per pixel: 1 - gray, 2 - gray and alpha,
+                                            // 3 - RGB, 4 - RGB and alpha
+            size_t data {0};                // offset of image data
+        };
+        // Parses header (magic number, dimensions and max color, separated by whitespace and
+        // comments, or PAM header lines). Throws DecoderError if it is broken.
+        static Header read_header(std::span<const char> data);
+        // Parses fields of PAM header after magic number up to ENDHDR line.
+        static void read_pam_header(std::span<const char> data, Header& header);
+        // Returns position of the first character after whitespace and comments.
+        static size_t skip_space(std::span<const char> data, size_t position);
+        // Parses decimal number at position and moves position after it. Returns false, if
+        // there is no number or it does not fit into 32 bits.
+        static bool read_number(std::span<const char> data, size_t& position,
+                                std::uint32_t& value);
+        // Parses samples of ASCII (P3) image data.
+        void read_ascii(std::span<const char> data, const Header& header);
+        // Unpacks bits of PBM (P4) image data, 1 is black.
+        void read_bitmap(std::span<const char> data, const Header& header);
+        // Luma of color (ITU-R BT.601), exact for gray colors.
+        static int luma(Color color);
+        // Writes image data of depth (1 - 4) samples per pixel.
+        void write_samples(std::ofstream& file, std::uint32_t depth);
     public:
         // These are the same to base class.
         virtual void read(std::string_view path) override;
@@ -405,8 +852,97 @@ namespace img {
             const char* what() const noexcept override;
         };
 
-        // For access to signature
+        // For access to signature and structure of file
+        friend ImageType get_type(std::string_view path);
+        friend ImageInfo probe(std::string_view path);
+        friend bool verify(std::string_view path);
+    };
+
+    /** \brief PGM image (P5), gray samples of one byte per pixel.
+     *  Colored pixels are written as their luma.
+     */
+    class PGMImage : public PPMImage {
+    public:
+        virtual void write(std::string_view path) override;
+        PGMImage() = default;
+    };
+
+    /** \brief PBM image (P4), one bit per pixel.
+     *  Pixels with luma below the half of max color are written black.
+     */
+    class PBMImage : public PPMImage {
+    public:
+        virtual void write(std::string_view path) override;
+        PBMImage() = default;
+    };
+
+    /** \brief PAM image (P7).
+     *  Written as GRAYSCALE or RGB tuples, with alpha if any pixel is not opaque.
+     */
+    class PAMImage : public PPMImage {
+    public:
+        virtual void write(std::string_view path) override;
+        PAMImage() = default;
+    };
+
+    /** \brief QOI image ("Quite OK Image" format).
+     *  Lossless, encoded and decoded in a single pass over pixels, intended for intermediate
+     *  files. Alpha channel is written only if any pixel is not opaque.
+     */
+    class QOIImage : public Image {
+    private:
+        // File signature.
+        constexpr static char _signature[5] {"qoif"};
+        // Size of header (signature, width, height, channels and colorspace).
+        constexpr static size_t _header_size {14};
+        // End of data marker.
+        constexpr static char _end_marker[8] {0, 0, 0, 0, 0, 0, 0, 1};
+        // Max number of pixels (limit of reference implementation).
+        constexpr static std::uint64_t _pixels_limit {400'000'000};
+        // Size of buffer of encoded data, that is written at once.
+        constexpr static size_t _buffer_size {64 * 1024};
+        // Operation tags, 2-bit ones are in high bits of byte.
+        constexpr static std::uint8_t _op_index {0x00};
+        constexpr static std::uint8_t _op_diff  {0x40};
+        constexpr static std::uint8_t _op_luma  {0x80};
+        constexpr static std::uint8_t _op_run   {0xc0};
+        constexpr static std::uint8_t _op_rgb   {0xfe};
+        constexpr static std::uint8_t _op_rgba  {0xff};
+        constexpr static std::uint8_t _mask_2   {0xc0};
+        // Position of RGBA pixel in array of previously seen pixels.
+        static std::uint32_t hash(std::uint32_t r, std::uint32_t g, std::uint32_t b,
+                                  std::uint32_t a);
+    public:
+        // These are the same to base class.
+        virtual void read(std::string_view path) override;
+        virtual void write(std::string_view path) override;
+        QOIImage() = default;
+        // Error types.
+        enum class ErrorType {
+            BadSignature,
+            BadImageSize,
+            BadImageData
+        };
+
+        // Class that represents general problems with decoding QOI.
+        class DecoderError : public std::exception {
+        private:
+            static constexpr char fmt_bad_signature[]
+                {"Bad signature, decoded: <{}>. Are you sure this image is QOI?"};
+            static constexpr char fmt_bad_size[]
+                {"Bad image dimensions, decoded: <{}>"};
+            static constexpr char fmt_bad_data[]
+                {"Bad image data, decoder status: <{}>"};
+            std::string m_error;
+        public:
+            DecoderError(ErrorType error_type, std::string actual);
+            const char* what() const noexcept override;
+        };
+
+        // For access to signature and structure of file
         friend ImageType get_type(std::string_view path);
+        friend ImageInfo probe(std::string_view path);
+        friend bool verify(std::string_view path);
     };
 
     class PNGImage : public Image {
@@ -422,14 +958,29 @@ namespace img {
         constexpr static char _iend_name[4] {'I', 'E', 'N', 'D'};
         constexpr static char _idat_name[4] {'I', 'D', 'A', 'T'};
         constexpr static char _ihdr_name[4] {'I', 'H', 'D', 'R'};
+        constexpr static char _plte_name[4] {'P', 'L', 'T', 'E'};
         // Chunk types.
         enum class Chunk {
-            IHDR, IDAT, IEND, Unknown
+            IHDR, PLTE, IDAT, IEND, Unknown
+        };
+        // Chunk of PNG data stream, viewed in place inside of the file buffer.
+        struct ChunkView {
+            Chunk chunk {Chunk::Unknown};
+            const char* type {nullptr};         // 4 bytes of type, payload follows them
+            std::span<const char> payload {};
+            std::uint32_t crc {0};              // CRC stored in the file
+        };
+        // Walks chunks of data stream (after signature) without copying them.
+        class ChunkReader {
+        public:
+            explicit ChunkReader(std::span<const char> data);
+            // Fills view with the next chunk, returns false at the end of data. Throws
+            // DecoderError if the chunk does not fit into the data.
+            bool next(ChunkView& view);
+        private:
+            std::span<const char> _data;
+            size_t _position {0};
         };
-        // Buffers.
-        static char _chunk_1b[1];
-        static char _chunk_4b[4];
-        static char _chunk_8b[8];
         // Fields of PNG header.
         int bit_depth           {8}; // 1 byte per sample unit (for ex. color component)
         int color_type          {2}; // type of samples
@@ -437,27 +988,115 @@ namespace img {
         int filter_method       {0}; // adaptive filter
         int interlace_method    {0}; // no interlace, default byte order
         int sample_size         {3}; // 3 units in sample
+        // Size of image in file (map is smaller, if image is decoded scaled down).
+        std::uint32_t _width    {0};
+        std::uint32_t _height   {0};
+        // Decoded window of image (DecodeOptions::region clamped to the image).
+        std::uint32_t _window_row       {0};
+        std::uint32_t _window_column    {0};
+        std::uint32_t _window_rows      {0};
+        std::uint32_t _window_columns   {0};
+        // Sums of color components of the current row of boxes for scaled decoding.
+        std::vector<std::uint32_t> _box_sums {};
+        // RGB triplets of palette (PLTE) of indexed color image.
+        std::vector<std::uint8_t> _palette {};
+        // Scanline converted to RGB triplets (RGBA quadruplets for image with alpha).
+        std::vector<std::uint8_t> _rgb_line {};
+        // Channels of converted scanline: 3, or 4 for image with alpha.
+        size_t _channels {3};
+        // Samples of 16-bit scanline in native byte order and scaled down to 8 bits.
+        std::vector<std::uint16_t> _wide_line {};
+        std::vector<std::uint8_t> _narrow_line {};
         static constexpr int _size_limit {5000};
+        // Samples of every color type: gray, -, true color, indexed, gray with alpha, -, RGBA.
+        static constexpr int _color_samples[7] {1, 0, 3, 1, 2, 0, 4};
         // Parse functions. (chunks)
-        // Reads and checks CRC.
-        bool read_crc(char* buffer, size_t size);
-        // Reads header of a chunk.
-        void read_chunk_header(char*& buffer, Chunk& chunk, size_t& size);
-        // Reads IHDR data.
-        void read_ihdr(char*& buffer);
-        // Reads IDAT data.
-        void read_idat(char*& buffer, size_t size);
+        // Checks CRC of chunk type and payload against the stored one.
+        static bool check_crc(const ChunkView& view);
+        // Checks fields of IHDR data (13 bytes), throws IHDRDecoderError if image is not supported.
+        static void check_ihdr(const char* data);
+        // Reads IHDR data (13 bytes).
+        void read_ihdr(const char* data);
+        // Reads palette from PLTE.
+        void read_plte(const ChunkView& view, bool after_idat);
+        // Reads IDAT data (zlib stream of all IDAT chunks).
+        void read_idat(const char* data, size_t size);
         // Writes IHDR.
         void write_ihdr(Scanline& scanline);
-        // Writes IDAT.
-        void write_idat(Scanline& scanline);
+        // Writes PLTE.
+        void write_plte(Scanline& scanline);
+        // Writes IDAT (indices are used for indexed color image).
+        void write_idat(Scanline& scanline, const std::vector<std::uint8_t>& indices);
         // Writes IEND.
         void write_iend(Scanline& scanline);
+        // Writes safe-to-copy retained ancillary chunks from one side of image data.
+        void write_ancillary(Scanline& scanline, bool after_idat);
+        // Sampling of filtered data for Strategy::automatic: size of sample, entropy (bits per
+        // byte) above which data is stored and minimum gain of full deflate over RLE
+        static constexpr size_t _sample_size {64 * 1024};
+        static constexpr double _stored_entropy {7.8};
+        static constexpr double _min_deflate_gain {0.02};
+        // Chooses stored blocks, Z_RLE or Z_DEFAULT_STRATEGY for filtered data of size bytes
+        // (rows of row_size bytes) by its statistics and trial compression of a sample.
+        void select_strategy(const std::uint8_t* data, size_t size, size_t row_size,
+                             Scanline::zlib_params& params);
         // Parse functions. (IDAT)
-        // Parses data of 8-bit true color image.
-        void parse_8b_truecolor(std::uint8_t*& buffer, size_t size);
+        // Unfilters one scanline (upper_line is nullptr for the first one) and stores its
+        // pixels to the row of map.
+        void parse_line(std::uint8_t* line, std::uint8_t* upper_line, size_t row);
+        // Size of scanline of width pixels in bytes, including filter type byte.
+        size_t scanline_size(size_t width) const;
+        // Converts count unfiltered pixels of scanline starting from first one to 8-bit RGB
+        // triplets or RGBA quadruplets (8-bit true color pixels are returned in place).
+        const std::uint8_t* to_rgb(const std::uint8_t* pixels, size_t first, size_t count);
+        // Loads count big-endian 16-bit samples in native byte order.
+        static void load_be16(const std::uint8_t* data, std::uint16_t* samples, size_t count);
+        // Reverses filter of scanline (filter type byte and size - 1 bytes), upper_line is
+        // nullptr for the first scanline.
+        void unfilter_line(std::uint8_t* line, std::uint8_t* upper_line, size_t size);
+        // Adam7 passes: first row, first column, row step and column step.
+        static constexpr std::uint32_t _adam7[7][4] {
+            {0, 0, 8, 8}, {0, 4, 8, 8}, {4, 0, 8, 4}, {0, 2, 4, 4},
+            {2, 0, 4, 2}, {0, 1, 2, 2}, {1, 0, 2, 1}
+        };
+        // Row and column masks of blocks, that are covered by one pixel after each pass.
+        static constexpr std::uint32_t _adam7_blocks[7][2] {
+            {7, 7}, {7, 3}, {3, 3}, {3, 1}, {1, 1}, {1, 0}, {0, 0}
+        };
+        // Decodes IDAT data of interlaced image.
+        void read_adam7(const std::uint8_t* data, size_t size);
+        // Unfilters scanline of Adam7 pass (size bytes, upper_line is nullptr for the first one
+        // in pass) and stores its pixels to their places in the map.
+        void parse_adam7_line(std::uint8_t* line, std::uint8_t* upper_line, size_t pass,
+                              size_t size, size_t row);
+        // Stores pixel at image coordinates to the map (or to box sums in scaled decoding),
+        // pixels outside of the window are dropped.
+        void put_pixel(size_t row, size_t column, const std::uint8_t* pixel,
+                       const std::uint16_t* wide);
+        // Stores 16-bit samples of decoded pixel to the map of PixelFormat::rgba16 (gray is
+        // spread to RGB, no alpha is opaque).
+        void store_wide(size_t row, size_t column, const std::uint16_t* samples);
+        // Stores averages of box sums of interlaced image to the map.
+        void finish_boxes();
+        // Adds unfiltered pixels of a row of the window to box sums and stores averages of the
+        // boxes to the map after the last row of them.
+        void accumulate_boxes(const std::uint8_t* pixels, size_t row);
         // Assembles data of 8-bit true color image.
         void assemble_8b_truecolor(std::unique_ptr<std::uint8_t[]>& buffer, size_t& size);
+        // Checks whether every pixel of image is gray (R == G == B), samples of map of other
+        // format than PixelFormat::rgba are checked at its depth.
+        bool is_grayscale();
+        // Checks whether any pixel of image is not opaque, at depth of the map.
+        bool has_alpha();
+        // Assembles data of grayscale (luma of colored pixels) or true color image with or
+        // without alpha of bit_depth (8 or 16) bits per sample.
+        void assemble_samples(std::unique_ptr<std::uint8_t[]>& buffer, size_t& size);
+        // Collects palette of image and palette index of every pixel, returns false (and leaves
+        // palette empty) if image has more than 256 colors.
+        bool build_palette(std::vector<std::uint8_t>& indices);
+        // Assembles data of indexed color image of bit_depth bits per index.
+        void assemble_indexed(const std::vector<std::uint8_t>& indices,
+                              std::unique_ptr<std::uint8_t[]>& buffer, size_t& size);
         // Filters.
         // Applies Sub filter.
         void apply_sub(std::uint8_t* raw_buffer, size_t size);
@@ -475,7 +1114,124 @@ namespace img {
         void reverse_avg(std::uint8_t* processed_buffer, std::uint8_t* upper_buffer, size_t size);
         // Reverses Paeth filter.
         void reverse_paeth(std::uint8_t* processed_buffer, std::uint8_t* upper_buffer, size_t size);
+        // Writes line filtered with filter type (0 - 4) to filtered buffer without changing the
+        // line, upper_line is nullptr for the first line. Returns sum of absolute values of
+        // filtered bytes (as signed), which is used to choose filter for the line.
+        std::uint64_t filter_line(int filter, const std::uint8_t* line, const std::uint8_t* upper_line,
+                                  std::uint8_t* filtered, size_t size);
+        // Approximate size of band of rows filtered by one job of assemble_8b_truecolor().
+        static constexpr size_t _band_size {64 * 1024};
     public:
+        /** \brief Deflate strategy, see zlib manual for details.
+         */
+        enum class Strategy {
+            standard,       ///< Z_DEFAULT_STRATEGY, general purpose.
+            filtered,       ///< Z_FILTERED, favors Huffman coding over string matching.
+            huffman_only,   ///< Z_HUFFMAN_ONLY, no string matching at all.
+            rle,            ///< Z_RLE, matches only with distance one (runs).
+            fixed,          ///< Z_FIXED, no dynamic Huffman codes.
+            automatic       ///< Chosen by sample of image data: stored blocks, Z_RLE or default.
+        };
+        /** \brief Filter applied to scanlines before compression.
+         */
+        enum class Filter {
+            none,       ///< Raw scanlines.
+            sub,        ///< Difference with the pixel on the left.
+            up,         ///< Difference with the pixel above.
+            average,    ///< Difference with average of left and upper pixels.
+            paeth,      ///< Difference with Paeth predictor.
+            adaptive    ///< Filter with minimum sum of absolute differences for every scanline.
+        };
+        /** \brief Writing of images as grayscale (color type 0).
+         */
+        enum class Grayscale {
+            automatic,  ///< Images with R == G == B in every pixel are written as grayscale.
+            force,      ///< Every image is written as grayscale (luma of colored pixels).
+            forbid      ///< Images are never written as grayscale.
+        };
+        /** \brief Options that control encoding of PNG images.
+         */
+        struct EncodeOptions {
+            int level {6};                          ///< Compression level in range [0; 9].
+            Strategy strategy {Strategy::standard}; ///< Deflate strategy.
+            int mem_level {8};                      ///< zlib memory level in range [1; 9].
+            int window_bits {15};                   ///< Window size logarithm in range [9; 15].
+            size_t idat_chunk_size {0};             ///< Max size of IDAT chunk, 0 is unlimited.
+            unsigned threads {0}; ///< Number of threads for filtering and compression, 0 is hardware concurrency.
+            Filter filter {Filter::adaptive};       ///< Scanline filter.
+            bool palette {false};   ///< Write images with up to 256 colors as indexed color.
+            Grayscale grayscale {Grayscale::automatic}; ///< Grayscale output.
+            int bit_depth {0};      ///< Bits per sample of grayscale and true color output: 8, 16
+                                    ///< (only for map of PixelFormat::rgba16, for ex. of image
+                                    ///< decoded from 16-bit PNG) or 0 - 16 for such map and 8
+                                    ///< otherwise.
+            /** \brief Preset for intermediate files: fastest compression with RLE.
+             * \return Options with level 1 and Strategy::rle.
+             */
+            static EncodeOptions fast();
+            /** \brief Preset for archival: maximum compression.
+             * \return Options with level 9, maximum memory level and palette detection.
+             */
+            static EncodeOptions small();
+        };
+        /** \brief What decoder does with ancillary chunks, that it does not interpret.
+         */
+        enum class Ancillary {
+            verify,     ///< Check their CRC, then drop them.
+            skip,       ///< Drop them without touching their data.
+            retain      ///< Check their CRC and keep them for ancillary_chunks() and write().
+        };
+        /** \brief Ancillary chunk kept by Ancillary::retain.
+         */
+        struct AncillaryChunk {
+            std::array<char, 4> type;   ///< Chunk type.
+            std::vector<char> data;     ///< Chunk payload.
+            bool after_idat;            ///< Chunk followed image data in the source file.
+        };
+        /** \brief Window of image in file coordinates.
+         */
+        struct Region {
+            std::uint32_t row {0};      ///< First row.
+            std::uint32_t column {0};   ///< First column.
+            std::uint32_t rows {0};     ///< Number of rows, 0 extends window to the bottom edge.
+            std::uint32_t columns {0};  ///< Number of columns, 0 extends window to the right edge.
+        };
+        /** \brief Options that control decoding of PNG images.
+         */
+        struct DecodeOptions {
+            bool pipeline {false};  ///< Inflate and unfilter scanlines on two separate threads.
+            size_t ring_rows {64};  ///< Number of scanlines buffered between the threads.
+            Ancillary ancillary {Ancillary::skip};  ///< Policy for unknown ancillary chunks.
+            unsigned scale {1}; ///< Image is decoded scaled down by 1, 2, 4 or 8 (box filter).
+            Region region {};   ///< Only this window of image is decoded (and then scaled).
+            unsigned passes {7};    ///< Adam7 passes of interlaced image to decode (1 - 7), the
+                                    ///< rest of pixels copy decoded ones (quick preview).
+        };
+        /** \brief Get current encoding options.
+         * \return Reference to options, that are used by write().
+         */
+        const EncodeOptions& encode_options() const;
+        /** \brief Set encoding options.
+         * \param options new options, that are used by next write() calls
+         * \details Throws std::runtime_error if any of the options is out of range.
+         */
+        void encode_options(const EncodeOptions& options);
+        /** \brief Get current decoding options.
+         * \return Reference to options, that are used by read().
+         */
+        const DecodeOptions& decode_options() const;
+        /** \brief Set decoding options.
+         * \param options new options, that are used by next read() calls
+         * \details Throws std::runtime_error if ring_rows is 0, scale is not 1, 2, 4 or 8 or
+         * passes is out of [1; 7].
+         */
+        void decode_options(const DecodeOptions& options);
+        /** \brief Get ancillary chunks retained by the last read().
+         * \return Chunks in file order, empty unless Ancillary::retain was used.
+         * \details write() puts safe-to-copy ones back to the same side of image data,
+         * others depend on image data and are not written.
+         */
+        const std::vector<AncillaryChunk>& ancillary_chunks() const;
         // These are the same to base class.
         virtual void read(std::string_view path) override;
         virtual void write(std::string_view path) override;
@@ -540,12 +1296,28 @@ namespace img {
             const char* what() const noexcept override;
         };
 
-        // For access to signature
+        // For access to signature and structure of file
         friend ImageType get_type(std::string_view path);
+        friend ImageInfo probe(std::string_view path);
+        friend bool verify(std::string_view path);
+    private:
+        // Options for write().
+        EncodeOptions _encode_options {};
+        // Options for read().
+        DecodeOptions _decode_options {};
+        // Ancillary chunks retained by read().
+        std::vector<AncillaryChunk> _ancillary {};
+        // Filters rows of raw data (stride bytes each) into buffer, prepending filter type byte
+        // to each of them.
+        void filter_scanlines(const std::uint8_t* raw, size_t stride, size_t rows,
+                              std::uint8_t* buffer, Filter filter);
     };
 
-    // Converts to another image type
-    Image convert(Image& img, ImageType new_type);
+    // Creates empty image of type, nullptr if type is unknown
+    std::unique_ptr<Image> make_image(ImageType type);
+
+    // Converts to another image type (pixels are copied, encoder of new type writes them)
+    std::unique_ptr<Image> convert(Image& img, ImageType new_type);
 
 }
 
@@ -0,0 +1,648 @@
+// std headers
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "image.hpp"
+
+using i = img::Image;
+
+namespace {
+// Entry of decoding table:
+// bits 0 - 4   number of bits the entry consumes
+// bits 5 - 7   kind of entry
+// bits 8 - 11  number of extra bits (lengths and distances)
+// bits 12 - 15 number of index bits of subtable
+// bits 16 - 31 value: literal(s), base of length/distance or offset of subtable
+enum entry_kind : std::uint32_t {
+    literal = 0,    // one literal
+    literal_pair,   // two literals, the first one in low byte of value
+    base,           // length or distance
+    end_of_block,
+    subtable,       // code is longer than primary index, continue in subtable
+    invalid
+};
+
+constexpr std::uint32_t make_entry(std::uint32_t kind, std::uint32_t value,
+                                   std::uint32_t extra = 0) {
+    return (kind << 5) | (extra << 8) | (value << 16);
+}
+constexpr std::uint32_t entry_bits(std::uint32_t entry) { return entry & 0x1F; }
+constexpr std::uint32_t entry_kind_of(std::uint32_t entry) { return (entry >> 5) & 0x7; }
+constexpr std::uint32_t entry_extra(std::uint32_t entry) { return (entry >> 8) & 0xF; }
+constexpr std::uint32_t entry_sub_bits(std::uint32_t entry) { return (entry >> 12) & 0xF; }
+constexpr std::uint32_t entry_value(std::uint32_t entry) { return entry >> 16; }
+
+// Bits of primary index of literal/length, distance and code length tables
+constexpr int litlen_primary  {10};
+constexpr int dist_primary    {8};
+constexpr int codelen_primary {7};
+constexpr int max_code_length {15};
+
+constexpr std::uint16_t length_base[29] {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+constexpr std::uint8_t length_extra[29] {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+constexpr std::uint16_t dist_base[30] {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+constexpr std::uint8_t dist_extra[30] {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+constexpr int codelen_order[19] {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+// Entries (without number of bits) of every symbol of literal/length and distance alphabets
+constexpr auto litlen_entries = [] {
+    std::array<std::uint32_t, 288> entries {};
+    for (std::uint32_t s {0}; s < 256; ++s) {
+        entries[s] = make_entry(literal, s);
+    }
+    entries[256] = make_entry(end_of_block, 0);
+    for (std::uint32_t s {0}; s < 29; ++s) {
+        entries[257 + s] = make_entry(base, length_base[s], length_extra[s]);
+    }
+    entries[286] = entries[287] = make_entry(invalid, 0);
+    return entries;
+}();
+constexpr auto dist_entries = [] {
+    std::array<std::uint32_t, 32> entries {};
+    for (std::uint32_t s {0}; s < 30; ++s) {
+        entries[s] = make_entry(base, dist_base[s], dist_extra[s]);
+    }
+    entries[30] = entries[31] = make_entry(invalid, 0);
+    return entries;
+}();
+constexpr auto codelen_entries = [] {
+    std::array<std::uint32_t, 19> entries {};
+    for (std::uint32_t s {0}; s < 19; ++s) {
+        entries[s] = make_entry(literal, s);
+    }
+    return entries;
+}();
+
+// Builds two-level decoding table, returns false if code lengths are over-subscribed.
+// Codes, that do not fit into primary index, are decoded with subtables placed after it.
+bool build_table(const std::uint8_t* lengths, int count, const std::uint32_t* entries,
+                 int primary_bits, std::vector<std::uint32_t>& table) {
+    int length_count[max_code_length + 1] {};
+    for (int s {0}; s < count; ++s) {
+        ++length_count[lengths[s]];
+    }
+    int left {1};
+    for (int l {1}; l <= max_code_length; ++l) {
+        left = (left << 1) - length_count[l];
+        if (left < 0) {
+            return false;
+        }
+    }
+    std::uint32_t next_code[max_code_length + 1] {};
+    std::uint32_t code {0};
+    length_count[0] = 0;
+    for (int l {1}; l <= max_code_length; ++l) {
+        code = (code + length_count[l - 1]) << 1;
+        next_code[l] = code;
+    }
+    // codes are read starting with the most significant bit, so table is indexed by reversed ones
+    std::uint32_t reversed[288];
+    for (int s {0}; s < count; ++s) {
+        reversed[s] = 0;
+        for (int b {0}; b < lengths[s]; ++b) {
+            reversed[s] = (reversed[s] << 1) | ((next_code[lengths[s]] >> b) & 1);
+        }
+        if (lengths[s]) {
+            ++next_code[lengths[s]];
+        }
+    }
+    const std::uint32_t primary_size {1u << primary_bits};
+    const std::uint32_t mask {primary_size - 1};
+    table.assign(primary_size, make_entry(invalid, 0));
+    // every prefix of long codes gets subtable, that fits the longest of them
+    std::uint8_t sub_bits[1 << litlen_primary] {};
+    for (int s {0}; s < count; ++s) {
+        if (lengths[s] > primary_bits) {
+            auto& bits = sub_bits[reversed[s] & mask];
+            bits = std::max<std::uint8_t>(bits, lengths[s] - primary_bits);
+        }
+    }
+    for (std::uint32_t prefix {0}; prefix < primary_size; ++prefix) {
+        if (sub_bits[prefix]) {
+            std::uint32_t offset {static_cast<std::uint32_t>(table.size())};
+            table[prefix] = make_entry(subtable, offset) | (sub_bits[prefix] << 12) | primary_bits;
+            table.resize(offset + (1u << sub_bits[prefix]), make_entry(invalid, 0));
+        }
+    }
+    for (int s {0}; s < count; ++s) {
+        std::uint32_t length {lengths[s]};
+        if (!length) {
+            continue;
+        }
+        if (length <= static_cast<std::uint32_t>(primary_bits)) {
+            for (std::uint32_t index {reversed[s]}; index < primary_size; index += 1u << length) {
+                table[index] = entries[s] | length;
+            }
+            continue;
+        }
+        auto link = table[reversed[s] & mask];
+        std::uint32_t sub_length {length - primary_bits};
+        for (std::uint32_t index {reversed[s] >> primary_bits}; index < (1u << entry_sub_bits(link));
+             index += 1u << sub_length) {
+            table[entry_value(link) + index] = entries[s] | sub_length;
+        }
+    }
+    return true;
+}
+
+// Replaces primary entries of literals, that are followed by another short literal, with pairs
+void pair_literals(std::vector<std::uint32_t>& table, int primary_bits) {
+    const std::uint32_t primary_size {1u << primary_bits};
+    std::vector<std::uint32_t> single(table.begin(), table.begin() + primary_size);
+    for (std::uint32_t index {0}; index < primary_size; ++index) {
+        auto first = single[index];
+        if (entry_kind_of(first) != literal) {
+            continue;
+        }
+        auto second = single[index >> entry_bits(first)];
+        std::uint32_t bits {entry_bits(first) + entry_bits(second)};
+        if (entry_kind_of(second) == literal && bits <= static_cast<std::uint32_t>(primary_bits)) {
+            table[index] = make_entry(literal_pair,
+                                      entry_value(first) | (entry_value(second) << 8)) | bits;
+        }
+    }
+}
+}
+
+// Decoder state: input with 64-bit bit buffer and output, that is filled row by row.
+// Output keeps only the window of matches and the row being filled, older data is dropped.
+class i::Scanline::inflater {
+public:
+    inflater(const std::uint8_t* data, size_t size, std::vector<size_t> row_ends,
+             const row_callback& on_row)
+        : _in(data), _in_end(data + size), _row_ends(std::move(row_ends)), _on_row(on_row) {
+        _total = _row_ends.empty() ? 0 : _row_ends.back();
+        size_t max_row {0};
+        for (size_t row {0}; row < _row_ends.size(); ++row) {
+            max_row = std::max(max_row, _row_ends[row] - row_start(row));
+        }
+        // window and the row being filled are kept, there is room for the next row with the
+        // longest match past its end, extra room makes moves of the window rare
+        _capacity = std::min(_total, _window + 2 * max_row + _max_match + _extra_room);
+        _output.resize(_capacity + _copy_slack);
+        _out = _output.data();
+        _out_end = _output.data() + _capacity;
+    }
+
+    bool run() {
+        read_header();
+        bool last {false};
+        while (!last) {
+            last = take(1);
+            auto type = take(2);
+            switch (type) {
+            case 0:
+                stored_block();
+                break;
+            case 1:
+                fixed_tables();
+                codes_block();
+                break;
+            case 2:
+                dynamic_tables();
+                codes_block();
+                break;
+            default:
+                throw std::runtime_error("invalid block type");
+            }
+            if (_stopped) {
+                return false;
+            }
+        }
+        if (position() != _total) {
+            throw std::runtime_error("stream is shorter than image data");
+        }
+        read_trailer();
+        return true;
+    }
+
+private:
+    // Matches are copied by 8 bytes, so up to 8 bytes may be written past the end of match
+    static constexpr size_t _copy_slack {8};
+    // Matches reach at most 32 KiB back and are at most 258 bytes long
+    static constexpr size_t _window {32768};
+    static constexpr size_t _max_match {258};
+    static constexpr size_t _extra_room {4 * _window};
+
+    // Fills bit buffer with at least 56 bits, bytes past the end of input read as zeros
+    void refill() {
+        if (_in_end - _in >= 8) {
+            std::uint64_t word;
+            std::memcpy(&word, _in, 8);
+            if constexpr (std::endian::native == std::endian::big) {
+                word = __builtin_bswap64(word);
+            }
+            _bits |= word << _count;
+            _in += (63 - _count) >> 3;
+            _count |= 56;
+            return;
+        }
+        while (_count <= 56) {
+            if (_in < _in_end) {
+                _bits |= static_cast<std::uint64_t>(*_in++) << _count;
+            } else {
+                ++_overrun;
+            }
+            _count += 8;
+        }
+    }
+
+    void consume(std::uint32_t bits) {
+        _bits >>= bits;
+        _count -= bits;
+    }
+
+    std::uint32_t take(std::uint32_t bits) {
+        if (_count < static_cast<int>(bits)) {
+            refill();
+        }
+        std::uint32_t value {static_cast<std::uint32_t>(_bits & ((std::uint64_t{1} << bits) - 1))};
+        consume(bits);
+        return value;
+    }
+
+    // Checks that decoder did not run past the end of input
+    void check_input() {
+        if (_overrun * 8 > _count) {
+            throw std::runtime_error("unexpected end of stream");
+        }
+    }
+
+    // Drops bits up to byte boundary and returns the rest of bit buffer to input
+    void align() {
+        consume(_count & 7);
+        auto buffered = static_cast<size_t>(_count >> 3);
+        if (buffered < _overrun) {
+            throw std::runtime_error("unexpected end of stream");
+        }
+        _in -= buffered - _overrun;
+        _overrun = 0;
+        _bits = 0;
+        _count = 0;
+    }
+
+    std::uint32_t decode(const std::vector<std::uint32_t>& table, int primary_bits) {
+        auto entry = table[_bits & ((1u << primary_bits) - 1)];
+        if (entry_kind_of(entry) == subtable) {
+            consume(primary_bits);
+            entry = table[entry_value(entry) + (_bits & ((1u << entry_sub_bits(entry)) - 1))];
+        }
+        consume(entry_bits(entry));
+        return entry;
+    }
+
+    void read_header() {
+        if (_in_end - _in < 2) {
+            throw std::runtime_error("stream is too short");
+        }
+        std::uint32_t cmf {_in[0]}, flg {_in[1]};
+        if ((cmf & 0x0F) != 8 || (cmf >> 4) > 7 || (cmf * 256 + flg) % 31 || (flg & 0x20)) {
+            throw std::runtime_error("invalid zlib header");
+        }
+        _in += 2;
+    }
+
+    void read_trailer() {
+        align();
+        if (_in_end - _in < 4) {
+            throw std::runtime_error("missing Adler32 checksum");
+        }
+        std::uint32_t expected {static_cast<std::uint32_t>(_in[0]) << 24 |
+                                static_cast<std::uint32_t>(_in[1]) << 16 |
+                                static_cast<std::uint32_t>(_in[2]) << 8 | _in[3]};
+        if (_adler != expected) {
+            throw std::runtime_error("Adler32 checksum mismatch");
+        }
+    }
+
+    // Number of bytes decoded so far
+    size_t position() const {
+        return _base + (_out - _output.data());
+    }
+
+    size_t row_start(size_t row) const {
+        return row ? _row_ends[row - 1] : 0;
+    }
+
+    // Hands back rows, that were completed since the last call, and adds them to checksum
+    void emit_rows() {
+        size_t done {position()};
+        for (; _next_row < _row_ends.size() && _row_ends[_next_row] <= done && !_stopped;
+             ++_next_row) {
+            std::uint8_t* row {_output.data() + (row_start(_next_row) - _base)};
+            _adler = adler32(row, _row_ends[_next_row] - row_start(_next_row), _adler);
+            _stopped = !_on_row(row, _next_row);
+        }
+        if (!_stopped) {
+            make_room();
+        }
+    }
+
+    // Moves the window and the row being filled to the front of output, if the rest of row
+    // and a match past its end may not fit
+    void make_room() {
+        if (_next_row == _row_ends.size() ||
+            std::min(_row_ends[_next_row] + _max_match, _total) <= _base + _capacity) {
+            return;
+        }
+        size_t filled {static_cast<size_t>(_out - _output.data())};
+        size_t keep {std::min(filled, std::max(_window, position() - row_start(_next_row)))};
+        std::memmove(_output.data(), _out - keep, keep);
+        _base += filled - keep;
+        _out = _output.data() + keep;
+        _out_end = _output.data() + std::min(_capacity, _total - _base);
+    }
+
+    // End of the row, that is filled now (past the end of output, if all rows are done)
+    std::uint8_t* row_end() {
+        return (_next_row < _row_ends.size())
+                   ? _output.data() + (_row_ends[_next_row] - _base)
+                   : _out_end + 1;
+    }
+
+    void stored_block() {
+        align();
+        if (_in_end - _in < 4) {
+            throw std::runtime_error("unexpected end of stream");
+        }
+        std::uint32_t length {_in[0] | static_cast<std::uint32_t>(_in[1]) << 8};
+        std::uint32_t nlength {_in[2] | static_cast<std::uint32_t>(_in[3]) << 8};
+        if ((length ^ 0xFFFF) != nlength) {
+            throw std::runtime_error("invalid stored block length");
+        }
+        _in += 4;
+        if (static_cast<size_t>(_in_end - _in) < length) {
+            throw std::runtime_error("unexpected end of stream");
+        }
+        if (_total - position() < length) {
+            throw std::runtime_error("stream is longer than image data");
+        }
+        // copied row by row, so that output has room for every part
+        while (length && !_stopped) {
+            std::uint32_t part {static_cast<std::uint32_t>(
+                std::min<size_t>(length, row_end() - _out))};
+            std::memcpy(_out, _in, part);
+            _in += part;
+            _out += part;
+            length -= part;
+            emit_rows();
+        }
+    }
+
+    void fixed_tables() {
+        if (_fixed_litlen.empty()) {
+            std::uint8_t lengths[288];
+            std::fill(lengths, lengths + 144, 8);
+            std::fill(lengths + 144, lengths + 256, 9);
+            std::fill(lengths + 256, lengths + 280, 7);
+            std::fill(lengths + 280, lengths + 288, 8);
+            build_table(lengths, 288, litlen_entries.data(), litlen_primary, _fixed_litlen);
+            pair_literals(_fixed_litlen, litlen_primary);
+            std::fill(lengths, lengths + 32, 5);
+            build_table(lengths, 32, dist_entries.data(), dist_primary, _fixed_dist);
+        }
+        _litlen = &_fixed_litlen;
+        _dist = &_fixed_dist;
+    }
+
+    void dynamic_tables() {
+        std::uint32_t hlit {take(5) + 257}, hdist {take(5) + 1}, hclen {take(4) + 4};
+        if (hlit > 286 || hdist > 30) {
+            throw std::runtime_error("too many length or distance symbols");
+        }
+        std::uint8_t codelen_lengths[19] {};
+        for (std::uint32_t c {0}; c < hclen; ++c) {
+            codelen_lengths[codelen_order[c]] = take(3);
+        }
+        if (!build_table(codelen_lengths, 19, codelen_entries.data(), codelen_primary,
+                         _codelen)) {
+            throw std::runtime_error("invalid code length code");
+        }
+        std::uint8_t lengths[288 + 32] {};
+        std::uint32_t filled {0};
+        while (filled < hlit + hdist) {
+            refill();
+            auto entry = decode(_codelen, codelen_primary);
+            if (entry_kind_of(entry) != literal) {
+                throw std::runtime_error("invalid code length code");
+            }
+            std::uint32_t symbol {entry_value(entry)}, repeat {1};
+            std::uint8_t value {static_cast<std::uint8_t>(symbol)};
+            if (symbol == 16) {
+                if (!filled) {
+                    throw std::runtime_error("repeat of missing code length");
+                }
+                value = lengths[filled - 1];
+                repeat = 3 + take(2);
+            } else if (symbol == 17) {
+                value = 0;
+                repeat = 3 + take(3);
+            } else if (symbol == 18) {
+                value = 0;
+                repeat = 11 + take(7);
+            }
+            if (filled + repeat > hlit + hdist) {
+                throw std::runtime_error("too many code lengths");
+            }
+            std::fill(lengths + filled, lengths + filled + repeat, value);
+            filled += repeat;
+        }
+        check_input();
+        if (!lengths[256]) {
+            throw std::runtime_error("missing end of block code");
+        }
+        if (!build_table(lengths, hlit, litlen_entries.data(), litlen_primary, _dynamic_litlen) ||
+            !build_table(lengths + hlit, hdist, dist_entries.data(), dist_primary,
+                         _dynamic_dist)) {
+            throw std::runtime_error("invalid literal/length or distance code");
+        }
+        pair_literals(_dynamic_litlen, litlen_primary);
+        _litlen = &_dynamic_litlen;
+        _dist = &_dynamic_dist;
+    }
+
+    // Copies match, that starts distance bytes behind output, 8 bytes at a time if possible
+    static void copy_match(std::uint8_t* out, std::uint32_t distance, std::uint32_t length) {
+        const std::uint8_t* from {out - distance};
+        if (distance >= 8) {
+            for (std::uint32_t copied {0}; copied < length; copied += 8) {
+                std::uint64_t word;
+                std::memcpy(&word, from + copied, 8);
+                std::memcpy(out + copied, &word, 8);
+            }
+        } else if (distance == 1) {
+            // run of one byte
+            std::uint64_t word {*from * std::uint64_t{0x0101010101010101}};
+            for (std::uint32_t copied {0}; copied < length; copied += 8) {
+                std::memcpy(out + copied, &word, 8);
+            }
+        } else {
+            for (std::uint32_t copied {0}; copied < length; ++copied) {
+                out[copied] = from[copied];
+            }
+        }
+    }
+
+    void codes_block() {
+        const std::uint32_t* litlen {_litlen->data()};
+        const std::uint32_t* dist {_dist->data()};
+        // state is kept in locals, so that stores to output do not force compiler to reload it
+        std::uint64_t bits {_bits};
+        int count {_count};
+        const std::uint8_t* in {_in};
+        std::uint8_t* out {_out};
+        std::uint8_t* const begin {_output.data()};
+        std::uint8_t* row_end {this->row_end()};
+        auto save = [&] {
+            _bits = bits;
+            _count = count;
+            _in = in;
+            _out = out;
+        };
+        auto fill = [&] {
+            if (_in_end - in >= 8) {
+                std::uint64_t word;
+                std::memcpy(&word, in, 8);
+                if constexpr (std::endian::native == std::endian::big) {
+                    word = __builtin_bswap64(word);
+                }
+                bits |= word << count;
+                in += (63 - count) >> 3;
+                count |= 56;
+            } else {
+                save();
+                refill();
+                bits = _bits;
+                count = _count;
+                in = _in;
+            }
+        };
+        auto lookup = [&](const std::uint32_t* table, int primary_bits) {
+            auto entry = table[bits & ((1u << primary_bits) - 1)];
+            if (entry_kind_of(entry) == subtable) {
+                bits >>= primary_bits;
+                count -= primary_bits;
+                entry = table[entry_value(entry) + (bits & ((1u << entry_sub_bits(entry)) - 1))];
+            }
+            bits >>= entry_bits(entry);
+            count -= entry_bits(entry);
+            return entry;
+        };
+        auto extra = [&](std::uint32_t number) {
+            std::uint32_t value {static_cast<std::uint32_t>(bits & ((std::uint64_t{1} << number) - 1))};
+            bits >>= number;
+            count -= number;
+            return value;
+        };
+        for (;;) {
+            // one refill is enough for the longest length and distance with their extra bits
+            fill();
+            auto entry = lookup(litlen, litlen_primary);
+            auto kind = entry_kind_of(entry);
+            if (kind <= literal_pair) {
+                std::uint32_t literals {1 + kind};
+                if (static_cast<std::uint32_t>(_out_end - out) < literals) {
+                    throw std::runtime_error("stream is longer than image data");
+                }
+                // second byte of single literal is written to slack or overwritten later
+                out[0] = entry_value(entry) & 0xFF;
+                out[1] = entry_value(entry) >> 8;
+                out += literals;
+            } else if (kind == base) {
+                std::uint32_t length {entry_value(entry) + extra(entry_extra(entry))};
+                auto dist_entry = lookup(dist, dist_primary);
+                if (entry_kind_of(dist_entry) != base) {
+                    throw std::runtime_error("invalid distance code");
+                }
+                std::uint32_t distance {entry_value(dist_entry) + extra(entry_extra(dist_entry))};
+                if (distance > out - begin) {
+                    throw std::runtime_error("distance is too far back");
+                }
+                if (static_cast<std::uint32_t>(_out_end - out) < length) {
+                    throw std::runtime_error("stream is longer than image data");
+                }
+                copy_match(out, distance, length);
+                out += length;
+            } else if (kind == end_of_block) {
+                save();
+                check_input();
+                emit_rows();
+                return;
+            } else {
+                throw std::runtime_error("invalid literal/length code");
+            }
+            if (out >= row_end) {
+                save();
+                check_input();
+                emit_rows();
+                if (_stopped) {
+                    return;
+                }
+                out = _out;
+                row_end = this->row_end();
+            }
+        }
+    }
+
+    const std::uint8_t* _in;
+    const std::uint8_t* _in_end;
+    std::uint64_t _bits {0};
+    int _count {0};
+    // number of zero bytes read past the end of input
+    size_t _overrun {0};
+
+    // offsets of ends of rows in decoded data
+    std::vector<size_t> _row_ends;
+    size_t _next_row {0};
+    // size of decoded data, offset of the first byte of output in it and size of output
+    size_t _total;
+    size_t _base {0};
+    size_t _capacity;
+    std::vector<std::uint8_t> _output;
+    std::uint8_t* _out;
+    // end of decoded data or of output, whichever comes first
+    std::uint8_t* _out_end;
+    std::uint32_t _adler {1};
+    const row_callback& _on_row;
+    bool _stopped {false};
+
+    std::vector<std::uint32_t> _fixed_litlen, _fixed_dist;
+    std::vector<std::uint32_t> _dynamic_litlen, _dynamic_dist, _codelen;
+    const std::vector<std::uint32_t>* _litlen {nullptr};
+    const std::vector<std::uint32_t>* _dist {nullptr};
+};
+
+bool i::Scanline::inflate(const std::uint8_t* data, size_t size, size_t row_size, size_t rows,
+                          const row_callback& on_row) {
+    return inflate(data, size, std::vector<size_t>(rows, row_size), on_row);
+}
+
+bool i::Scanline::inflate(const std::uint8_t* data, size_t size,
+                          const std::vector<size_t>& row_sizes, const row_callback& on_row) {
+    std::vector<size_t> row_ends(row_sizes.size());
+    size_t end {0};
+    for (size_t row {0}; row < row_sizes.size(); ++row) {
+        end += row_sizes[row];
+        row_ends[row] = end;
+    }
+    inflater state {data, size, std::move(row_ends), on_row};
+    return state.run();
+}
@@ -0,0 +1,93 @@
+// std headers
+#include <cstddef>
+#include <algorithm>
+#include <vector>
+
+// compression
+#include <zlib.h>
+
+#include "image.hpp"
+
+using i = img::Image;
+
+namespace {
+// Deflated block together with Adler32 of its input.
+struct deflated_block {
+    std::vector<std::uint8_t> data {};
+    uLong adler {1};
+    int status {Z_OK};
+};
+
+// Compresses one block as raw deflate, primed with dictionary of previous window.
+void deflate_block(deflated_block& block, const std::uint8_t* data, size_t size,
+                   const std::uint8_t* dictionary, size_t dictionary_size,
+                   bool last, int level, int strategy, int mem_level, int window_bits) {
+    z_stream stream {};
+    block.status = deflateInit2(&stream, level, Z_DEFLATED, -window_bits, mem_level, strategy);
+    if (block.status != Z_OK) {
+        return;
+    }
+    if (dictionary_size) {
+        block.status = deflateSetDictionary(&stream, dictionary, dictionary_size);
+        if (block.status != Z_OK) {
+            deflateEnd(&stream);
+            return;
+        }
+    }
+    // sync flush adds an empty stored block (5 bytes) after the bound
+    block.data.resize(deflateBound(&stream, size) + 16);
+    stream.next_in = const_cast<std::uint8_t*>(data);
+    stream.avail_in = size;
+    stream.next_out = block.data.data();
+    stream.avail_out = block.data.size();
+    auto result = ::deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    block.status = (result == Z_STREAM_END || (!last && result == Z_OK)) ? Z_OK : Z_BUF_ERROR;
+    block.data.resize(block.data.size() - stream.avail_out);
+    block.adler = adler32(1, data, size);
+    deflateEnd(&stream);
+}
+}
+
+int i::Scanline::parallel_deflate(std::vector<std::uint8_t>& dest, const std::uint8_t* data,
+                                  size_t size, unsigned threads, const zlib_params& params) {
+    size_t window {size_t{1} << params.window_bits};
+    size_t count {std::max<size_t>((size + parallel_block_size - 1) / parallel_block_size, 1)};
+    std::vector<deflated_block> blocks(count);
+    parallel_for(count, threads, [&](size_t index) {
+        size_t start {index * parallel_block_size};
+        size_t length {std::min<size_t>(parallel_block_size, size - start)};
+        size_t dictionary_size {std::min<size_t>(start, window)};
+        deflate_block(blocks[index], data + start, length, data + start - dictionary_size,
+                      dictionary_size, index + 1 == count,
+                      params.level, params.strategy, params.mem_level, params.window_bits);
+    });
+
+    size_t total {2 + 4};
+    for (auto& block : blocks) {
+        if (block.status != Z_OK) {
+            return block.status;
+        }
+        total += block.data.size();
+    }
+    dest.clear();
+    dest.reserve(total);
+    // zlib header: deflate with window size, FLEVEL hint derived from level
+    int flevel {(params.level < 2) ? 0 : (params.level < 6) ? 1 : (params.level == 6) ? 2 : 3};
+    std::uint8_t cmf {static_cast<std::uint8_t>(((params.window_bits - 8) << 4) | Z_DEFLATED)};
+    std::uint8_t flg {static_cast<std::uint8_t>(flevel << 6)};
+    flg += 31 - (cmf * 256 + flg) % 31;
+    dest.push_back(cmf);
+    dest.push_back(flg);
+    uLong check_sum {1};
+    size_t offset {0};
+    for (auto& block : blocks) {
+        dest.insert(dest.end(), block.data.begin(), block.data.end());
+        size_t length {std::min<size_t>(parallel_block_size, size - offset)};
+        check_sum = adler32_combine(check_sum, block.adler, length);
+        offset += length;
+    }
+    for (int shift {24}; shift >= 0; shift -= 8) {
+        dest.push_back(static_cast<std::uint8_t>((check_sum >> shift) & 0xFF));
+    }
+    return Z_OK;
+}
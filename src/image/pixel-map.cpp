@@ -1,8 +1,137 @@
 #include "image.hpp"
 #include <vector>
 #include <stdexcept>
+#include <algorithm>
 
-img::PixelMap::PixelMap(size_t width, size_t height) : _width{width}, _height{height} {
+namespace {
+    // Opaque black of PixelFormat::rgba16 (default pixel, same to Color{}).
+    constexpr img::PixelMap::samples_t wide_black {0, 0, 0, 65535};
+
+    // round(value * 255 / 65535), exact inverse of 8-bit value scaled by 257
+    img::Color to_narrow(const img::PixelMap::samples_t& samples) {
+        return img::Color{(samples[0] + 128) / 257, (samples[1] + 128) / 257,
+                          (samples[2] + 128) / 257, (samples[3] + 128) / 257};
+    }
+
+    // ITU-R BT.601 luma of 8-bit samples, exact for gray pixels
+    std::uint8_t luma(unsigned r, unsigned g, unsigned b) {
+        return static_cast<std::uint8_t>((r * 299 + g * 587 + b * 114 + 500) / 1000);
+    }
+
+    // Expansion and trimming are the same for rows of any pixel type, width is the new one.
+    template <typename Pixel>
+    void expand_rows(std::vector<std::vector<Pixel>>& map, size_t width, img::Side side,
+                     int count, const Pixel& fill) {
+        switch(side) {
+        case img::Side::right:
+            for (std::vector<Pixel>& row : map) {
+                row.resize(width, fill);
+            }
+            break;
+        case img::Side::bottom:
+            map.resize(map.size() + count, std::vector<Pixel>(width, fill));
+            break;
+        case img::Side::left:
+            for (std::vector<Pixel>& row : map) {
+                row.resize(width);
+                std::move_backward(row.begin(), row.end() - count, row.end());
+                std::fill(row.begin(), row.begin() + count, fill);
+            }
+            break;
+        case img::Side::top:
+            map.resize(map.size() + count);
+            std::move_backward(map.begin(), map.end() - count, map.end());
+            std::fill(map.begin(), map.begin() + count, std::vector<Pixel>(width, fill));
+            break;
+        }
+    }
+
+    template <typename Pixel>
+    void expand_rows(std::vector<std::vector<Pixel>>& map, size_t width, img::JointSide sides,
+                     int count_1, int count_2, const Pixel& fill) {
+        if (sides == img::JointSide::bottom_and_top) {
+            int& top = count_2;
+            int& bottom = count_1;
+            // There is no forward_add_range() function in STL, so
+            // we have to improvise.
+            map.resize(map.size() + top + bottom);
+            // std::move() needs third iterator to be out of range that
+            // first two provide, so move_backward() needs to be here instead.
+            std::move_backward(map.begin(), map.end() - top - bottom, map.end() - bottom);
+            std::fill(map.begin(), map.begin() + top, std::vector<Pixel>(width, fill));
+            std::fill(map.end() - bottom, map.end(), std::vector<Pixel>(width, fill));
+        } else {
+            int& left = count_1;
+            int& right = count_2;
+            for (std::vector<Pixel>& row : map) {
+                row.resize(width);
+                std::move_backward(row.begin(), row.end() - left - right, row.end() - right);
+                std::fill(row.begin(), row.begin() + left, fill);
+                std::fill(row.end() - right, row.end(), fill);
+            }
+        }
+    }
+
+    template <typename Pixel>
+    void trim_rows(std::vector<std::vector<Pixel>>& map, img::Side side, int count) {
+        switch(side) {
+        case img::Side::right:
+            for (std::vector<Pixel>& row : map) {
+                row.erase(row.end() - count, row.end());
+            }
+            break;
+        case img::Side::bottom:
+            map.erase(map.end() - count, map.end());
+            break;
+        case img::Side::left:
+            for (std::vector<Pixel>& row : map) {
+                row.erase(row.begin(), row.begin() + count);
+            }
+            break;
+        case img::Side::top:
+            map.erase(map.begin(), map.begin() + count);
+            break;
+        }
+    }
+
+    template <typename Pixel>
+    void trim_rows(std::vector<std::vector<Pixel>>& map, img::JointSide sides,
+                   int count_1, int count_2) {
+        if (sides == img::JointSide::bottom_and_top) {
+            int& top = count_2;
+            int& bottom = count_1;
+            map.erase(map.begin(), map.begin() + top);
+            map.erase(map.end() - bottom, map.end());
+        } else {
+            int& left = count_1;
+            int& right = count_2;
+            for (std::vector<Pixel>& row : map) {
+                row.erase(row.begin(), row.begin() + left);
+                row.erase(row.end() - right, row.end());
+            }
+        }
+    }
+
+    bool check_side(img::Side side) {
+        return side == img::Side::left || side == img::Side::top ||
+               side == img::Side::right || side == img::Side::bottom;
+    }
+
+    bool check_sides(img::JointSide sides) {
+        return sides == img::JointSide::bottom_and_top || sides == img::JointSide::left_and_right;
+    }
+}
+
+img::PixelMap::PixelMap(size_t width, size_t height, PixelFormat format)
+    : _format{format}, _width{width}, _height{height} {
+    if (_format == PixelFormat::rgba16) {
+        _wide.assign(height, std::vector<samples_t>(width, wide_black));
+        return;
+    }
+    if (_format == PixelFormat::gray) {
+        _gray.assign(height, std::vector<std::uint8_t>(width));
+        return;
+    }
     _map = std::move(pixel_map_t(height));
     for (int row {0}; row < height; ++row) {
         _map[row] = std::move(std::vector<Color>(width));
@@ -11,120 +140,176 @@ img::PixelMap::PixelMap(size_t width, size_t height) : _width{width}, _height{he
 
 size_t img::PixelMap::rows() const   { return _height; }
 size_t img::PixelMap::columns() const { return _width; }
+img::PixelFormat img::PixelMap::format() const { return _format; }
+
+std::uint16_t img::PixelMap::max_sample() const {
+    return (_format == PixelFormat::rgba16) ? 65535 : 255;
+}
 
 img::Color& img::PixelMap::at(int row, int column) {
+    if (_format != PixelFormat::rgba) {
+        format(PixelFormat::rgba);
+    }
     return _map[row][column];
 }
 
-void img::PixelMap::expand(JointSide sides, int count_1, int count_2) {
-    if (sides == JointSide::bottom_and_top) {
-        int& top = count_2;
-        int& bottom = count_1;
-        _height += top + bottom;
-        // There is no forward_add_range() function in STL, so
-        // we have to improvise.
-        _map.resize(_height);
-        // std::move() needs third iterator to be out of range that
-        // first two provide, so move_backward() needs to be here instead.
-        std::move_backward(_map.begin(), _map.end() - top - bottom, _map.end() - bottom);
-        std::fill(_map.begin(), _map.begin() + top, std::vector<Color>(_width));
-        std::fill(_map.end() - bottom, _map.end(), std::vector<Color>(_width));
-    }
-    else if (sides == JointSide::left_and_right) {
-        int& left = count_1;
-        int& right = count_2;
-        _width += left + right;
-        for (std::vector<Color>& row : _map) {
-            row.resize(_width);
-            std::move_backward(row.begin(), row.end() - right, row.end());
-            std::fill(row.begin(), row.begin() + left, Color{});
-            std::fill(row.end() - right, row.end(), Color{});
+std::uint8_t& img::PixelMap::gray(int row, int column) {
+    if (_format != PixelFormat::gray) {
+        format(PixelFormat::gray);
+    }
+    return _gray[row][column];
+}
+
+img::Color img::PixelMap::color(int row, int column) const {
+    if (_format == PixelFormat::rgba16) {
+        return to_narrow(_wide[row][column]);
+    }
+    if (_format == PixelFormat::gray) {
+        int value {_gray[row][column]};
+        return Color{value, value, value};
+    }
+    return _map[row][column];
+}
+
+img::PixelMap::samples_t img::PixelMap::samples(int row, int column) const {
+    if (_format == PixelFormat::rgba16) {
+        return _wide[row][column];
+    }
+    if (_format == PixelFormat::gray) {
+        std::uint16_t value {_gray[row][column]};
+        return {value, value, value, 255};
+    }
+    auto color = _map[row][column];
+    return {static_cast<std::uint16_t>(color.R()), static_cast<std::uint16_t>(color.G()),
+            static_cast<std::uint16_t>(color.B()), static_cast<std::uint16_t>(color.A())};
+}
+
+void img::PixelMap::samples(int row, int column, const samples_t& samples) {
+    if (_format == PixelFormat::rgba16) {
+        _wide[row][column] = samples;
+        return;
+    }
+    if (_format == PixelFormat::gray) {
+        _gray[row][column] = luma(samples[0], samples[1], samples[2]);
+        return;
+    }
+    _map[row][column] = Color{samples[0], samples[1], samples[2], samples[3]};
+}
+
+void img::PixelMap::copy(int row, int column, const PixelMap& from, int from_row,
+                         int from_column) {
+    if (from._format == _format) {
+        if (_format == PixelFormat::rgba16) {
+            _wide[row][column] = from._wide[from_row][from_column];
+        } else if (_format == PixelFormat::gray) {
+            _gray[row][column] = from._gray[from_row][from_column];
+        } else {
+            _map[row][column] = from._map[from_row][from_column];
+        }
+        return;
+    }
+    // rounded value * max / from_max, fits into 32 bits for 16-bit samples
+    std::uint32_t max {max_sample()}, from_max {from.max_sample()};
+    auto samples = from.samples(from_row, from_column);
+    for (auto& sample : samples) {
+        sample = static_cast<std::uint16_t>((sample * max + from_max / 2) / from_max);
+    }
+    this->samples(row, column, samples);
+}
+
+void img::PixelMap::format(PixelFormat format) {
+    if (format == _format) {
+        return;
+    }
+    // rows are released as soon as they are converted
+    PixelMap converted {_width, _height, format};
+    for (size_t row {0}; row < _height; ++row) {
+        for (size_t column {0}; column < _width; ++column) {
+            converted.copy(row, column, *this, row, column);
+        }
+        switch (_format) {
+        case PixelFormat::rgba:
+            std::vector<Color>{}.swap(_map[row]);
+            break;
+        case PixelFormat::rgba16:
+            std::vector<samples_t>{}.swap(_wide[row]);
+            break;
+        case PixelFormat::gray:
+            std::vector<std::uint8_t>{}.swap(_gray[row]);
+            break;
         }
     }
-    else {
+    *this = std::move(converted);
+}
+
+void img::PixelMap::expand(JointSide sides, int count_1, int count_2) {
+    if (!check_sides(sides)) {
         throw std::runtime_error("Parameter <sides> value is out of acceptable range.");
     }
+    if (sides == JointSide::bottom_and_top) {
+        _height += count_1 + count_2;
+    } else {
+        _width += count_1 + count_2;
+    }
+    if (_format == PixelFormat::rgba16) {
+        expand_rows(_wide, _width, sides, count_1, count_2, wide_black);
+    } else if (_format == PixelFormat::gray) {
+        expand_rows(_gray, _width, sides, count_1, count_2, std::uint8_t{0});
+    } else {
+        expand_rows(_map, _width, sides, count_1, count_2, Color{});
+    }
 }
 
 void img::PixelMap::expand(Side side, int count) {
-    switch(side) {
-    case Side::right:
-        _width += count;
-        for (std::vector<Color>& row : _map) {
-            row.resize(_width);
-            std::fill(row.end() - count, row.end(), Color{});
-        }
-        break;
-    case Side::bottom:
+    if (!check_side(side)) {
+        throw std::runtime_error("Parameter <side> value is out of acceptable range.");
+    }
+    if (side == Side::top || side == Side::bottom) {
         _height += count;
-        _map.resize(_height);
-        std::fill(_map.end() - count, _map.end(), std::vector<Color>(_width));
-        break;
-    case Side::left:
+    } else {
         _width += count;
-        for (std::vector<Color>& row : _map) {
-            row.resize(_width);
-            std::move_backward(row.begin(), row.end() - count, row.end());
-            std::fill(row.begin(), row.begin() + count, Color{});
-        }
-        break;
-    case Side::top:
-        _height += count;
-        _map.resize(_height);
-        std::move_backward(_map.begin(), _map.end() - count, _map.end());
-        std::fill(_map.begin(), _map.begin() + count, std::vector<Color>(_width));
-        break;
-    default:
-        throw std::runtime_error("Parameter <side> value is out of acceptable range.");
+    }
+    if (_format == PixelFormat::rgba16) {
+        expand_rows(_wide, _width, side, count, wide_black);
+    } else if (_format == PixelFormat::gray) {
+        expand_rows(_gray, _width, side, count, std::uint8_t{0});
+    } else {
+        expand_rows(_map, _width, side, count, Color{});
     }
 }
 
 void img::PixelMap::trim(Side side, int count) {
-    switch(side) {
-    case Side::right:
-        _width -= count;
-        for (std::vector<Color>& row : _map) {
-            row.erase(row.end() - count, row.end());
-        }
-        break;
-    case Side::bottom:
+    if (!check_side(side)) {
+        throw std::runtime_error("Parameter <side> value is out of acceptable range.");
+    }
+    if (side == Side::top || side == Side::bottom) {
         _height -= count;
-        _map.erase(_map.end() - count, _map.end());
-        break;
-    case Side::left:
+    } else {
         _width -= count;
-        for (std::vector<Color>& row : _map) {
-            row.erase(row.begin(), row.begin() + count);
-        }
-        break;
-    case Side::top:
-        _height -= count;
-        _map.erase(_map.begin(), _map.begin() + count);
-        break;
-    default:
-        throw std::runtime_error("Parameter <side> value is out of acceptable range.");
+    }
+    if (_format == PixelFormat::rgba16) {
+        trim_rows(_wide, side, count);
+    } else if (_format == PixelFormat::gray) {
+        trim_rows(_gray, side, count);
+    } else {
+        trim_rows(_map, side, count);
     }
 }
 
 void img::PixelMap::trim(JointSide sides, int count_1, int count_2) {
+    if (!check_sides(sides)) {
+        throw std::runtime_error("Parameter <sides> value is out of acceptable range.");
+    }
     if (sides == JointSide::bottom_and_top) {
-        int& top = count_2;
-        int& bottom = count_1;
-        _height -= top + bottom;
-        _map.erase(_map.begin(), _map.begin() + top);
-        _map.erase(_map.end() - bottom, _map.end());
-    }
-    else if (sides == JointSide::left_and_right) {
-        int& left = count_1;
-        int& right = count_2;
-        _width -= left + right;
-        for (std::vector<Color>& row : _map) {
-            row.erase(row.begin(), row.begin() + left);
-            row.erase(row.end() - right, row.end());
-        }
+        _height -= count_1 + count_2;
+    } else {
+        _width -= count_1 + count_2;
     }
-    else {
-        throw std::runtime_error("Parameter <sides> value is out of acceptable range.");
+    if (_format == PixelFormat::rgba16) {
+        trim_rows(_wide, sides, count_1, count_2);
+    } else if (_format == PixelFormat::gray) {
+        trim_rows(_gray, sides, count_1, count_2);
+    } else {
+        trim_rows(_map, sides, count_1, count_2);
     }
 }
-
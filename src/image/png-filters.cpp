@@ -3,6 +3,7 @@
 #include <cstddef>
 #include <memory>
 #include <cmath>
+#include <cstdlib>
 
 namespace {
 int raw(std::uint8_t* buffer, int index) {
@@ -123,3 +124,34 @@ void img::PNGImage::reverse_paeth(std::uint8_t* current_buffer,
         current_buffer[i] = result;
     }
 }
+
+std::uint64_t img::PNGImage::filter_line(int filter, const std::uint8_t* line,
+                                         const std::uint8_t* upper_line, std::uint8_t* filtered,
+                                         size_t size) {
+    size_t bpp {static_cast<size_t>(std::max(sample_size * bit_depth / 8, 1))};
+    auto left = [&](size_t i) { return (i >= bpp) ? line[i - bpp] : 0; };
+    auto up = [&](size_t i) { return upper_line ? upper_line[i] : 0; };
+    auto up_left = [&](size_t i) { return (upper_line && i >= bpp) ? upper_line[i - bpp] : 0; };
+    std::uint64_t sum {0};
+    for (size_t i {0}; i < size; ++i) {
+        std::uint8_t predictor {0};
+        switch (filter) {
+        case 1:
+            predictor = left(i);
+            break;
+        case 2:
+            predictor = up(i);
+            break;
+        case 3:
+            predictor = (left(i) + up(i)) / 2;
+            break;
+        case 4:
+            predictor = paeth_predictor(left(i), up(i), up_left(i));
+            break;
+        }
+        std::uint8_t result = line[i] - predictor;
+        filtered[i] = result;
+        sum += std::abs(static_cast<std::int8_t>(result));
+    }
+    return sum;
+}
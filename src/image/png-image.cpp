@@ -12,192 +12,397 @@
 #include <cmath>
 #include <format>
 #include <climits>
-
-char img::PNGImage::_chunk_1b[1] {};
-char img::PNGImage::_chunk_4b[4] {};
-char img::PNGImage::_chunk_8b[8] {};
-
-#define GET_BUFF(start, end)                        \
-    smart_buffer = scline.get_chunk(start, end);    \
-    ptr_buffer = smart_buffer.get();
-
-void img::PNGImage::read_chunk_header(char*& buffer,
-                                      img::PNGImage::Chunk& chunk,
-                                      size_t& size) {
-    // first 4-byte chunk is length
-    Scanline::_extr_chunk(buffer, _chunk_4b, 4);
-    size = Scanline::_parse_chunk(_chunk_4b, 4);
-    // second 4-byte chunk is name
-    Scanline::_extr_chunk(buffer, _chunk_4b, 4);
-    if (Scanline::_cmp_chunks(_chunk_4b, 4, _ihdr_name, 4)) {
-        chunk = img::PNGImage::Chunk::IHDR;
-    } else if (Scanline::_cmp_chunks(_chunk_4b, 4, _idat_name, 4)) {
-        chunk = img::PNGImage::Chunk::IDAT;
-    } else if (Scanline::_cmp_chunks(_chunk_4b, 4, _iend_name, 4)) {
-        chunk = img::PNGImage::Chunk::IEND;
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstring>
+#include <span>
+
+img::PNGImage::ChunkReader::ChunkReader(std::span<const char> data) : _data {data} {}
+
+bool img::PNGImage::ChunkReader::next(ChunkView& view) {
+    if (_position == _data.size()) {
+        return false;
+    }
+    // length, type, payload and CRC
+    size_t left {_data.size() - _position};
+    const char* header {_data.data() + _position};
+    if (left < 12) {
+        throw DecoderError(ErrorType::BadChunkOrder,
+                           std::format("chunk is truncated at offset {}", _position));
+    }
+    size_t size {Scanline::_load_be32(header)};
+    if (size > left - 12) {
+        throw DecoderError(ErrorType::BadChunkOrder,
+                           std::format("chunk of size {} does not fit into file", size));
+    }
+    view.type = header + 4;
+    view.payload = std::span<const char>{header + 8, size};
+    view.crc = Scanline::_load_be32(header + 8 + size);
+    if (!std::memcmp(view.type, _ihdr_name, 4)) {
+        view.chunk = Chunk::IHDR;
+    } else if (!std::memcmp(view.type, _idat_name, 4)) {
+        view.chunk = Chunk::IDAT;
+    } else if (!std::memcmp(view.type, _iend_name, 4)) {
+        view.chunk = Chunk::IEND;
+    } else if (!std::memcmp(view.type, _plte_name, 4)) {
+        view.chunk = Chunk::PLTE;
     } else {
-        chunk = img::PNGImage::Chunk::Unknown;
+        view.chunk = Chunk::Unknown;
     }
+    _position += size + 12;
+    return true;
 }
 
+bool img::PNGImage::check_crc(const ChunkView& view) {
+    // type and payload are adjacent in the file
+    return Scanline::_crc(view.type, view.payload.size() + 4) == view.crc;
+}
 
-
-bool img::PNGImage::read_crc(char* buffer, size_t size) {
-    auto expected_crc = Scanline::_crc(buffer, size - 4);
-    auto actual_crc = Scanline::_parse_chunk(buffer + size - 4, 4) % UINT32_MAX;
-    return expected_crc == actual_crc;
+void img::PNGImage::read_plte(const ChunkView& view, bool after_idat) {
+    if (after_idat || !_palette.empty()) {
+        throw DecoderError(ErrorType::BadChunkOrder,
+                           std::string{"PLTE must be single and precede IDAT"});
+    }
+    size_t size {view.payload.size()};
+    if (!size || size % 3 || size > 256 * 3) {
+        throw DecoderError(ErrorType::BadChunkOrder,
+                           std::format("PLTE size must be multiple of 3 up to 768, decoded: {}",
+                                       size));
+    }
+    if (!check_crc(view)) {
+        throw DecoderError(ErrorType::BadCRC,
+                           std::string{"CRC of PLTE did not match decoded value"});
+    }
+    // palette of true color image is only a suggestion for quantization
+    if (color_type == 3) {
+        _palette.assign(view.payload.begin(), view.payload.end());
+    }
 }
 
-void img::PNGImage::read_ihdr(char*& buffer) {
-    size_t buff_pos = 0;
-    Scanline::_extr_chunk(buffer, _chunk_4b, 4);
-    int width = Scanline::_parse_chunk(_chunk_4b, 4);
-    Scanline::_extr_chunk(buffer, _chunk_4b, 4);
-    int height = Scanline::_parse_chunk(_chunk_4b, 4);
-    if (!(0 <= width && width < _size_limit) || !(0 <= height && height < _size_limit)) {
+void img::PNGImage::check_ihdr(const char* data) {
+    std::uint32_t width {Scanline::_load_be32(data)};
+    std::uint32_t height {Scanline::_load_be32(data + 4)};
+    if (!(width < _size_limit) || !(height < _size_limit)) {
         throw IHDRDecoderError{IHDRErrorType::BadImageSize,
                                std::format("w: {}, h: {}", width, height)};
     }
-
-    _map.expand(Side::bottom, height);
-    _map.expand(Side::right, width);
-
-    Scanline::_extr_chunk(buffer, _chunk_1b, 1);
-    bit_depth = Scanline::_parse_chunk(_chunk_1b, 1);
-    Scanline::_extr_chunk(buffer, _chunk_1b, 1);
-    color_type = Scanline::_parse_chunk(_chunk_1b, 1);
-    sample_size = 3;
-    Scanline::_extr_chunk(buffer, _chunk_1b, 1);
-    compression_method = Scanline::_parse_chunk(_chunk_1b, 1);
-    Scanline::_extr_chunk(buffer, _chunk_1b, 1);
-    filter_method = Scanline::_parse_chunk(_chunk_1b, 1);
-    Scanline::_extr_chunk(buffer, _chunk_1b, 1);
-    interlace_method = Scanline::_parse_chunk(_chunk_1b, 1);
-
-    if (color_type != 2) {
-        throw IHDRDecoderError(IHDRErrorType::BadColorType, std::to_string(color_type));
+    auto depth = static_cast<std::uint8_t>(data[8]);
+    auto type = static_cast<std::uint8_t>(data[9]);
+    auto compression = static_cast<std::uint8_t>(data[10]);
+    auto filter = static_cast<std::uint8_t>(data[11]);
+    auto interlace = static_cast<std::uint8_t>(data[12]);
+    if (type > 6 || !_color_samples[type]) {
+        throw IHDRDecoderError(IHDRErrorType::BadColorType, std::to_string(type));
+    }
+    // grayscale allows 1, 2, 4, 8 and 16 bits per sample, indexed color - up to 8 bits and
+    // the rest - 8 and 16 bits
+    bool low {type == 0 || type == 3};
+    bool high {type != 3};
+    if (!(depth == 8 || (high && depth == 16) ||
+          (low && (depth == 1 || depth == 2 || depth == 4)))) {
+        throw IHDRDecoderError(IHDRErrorType::BadBitDepth, std::to_string(depth));
     }
-    if (bit_depth != 8) {
-        throw IHDRDecoderError(IHDRErrorType::BadBitDepth, std::to_string(bit_depth));
+    if (compression) {
+        throw IHDRDecoderError(IHDRErrorType::BadCompession, std::to_string(compression));
     }
-    if (compression_method) {
-        throw IHDRDecoderError(IHDRErrorType::BadCompession, std::to_string(compression_method));
+    if (filter) {
+        throw IHDRDecoderError(IHDRErrorType::BadFilter, std::to_string(filter));
     }
-    if (filter_method) {
-        throw IHDRDecoderError(IHDRErrorType::BadFilter, std::to_string(filter_method));
+    if (interlace > 1) {
+        throw IHDRDecoderError(IHDRErrorType::BadInterlace, std::to_string(interlace));
+    }
+}
+
+void img::PNGImage::read_ihdr(const char* data) {
+    check_ihdr(data);
+    std::uint32_t width {Scanline::_load_be32(data)};
+    std::uint32_t height {Scanline::_load_be32(data + 4)};
+
+    // only the window is stored, scaled image covers partial boxes at its right and bottom
+    // edges
+    auto& region = _decode_options.region;
+    unsigned scale {_decode_options.scale};
+    _width = width;
+    _height = height;
+    _window_row = std::min(region.row, height);
+    _window_column = std::min(region.column, width);
+    _window_rows = std::min(region.rows ? region.rows : height, height - _window_row);
+    _window_columns = std::min(region.columns ? region.columns : width, width - _window_column);
+    bit_depth = static_cast<std::uint8_t>(data[8]);
+    // 16-bit samples are kept only in the map of full resolution
+    _map.format((bit_depth == 16 && scale == 1) ? PixelFormat::rgba16 : PixelFormat::rgba);
+    _map.expand(Side::bottom, (_window_rows + scale - 1) / scale);
+    _map.expand(Side::right, (_window_columns + scale - 1) / scale);
+
+    color_type = static_cast<std::uint8_t>(data[9]);
+    compression_method = static_cast<std::uint8_t>(data[10]);
+    filter_method = static_cast<std::uint8_t>(data[11]);
+    interlace_method = static_cast<std::uint8_t>(data[12]);
+
+    sample_size = _color_samples[color_type];
+    _channels = (color_type & 4) ? 4 : 3;
+    // rows of interlaced image are not complete until the last pass, so it needs sums of all
+    // boxes
+    _box_sums.assign((scale > 1) ?
+                     _map.columns() * _channels * (interlace_method ? _map.rows() : 1) : 0, 0);
+}
+
+void img::PNGImage::read_idat(const char* buffer, size_t size) {
+    size_t window {scanline_size(_width)};
+    size_t rows {_height};
+    auto data = reinterpret_cast<const std::uint8_t*>(buffer);
+    // rows below the window are not inflated, stream is still fully checked, if the window
+    // reaches the bottom edge
+    size_t last_row {static_cast<size_t>(_window_row) + _window_rows};
+    if (!_window_rows || !_window_columns) {
+        return;
     }
     if (interlace_method) {
-        throw IHDRDecoderError(IHDRErrorType::BadCompession, std::to_string(interlace_method));
+        try {
+            read_adam7(data, size);
+        } catch (const std::runtime_error& error) {
+            throw DecoderError(ErrorType::BadDeflateCompression, error.what());
+        }
+        return;
+    }
+    auto needed = [&](size_t index) {
+        return index + 1 < last_row || last_row == rows;
+    };
+    // unfiltered current and upper lines, they swap places after every row
+    auto lines = std::make_unique<std::uint8_t[]>(window * 2);
+    std::uint8_t* current_line {lines.get()};
+    std::uint8_t* upper_line {nullptr};
+    auto unfilter = [&](size_t index) {
+        parse_line(current_line, upper_line, index);
+        upper_line = current_line;
+        current_line = (current_line == lines.get()) ? lines.get() + window : lines.get();
+    };
+    try {
+        if (!_decode_options.pipeline || rows < 2) {
+            Scanline::inflate(data, size, window, rows, [&](const std::uint8_t* row, size_t index) {
+                std::copy(row, row + window, current_line);
+                unfilter(index);
+                return needed(index);
+            });
+            return;
+        }
+        // pipeline: inflate thread fills ring of scanlines, this thread unfilters them
+        size_t ring_rows {std::min(_decode_options.ring_rows, rows)};
+        auto ring = std::make_unique<std::uint8_t[]>(ring_rows * window);
+        std::mutex mutex;
+        std::condition_variable row_ready, slot_free;
+        size_t produced {0}, consumed {0};
+        // cancelled is set by this thread, if unfiltering fails, so that inflate thread stops
+        bool finished {false}, cancelled {false};
+        std::exception_ptr error;
+        std::thread inflate_thread {[&] {
+            try {
+                Scanline::inflate(data, size, window, rows,
+                                  [&](const std::uint8_t* row, size_t index) {
+                    {
+                        std::unique_lock lock {mutex};
+                        slot_free.wait(lock, [&] {
+                            return produced - consumed < ring_rows || cancelled;
+                        });
+                        if (cancelled) {
+                            return false;
+                        }
+                    }
+                    std::copy(row, row + window, ring.get() + (index % ring_rows) * window);
+                    {
+                        std::lock_guard lock {mutex};
+                        ++produced;
+                    }
+                    row_ready.notify_one();
+                    return needed(index);
+                });
+            } catch (...) {
+                error = std::current_exception();
+            }
+            {
+                std::lock_guard lock {mutex};
+                finished = true;
+            }
+            row_ready.notify_one();
+        }};
+        try {
+            for (size_t index {0}; index < last_row; ++index) {
+                {
+                    std::unique_lock lock {mutex};
+                    row_ready.wait(lock, [&] { return produced > index || finished; });
+                    if (produced <= index) {
+                        break;
+                    }
+                }
+                auto slot = ring.get() + (index % ring_rows) * window;
+                std::copy(slot, slot + window, current_line);
+                {
+                    std::lock_guard lock {mutex};
+                    ++consumed;
+                }
+                slot_free.notify_one();
+                unfilter(index);
+            }
+        } catch (...) {
+            {
+                std::lock_guard lock {mutex};
+                cancelled = true;
+            }
+            slot_free.notify_one();
+            inflate_thread.join();
+            throw;
+        }
+        inflate_thread.join();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    } catch (const std::runtime_error& error) {
+        throw DecoderError(ErrorType::BadDeflateCompression, error.what());
     }
 }
 
-void img::PNGImage::read_idat(char*& buffer, size_t size) {
-    unsigned long dest_len {static_cast<unsigned long>(_map.rows() * (_map.columns() + 1) *
-                                                      (3 + (color_type == 6)) *
-                                                      (bit_depth / 8))};
-    auto dest = std::make_unique<std::uint8_t[]>(dest_len);
-    auto result = uncompress(dest.get(),
-                             &dest_len,
-                             reinterpret_cast<std::uint8_t*>(buffer),
-                             size);
-    auto ptr_dest = dest.get();
-    if (result != Z_OK) {
-        throw DecoderError(ErrorType::BadDeflateCompression, std::format("Status: {}", result));
+void img::PNGImage::read_adam7(const std::uint8_t* data, size_t size) {
+    // scanlines of non-empty passes (empty ones have no scanlines at all), pass and row in
+    // pass of every scanline
+    std::vector<size_t> row_sizes;
+    std::vector<std::pair<size_t, size_t>> scanlines;
+    size_t needed_rows {0}, max_size {0};
+    for (size_t pass {0}; pass < 7; ++pass) {
+        auto [first_row, first_column, row_step, column_step] = _adam7[pass];
+        size_t width {(_width > first_column) ?
+                      (_width - first_column + column_step - 1) / column_step : 0};
+        size_t rows {(_height > first_row) ? (_height - first_row + row_step - 1) / row_step : 0};
+        if (!width) {
+            continue;
+        }
+        for (size_t row {0}; row < rows; ++row) {
+            row_sizes.push_back(scanline_size(width));
+            scanlines.emplace_back(pass, row);
+        }
+        max_size = std::max(max_size, scanline_size(width));
+        if (pass < _decode_options.passes) {
+            needed_rows = row_sizes.size();
+        }
+    }
+    auto lines = std::make_unique<std::uint8_t[]>(max_size * 2);
+    std::uint8_t* current_line {lines.get()};
+    std::uint8_t* upper_line {nullptr};
+    Scanline::inflate(data, size, row_sizes, [&](const std::uint8_t* line, size_t index) {
+        auto [pass, row] = scanlines[index];
+        if (!row) {
+            upper_line = nullptr;
+        }
+        std::copy(line, line + row_sizes[index], current_line);
+        parse_adam7_line(current_line, upper_line, pass, row_sizes[index], row);
+        upper_line = current_line;
+        current_line = (current_line == lines.get()) ? lines.get() + max_size : lines.get();
+        // preview stops after the last scanline of the last requested pass
+        return index + 1 < needed_rows || needed_rows == row_sizes.size();
+    });
+    if (_decode_options.scale > 1) {
+        finish_boxes();
     }
-    parse_8b_truecolor(ptr_dest, dest_len);
 }
 
 void img::PNGImage::read(std::string_view path) {
 
     _status = false;
-
     Scanline scline {path.data(), ScanMode::read};
-    img::PNGImage::Chunk chunk;
-    size_t chunk_size;
     _map.trim(Side::bottom, _map.rows());
     _map.trim(Side::right, _map.columns());
 
-    // parse 8-bit header
+    // whole file is mapped (or read at once), chunks are parsed in place, so that data of
+    // skipped ones is never touched
+    auto file = scline.view_all();
+    _ancillary.clear();
+    _palette.clear();
 
-    scline.call_read(8);
-    auto smart_buffer = scline.get_chunk(0, 8);
-    auto ptr_buffer = smart_buffer.get();
-    if (!Scanline::_cmp_chunks(ptr_buffer, 8, _signature, 8)) {
-        throw DecoderError(ErrorType::BadSignature, std::string{ptr_buffer});
+    // parse 8-bit header
+    if (file.size() < 8 || !Scanline::_cmp_chunks(file.data(), 8, _signature, 8)) {
+        throw DecoderError(ErrorType::BadSignature,
+                           std::string{file.data(), std::min<size_t>(file.size(), 8)});
     }
-    scline.reset_buffer(8);
 
     // parse IHDR
-    scline.call_read(25);
-    GET_BUFF(0, 8);
-    read_chunk_header(ptr_buffer, chunk, chunk_size);
-    if (chunk_size != 13) {
+    ChunkReader reader {file.subspan(8)};
+    ChunkView view;
+    if (!reader.next(view) || view.payload.size() != 13) {
         throw DecoderError(ErrorType::BadChunkOrder,
-                           std::format("IHDR size must 13, decoded: {}", chunk_size));
+                           std::format("IHDR size must 13, decoded: {}", view.payload.size()));
     }
-    if (chunk != img::PNGImage::Chunk::IHDR) {
+    if (view.chunk != img::PNGImage::Chunk::IHDR) {
         throw DecoderError(ErrorType::BadChunkOrder,
                            std::format("IHDR expected, decoded (ID) - {}",
-                                       static_cast<int>(chunk)));
+                                       static_cast<int>(view.chunk)));
     }
-    GET_BUFF(8, 21);
-    read_ihdr(ptr_buffer);
-    GET_BUFF(4, 25);
-    if (!read_crc(ptr_buffer, 21)) {
+    read_ihdr(view.payload.data());
+    if (!check_crc(view)) {
         throw DecoderError(ErrorType::BadCRC,
                            std::string{"CRC of IHDR did not match decoded value"});
     }
-    scline.reset_buffer(scline.size());
 
-    std::unique_ptr<char[]> data_stream;
-    char* ptr_data_stream;
-    size_t data_stream_size {0};
+    // single IDAT is decoded straight from the file buffer, payloads of several consecutive
+    // ones are joined into one zlib stream
+    std::span<const char> data_stream;
+    std::vector<char> joined_stream;
+    size_t idat_chunks {0};
     bool is_data_stream {false};
 
-    while (chunk != img::PNGImage::Chunk::IEND) {
+    while (view.chunk != img::PNGImage::Chunk::IEND) {
 
-        scline.call_read(8);
-        GET_BUFF(0, 8);
-        read_chunk_header(ptr_buffer, chunk, chunk_size);
+        if (!reader.next(view)) {
+            throw DecoderError(ErrorType::BadChunkOrder, std::string{"IEND chunk is missing"});
+        }
 
-        if (is_data_stream && chunk != img::PNGImage::Chunk::IDAT) {
+        if (is_data_stream && view.chunk != img::PNGImage::Chunk::IDAT) {
             is_data_stream = false;
-            read_idat(ptr_data_stream, data_stream_size);
-            data_stream.reset();
+            read_idat(data_stream.data(), data_stream.size());
         }
 
-        if (chunk == img::PNGImage::Chunk::IDAT) {
-            if (!is_data_stream) { is_data_stream = true; }
-            scline.call_read(chunk_size + 4);
-            GET_BUFF(8, chunk_size + 8);
-            auto expanded_stream = std::make_unique<char[]>(data_stream_size + chunk_size);
-            size_t i;
-            for (i = 0; i < data_stream_size; ++i) {
-                expanded_stream[i] = data_stream[i];
+        if (view.chunk == img::PNGImage::Chunk::IDAT) {
+            if (!is_data_stream && idat_chunks) {
+                throw DecoderError(ErrorType::BadChunkOrder,
+                                   std::string{"IDAT chunks must be consecutive"});
             }
-            data_stream_size += chunk_size;
-            for (size_t initial {i}; i < data_stream_size; ++i) {
-                expanded_stream[i] = ptr_buffer[i - initial];
+            if (color_type == 3 && _palette.empty()) {
+                throw DecoderError(ErrorType::BadChunkOrder, std::string{"PLTE chunk is missing"});
             }
-            data_stream = std::move(expanded_stream);
-            ptr_data_stream = data_stream.get();
-            GET_BUFF(4, chunk_size + 12);
-            if (!read_crc(ptr_buffer, chunk_size + 8)) {
+            is_data_stream = true;
+            if (!check_crc(view)) {
                 throw DecoderError(ErrorType::BadCRC,
                                    std::string{"CRC of IDAT did not match decoded value"});
             }
-            scline.reset_buffer(scline.size());
-        } else if (chunk == img::PNGImage::Chunk::IEND) {
-            scline.call_read(4);
-            GET_BUFF(4, 12);
-            if (!read_crc(ptr_buffer, 8)) {
+            if (!idat_chunks++) {
+                data_stream = view.payload;
+                continue;
+            }
+            if (joined_stream.empty()) {
+                joined_stream.assign(data_stream.begin(), data_stream.end());
+            }
+            joined_stream.insert(joined_stream.end(), view.payload.begin(), view.payload.end());
+            data_stream = joined_stream;
+        } else if (view.chunk == img::PNGImage::Chunk::IEND) {
+            if (!check_crc(view)) {
                 throw DecoderError(ErrorType::BadCRC,
                                    std::string{"CRC of IEND did not match decoded value"});
             }
-            scline.reset_buffer(scline.size());
-        } else if (chunk == img::PNGImage::Chunk::Unknown) {
-            scline.call_read(chunk_size + 4);
-            scline.reset_buffer(scline.size());
+        } else if (view.chunk == img::PNGImage::Chunk::PLTE) {
+            read_plte(view, idat_chunks > 0);
+        } else if (_decode_options.ancillary != Ancillary::skip) {
+            if (!check_crc(view)) {
+                throw DecoderError(ErrorType::BadCRC,
+                                   std::format("CRC of {} did not match decoded value",
+                                               std::string_view{view.type, 4}));
+            }
+            if (_decode_options.ancillary == Ancillary::retain) {
+                AncillaryChunk chunk {{}, {view.payload.begin(), view.payload.end()},
+                                      idat_chunks > 0};
+                std::copy(view.type, view.type + 4, chunk.type.begin());
+                _ancillary.push_back(std::move(chunk));
+            }
         }
 
     }
@@ -205,81 +410,270 @@ void img::PNGImage::read(std::string_view path) {
     _status = true;
 }
 
+img::PNGImage::EncodeOptions img::PNGImage::EncodeOptions::fast() {
+    EncodeOptions options {};
+    options.level = 1;
+    options.strategy = Strategy::rle;
+    return options;
+}
+
+img::PNGImage::EncodeOptions img::PNGImage::EncodeOptions::small() {
+    EncodeOptions options {};
+    options.level = 9;
+    options.mem_level = 9;
+    options.palette = true;
+    return options;
+}
+
+const img::PNGImage::EncodeOptions& img::PNGImage::encode_options() const {
+    return _encode_options;
+}
+
+void img::PNGImage::encode_options(const EncodeOptions& options) {
+    if (!(0 <= options.level && options.level <= 9)) {
+        throw std::runtime_error("Parameter <level> value is out of acceptable range.");
+    }
+    if (!(1 <= options.mem_level && options.mem_level <= 9)) {
+        throw std::runtime_error("Parameter <mem_level> value is out of acceptable range.");
+    }
+    if (!(9 <= options.window_bits && options.window_bits <= 15)) {
+        throw std::runtime_error("Parameter <window_bits> value is out of acceptable range.");
+    }
+    if (options.bit_depth != 0 && options.bit_depth != 8 && options.bit_depth != 16) {
+        throw std::runtime_error("Parameter <bit_depth> value is out of acceptable range.");
+    }
+    _encode_options = options;
+}
+
+const img::PNGImage::DecodeOptions& img::PNGImage::decode_options() const {
+    return _decode_options;
+}
+
+const std::vector<img::PNGImage::AncillaryChunk>& img::PNGImage::ancillary_chunks() const {
+    return _ancillary;
+}
+
+void img::PNGImage::decode_options(const DecodeOptions& options) {
+    if (!options.ring_rows) {
+        throw std::runtime_error("Parameter <ring_rows> value is out of acceptable range.");
+    }
+    if (options.scale != 1 && options.scale != 2 && options.scale != 4 && options.scale != 8) {
+        throw std::runtime_error("Parameter <scale> value is out of acceptable range.");
+    }
+    if (!(1 <= options.passes && options.passes <= 7)) {
+        throw std::runtime_error("Parameter <passes> value is out of acceptable range.");
+    }
+    _decode_options = options;
+}
+
 void img::PNGImage::write(std::string_view path) {
 
     _status = false;
+    // 16-bit output is only written from 16-bit samples, 8-bit ones do not make it precise
+    bool wide {_map.format() == PixelFormat::rgba16};
+    bit_depth = _encode_options.bit_depth ? _encode_options.bit_depth : (wide ? 16 : 8);
+    if (bit_depth == 16 && !wide) {
+        throw std::runtime_error("16-bit output needs pixel map of 16-bit samples");
+    }
     Scanline scline {path.data(), ScanMode::write};
 
-    scline.expand_buffer(8);
-    scline.set_chunk(0, 8, _signature);
-    scline.call_write(8);
+    scline.write_bytes(_signature, 8);
+
+    // true color, unless image is gray or fits into palette; 8-bit gray is preferred to
+    // 8-bit palette, that only adds PLTE; alpha is written only if some pixel is not opaque
+    // (palette has no transparency)
+    std::vector<std::uint8_t> indices;
+    auto grayscale = _encode_options.grayscale;
+    bool gray {grayscale == Grayscale::force ||
+               (grayscale == Grayscale::automatic && is_grayscale())};
+    bool alpha {has_alpha()};
+    color_type = (gray ? 0 : 2) | (alpha ? 4 : 0);
+    sample_size = (gray ? 1 : 3) + alpha;
+    _palette.clear();
+    if (grayscale != Grayscale::force && _encode_options.palette && !alpha && bit_depth == 8 &&
+        build_palette(indices)) {
+        size_t colors {_palette.size() / 3};
+        int depth {(colors <= 2) ? 1 : (colors <= 4) ? 2 : (colors <= 16) ? 4 : 8};
+        if (!gray || depth < 8) {
+            color_type = 3;
+            bit_depth = depth;
+            sample_size = 1;
+        } else {
+            _palette.clear();
+        }
+    }
 
     write_ihdr(scline);
-    write_idat(scline);
+    if (color_type == 3) {
+        write_plte(scline);
+    }
+    write_ancillary(scline, false);
+    write_idat(scline, indices);
+    write_ancillary(scline, true);
     write_iend(scline);
     _status = true;
 }
 
 void img::PNGImage::write_ihdr(Scanline& scanline) {
-    scanline.reset_buffer(scanline.size());
-    scanline.expand_buffer(8 + 13 + 4);
-    auto buffer = Scanline::_set_chunk(13, 4);
-    scanline.set_chunk(0, 4, buffer.get());
-    scanline.set_chunk(4, 8, _ihdr_name);
-    buffer = Scanline::_set_chunk(_map.columns(), 4);
-    scanline.set_chunk(8, 12, buffer.get());
-    buffer = Scanline::_set_chunk(_map.rows(), 4);
-    scanline.set_chunk(12, 16, buffer.get());
-    buffer = Scanline::_set_chunk(8, 1);        // bit depth is always 8
-    scanline.set_chunk(16, 17, buffer.get());
-    buffer = Scanline::_set_chunk(2, 1);        // color type is RGB
-    scanline.set_chunk(17, 18, buffer.get());
-    buffer = Scanline::_set_chunk(0, 3);
-    scanline.set_chunk(18, 21, buffer.get());
-    buffer = scanline.get_chunk(4, 21);
-    auto crc = Scanline::_crc(buffer.get(), 21 - 4);
-    buffer = Scanline::_set_chunk(crc, 4);
-    scanline.set_chunk(21, 25, buffer.get());
-    scanline.call_write(scanline.size());
+    char data[13] {};
+    Scanline::_store_be32(data, _map.columns());
+    Scanline::_store_be32(data + 4, _map.rows());
+    data[8] = bit_depth;
+    data[9] = color_type;
+    // compression, filter and interlace methods are 0
+    scanline.begin_chunk(_ihdr_name, 13);
+    scanline.write_chunk_data(data, 13);
+    scanline.end_chunk();
+}
+
+void img::PNGImage::write_plte(Scanline& scanline) {
+    scanline.begin_chunk(_plte_name, _palette.size());
+    scanline.write_chunk_data(reinterpret_cast<const char*>(_palette.data()), _palette.size());
+    scanline.end_chunk();
 }
 
-void img::PNGImage::write_idat(Scanline& scanline) {
+void img::PNGImage::write_idat(Scanline& scanline, const std::vector<std::uint8_t>& indices) {
     std::unique_ptr<std::uint8_t[]> data {nullptr};
     size_t size;
-    assemble_8b_truecolor(data, size);
-    unsigned long comp_size {static_cast<unsigned long>(std::ceil(size * 1.2))};
-//    int comp_size {static_cast<int>(std::ceil(size * 10))};
-    auto compressed = std::make_unique<std::uint8_t[]>(comp_size);
-    auto result = compress(compressed.get(), &comp_size, data.get(), size);
-//    auto result = Scanline::deflate(reinterpret_cast<char*>(compressed.get()),
-//                                    comp_size,
-//                                    reinterpret_cast<char*>(data.get()),
-//                                    size);
-    if (result == Z_OK) {
-        scanline.reset_buffer(scanline.size());
-        scanline.expand_buffer(8 + comp_size + 4);
-        auto buffer = Scanline::_set_chunk(comp_size, 4);
-        scanline.set_chunk(0, 4, buffer.get());
-        scanline.set_chunk(4, 8, _idat_name);
-        scanline.set_chunk(8, 8 + comp_size, reinterpret_cast<char*>(compressed.get()));
-        buffer = scanline.get_chunk(4, 8 + comp_size);
-        auto crc = Scanline::_crc(buffer.get(), comp_size + 4);
-        buffer = Scanline::_set_chunk(crc, 4);
-        scanline.set_chunk(8 + comp_size, 8 + comp_size + 4, buffer.get());
-        scanline.call_write(scanline.size());
+    if (color_type == 3) {
+        assemble_indexed(indices, data, size);
+    } else if (color_type == 2 && bit_depth == 8) {
+        assemble_8b_truecolor(data, size);
+    } else {
+        assemble_samples(data, size);
+    }
+    Scanline::zlib_params params {};
+    params.level = _encode_options.level;
+    params.mem_level = _encode_options.mem_level;
+    params.window_bits = _encode_options.window_bits;
+    switch (_encode_options.strategy) {
+    case Strategy::standard:
+        params.strategy = Z_DEFAULT_STRATEGY;
+        break;
+    case Strategy::filtered:
+        params.strategy = Z_FILTERED;
+        break;
+    case Strategy::huffman_only:
+        params.strategy = Z_HUFFMAN_ONLY;
+        break;
+    case Strategy::rle:
+        params.strategy = Z_RLE;
+        break;
+    case Strategy::fixed:
+        params.strategy = Z_FIXED;
+        break;
+    case Strategy::automatic:
+        select_strategy(data.get(), size, scanline_size(_map.columns()), params);
+        break;
+    }
+    std::vector<std::uint8_t> compressed;
+    auto result = Scanline::parallel_deflate(compressed, data.get(), size,
+                                             _encode_options.threads, params);
+    if (result != Z_OK) {
+        throw std::runtime_error(std::format("Compression of image data failed, zlib status: {}",
+                                             result));
+    }
+    // compressed stream may be split between several consecutive IDAT chunks
+    size_t chunk_limit {_encode_options.idat_chunk_size ? _encode_options.idat_chunk_size
+                                                        : compressed.size()};
+    size_t position {0};
+    do {
+        size_t comp_size {std::min(chunk_limit, compressed.size() - position)};
+        scanline.begin_chunk(_idat_name, comp_size);
+        scanline.write_chunk_data(reinterpret_cast<char*>(compressed.data() + position), comp_size);
+        scanline.end_chunk();
+        position += comp_size;
+    } while (position < compressed.size());
+}
+
+namespace {
+// Size of data compressed as zlib stream with given parameters
+size_t compressed_size(const std::vector<std::uint8_t>& data, int level, int strategy,
+                       int mem_level, int window_bits) {
+    z_stream stream {};
+    if (deflateInit2(&stream, level, Z_DEFLATED, window_bits, mem_level, strategy) != Z_OK) {
+        return data.size();
+    }
+    std::vector<std::uint8_t> output(deflateBound(&stream, data.size()));
+    stream.next_in = const_cast<std::uint8_t*>(data.data());
+    stream.avail_in = data.size();
+    stream.next_out = output.data();
+    stream.avail_out = output.size();
+    auto result = ::deflate(&stream, Z_FINISH);
+    size_t size {(result == Z_STREAM_END) ? stream.total_out : data.size()};
+    deflateEnd(&stream);
+    return size;
+}
+}
+
+void img::PNGImage::select_strategy(const std::uint8_t* data, size_t size, size_t row_size,
+                                    Scanline::zlib_params& params) {
+    // sample is made of evenly spaced stripes of consecutive rows
+    std::vector<std::uint8_t> sample;
+    if (size <= _sample_size) {
+        sample.assign(data, data + size);
+    } else {
+        constexpr size_t stripes {8};
+        size_t rows {size / row_size};
+        size_t stripe_rows {std::max<size_t>(_sample_size / stripes / row_size, 1)};
+        for (size_t stripe {0}; stripe < stripes && sample.size() < _sample_size; ++stripe) {
+            size_t first {stripe * rows / stripes};
+            size_t last {std::min(first + stripe_rows, rows)};
+            sample.insert(sample.end(), data + first * row_size, data + last * row_size);
+        }
+    }
+    // order-0 entropy and share of bytes, that repeat previous one
+    size_t frequency[256] {};
+    size_t repeats {0};
+    for (size_t i {0}; i < sample.size(); ++i) {
+        ++frequency[sample[i]];
+        repeats += i && sample[i] == sample[i - 1];
+    }
+    double entropy {0};
+    for (auto count : frequency) {
+        if (count) {
+            double p {static_cast<double>(count) / sample.size()};
+            entropy -= p * std::log2(p);
+        }
+    }
+    double runs {sample.empty() ? 1.0 : static_cast<double>(repeats) / sample.size()};
+    params.strategy = Z_DEFAULT_STRATEGY;
+    if (!params.level || entropy >= _stored_entropy) {
+        params.level = 0;
+        return;
+    }
+    // RLE is the cheapest strategy that still compresses, full deflate has to pay off
+    auto rle_size = compressed_size(sample, params.level, Z_RLE, params.mem_level,
+                                    params.window_bits);
+    if (rle_size >= sample.size() * (1 - _min_deflate_gain)) {
+        params.level = 0;
+        return;
+    }
+    params.strategy = Z_RLE;
+    if (runs >= 0.9) {
+        return;
+    }
+    auto full_size = compressed_size(sample, params.level, Z_DEFAULT_STRATEGY, params.mem_level,
+                                     params.window_bits);
+    if (full_size <= rle_size * (1 - _min_deflate_gain)) {
+        params.strategy = Z_DEFAULT_STRATEGY;
+    }
+}
+
+void img::PNGImage::write_ancillary(Scanline& scanline, bool after_idat) {
+    for (auto& chunk : _ancillary) {
+        // bit 5 of the last type byte (lowercase letter) marks safe-to-copy chunks
+        if (chunk.after_idat == after_idat && (chunk.type[3] & 0x20)) {
+            scanline.begin_chunk(chunk.type.data(), chunk.data.size());
+            scanline.write_chunk_data(chunk.data.data(), chunk.data.size());
+            scanline.end_chunk();
+        }
     }
 }
 
 void img::PNGImage::write_iend(Scanline& scanline) {
-    scanline.reset_buffer(scanline.size());
-    scanline.expand_buffer(12);
-    auto buffer = Scanline::_set_chunk(0, 4);
-    scanline.set_chunk(0, 4, buffer.get());
-    scanline.set_chunk(4, 8, _iend_name);
-    auto crc = Scanline::_crc(_iend_name, 4);
-    buffer = Scanline::_set_chunk(crc, 4);
-    scanline.set_chunk(8, 12, buffer.get());
-    scanline.call_write(scanline.size());
+    scanline.begin_chunk(_iend_name, 0);
+    scanline.end_chunk();
 }
 
 
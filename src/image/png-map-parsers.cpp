@@ -1,77 +1,464 @@
 #include "image.hpp"
 #include <memory>
 #include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <format>
+#include <bit>
+#include <cstring>
 
-void img::PNGImage::parse_8b_truecolor(std::uint8_t*& buffer, size_t size) {
-    auto step = 3;
-    auto window = _map.columns() * step + 1;
-    auto current_line = std::make_unique<std::uint8_t[]>(window);
-    std::unique_ptr<std::uint8_t[]> upper_line {nullptr};
-    for (int row {0}; row < _map.rows(); ++row) {
-        for (size_t i {0}; i < window; ++i) {
-            current_line[i] = buffer[i];
-        }
-        buffer += window;
-        auto filter = current_line[0];
-        switch (filter) {
-        case 1:
-            reverse_sub(current_line.get() + 1, window - 1);
-            break;
-        case 2:
-            reverse_up(current_line.get() + 1,
-                       ((upper_line.get()) ? upper_line.get() + 1 : nullptr),
-                       window - 1);
-            break;
-        case 3:
-            reverse_avg(current_line.get() + 1,
-                        ((upper_line.get()) ? upper_line.get() + 1 : nullptr),
-                        window - 1);
-            break;
-        case 4:
-            reverse_paeth(current_line.get() + 1,
-                          ((upper_line.get()) ? upper_line.get() + 1 : nullptr),
-                          window - 1);
-            break;
-        case 0:
-            break;
-        }
-        for (int column {0}; column < _map.columns(); ++column) {
-            auto color = img::Color{};
-            color.R(current_line[1 + column * step]);
-            color.G(current_line[1 + column * step + 1]);
-            color.B(current_line[1 + column * step + 2]);
-            _map.at(row, column) = color;
-        }
-        upper_line.reset();
-        upper_line = std::move(current_line);
-        current_line = std::make_unique<std::uint8_t[]>(window);
+void img::PNGImage::unfilter_line(std::uint8_t* line, std::uint8_t* upper_line, size_t size) {
+    auto filter = line[0];
+    switch (filter) {
+    case 1:
+        reverse_sub(line + 1, size - 1);
+        break;
+    case 2:
+        reverse_up(line + 1, ((upper_line) ? upper_line + 1 : nullptr), size - 1);
+        break;
+    case 3:
+        reverse_avg(line + 1, ((upper_line) ? upper_line + 1 : nullptr), size - 1);
+        break;
+    case 4:
+        reverse_paeth(line + 1, ((upper_line) ? upper_line + 1 : nullptr), size - 1);
+        break;
+    case 0:
+        break;
+    }
+}
+
+size_t img::PNGImage::scanline_size(size_t width) const {
+    return (width * sample_size * bit_depth + 7) / 8 + 1;
+}
+
+void img::PNGImage::load_be16(const std::uint8_t* data, std::uint16_t* samples, size_t count) {
+    size_t i {0};
+    if constexpr (std::endian::native == std::endian::little) {
+        // bytes of 4 samples are swapped at once within a 64-bit word
+        constexpr std::uint64_t low {0x00FF00FF00FF00FF};
+        for (; i + 4 <= count; i += 4) {
+            std::uint64_t word;
+            std::memcpy(&word, data + i * 2, 8);
+            word = ((word & low) << 8) | ((word >> 8) & low);
+            std::memcpy(samples + i, &word, 8);
+        }
+    }
+    for (; i < count; ++i) {
+        samples[i] = static_cast<std::uint16_t>(data[i * 2] << 8 | data[i * 2 + 1]);
+    }
+}
+
+const std::uint8_t* img::PNGImage::to_rgb(const std::uint8_t* pixels, size_t first, size_t count) {
+    if (bit_depth >= 8 && color_type != 3) {
+        size_t samples {count * sample_size};
+        auto narrow = pixels + first * sample_size;
+        if (bit_depth == 16) {
+            // round(value * 255 / 65535), exact inverse of 8-bit value scaled by 257
+            _wide_line.resize(samples);
+            _narrow_line.resize(samples);
+            load_be16(pixels + first * sample_size * 2, _wide_line.data(), samples);
+            for (size_t i {0}; i < samples; ++i) {
+                _narrow_line[i] = static_cast<std::uint8_t>((_wide_line[i] + 128u) / 257u);
+            }
+            narrow = _narrow_line.data();
+        }
+        // true color pixels are already RGB triplets or RGBA quadruplets
+        if (color_type & 2) {
+            return narrow;
+        }
+        _rgb_line.resize(count * _channels);
+        auto rgb = _rgb_line.data();
+        for (size_t i {0}; i < count; ++i, rgb += _channels, narrow += sample_size) {
+            rgb[0] = rgb[1] = rgb[2] = narrow[0];
+            if (sample_size == 2) {
+                rgb[3] = narrow[1];
+            }
+        }
+        return _rgb_line.data();
+    }
+    // gray and indexed color: bit_depth bits per sample, leftmost pixel in high bits of a byte
+    _rgb_line.resize(count * 3);
+    unsigned per_byte {8u / bit_depth}, mask {(1u << bit_depth) - 1};
+    size_t palette_size {_palette.size() / 3};
+    for (size_t i {0}; i < count; ++i) {
+        size_t column {first + i};
+        unsigned shift {static_cast<unsigned>((per_byte - 1 - column % per_byte) * bit_depth)};
+        size_t index {(pixels[column / per_byte] >> shift) & mask};
+        if (color_type == 0) {
+            // samples are scaled to the full range of 8 bits
+            std::fill_n(_rgb_line.data() + i * 3, 3,
+                        static_cast<std::uint8_t>(index * 255 / mask));
+            continue;
+        }
+        if (index >= palette_size) {
+            throw DecoderError(ErrorType::BadImageData,
+                               std::format("palette index {} is out of range", index));
+        }
+        std::copy_n(_palette.data() + index * 3, 3, _rgb_line.data() + i * 3);
+    }
+    return _rgb_line.data();
+}
+
+void img::PNGImage::parse_line(std::uint8_t* line, std::uint8_t* upper_line, size_t row) {
+    auto step = _channels;
+    unfilter_line(line, upper_line, scanline_size(_width));
+    // rows outside of the window are unfiltered only to serve as upper lines
+    if (row < _window_row || row >= _window_row + _window_rows) {
+        return;
+    }
+    auto pixels = to_rgb(line + 1, _window_column, _window_columns);
+    if (_decode_options.scale > 1) {
+        accumulate_boxes(pixels, row - _window_row);
+        return;
+    }
+    if (_map.format() == PixelFormat::rgba16) {
+        for (size_t column {0}; column < _map.columns(); ++column) {
+            store_wide(row - _window_row, column, _wide_line.data() + column * sample_size);
+        }
+        return;
+    }
+    for (int column {0}; column < _map.columns(); ++column) {
+        auto color = img::Color{};
+        color.R(pixels[column * step]);
+        color.G(pixels[column * step + 1]);
+        color.B(pixels[column * step + 2]);
+        if (step == 4) {
+            color.A(pixels[column * step + 3]);
+        }
+        _map.at(row - _window_row, column) = color;
+    }
+}
+
+void img::PNGImage::accumulate_boxes(const std::uint8_t* pixels, size_t row) {
+    unsigned scale {_decode_options.scale};
+    size_t columns {_map.columns()}, channels {_channels};
+    auto sums = _box_sums.data();
+    // full boxes first, then the partial one at the right edge
+    size_t full {_window_columns / scale};
+    for (size_t box {0}; box < full; ++box) {
+        auto pixel = pixels + box * scale * channels;
+        for (size_t channel {0}; channel < channels; ++channel) {
+            std::uint32_t sum {0};
+            for (size_t column {0}; column < scale; ++column) {
+                sum += pixel[column * channels + channel];
+            }
+            sums[box * channels + channel] += sum;
+        }
+    }
+    for (size_t column {full * scale}; column < _window_columns; ++column) {
+        for (size_t channel {0}; channel < channels; ++channel) {
+            sums[full * channels + channel] += pixels[column * channels + channel];
+        }
+    }
+    if ((row + 1) % scale && row + 1 < _window_rows) {
+        return;
+    }
+    std::uint32_t box_rows {static_cast<std::uint32_t>(row % scale + 1)};
+    for (size_t box {0}; box < columns; ++box) {
+        std::uint32_t box_columns {std::min<std::uint32_t>(scale, _window_columns - box * scale)};
+        std::uint32_t count {box_rows * box_columns};
+        auto average = [&](size_t channel) {
+            return static_cast<int>((sums[box * channels + channel] + count / 2) / count);
+        };
+        _map.at(row / scale, box) = Color{average(0), average(1), average(2),
+                                          (channels == 4) ? average(3) : 255};
+    }
+    std::fill(_box_sums.begin(), _box_sums.end(), 0);
+}
+
+void img::PNGImage::parse_adam7_line(std::uint8_t* line, std::uint8_t* upper_line, size_t pass,
+                                     size_t size, size_t row) {
+    unfilter_line(line, upper_line, size);
+    auto [first_row, first_column, row_step, column_step] = _adam7[pass];
+    // in preview every decoded pixel fills the block, that later passes would fill
+    auto [row_mask, column_mask] = _adam7_blocks[_decode_options.passes - 1];
+    size_t image_row {first_row + row * row_step};
+    size_t block_rows {std::min<size_t>(row_mask + 1, _height - image_row)};
+    size_t width {(_width - first_column + column_step - 1) / column_step};
+    auto pixels = to_rgb(line + 1, 0, width);
+    for (size_t column {0}; column < width; ++column) {
+        size_t image_column {first_column + column * column_step};
+        size_t block_columns {std::min<size_t>(column_mask + 1, _width - image_column)};
+        for (size_t y {0}; y < block_rows; ++y) {
+            for (size_t x {0}; x < block_columns; ++x) {
+                put_pixel(image_row + y, image_column + x, pixels + column * _channels,
+                          (_map.format() == PixelFormat::rgba16) ?
+                          _wide_line.data() + column * sample_size : nullptr);
+            }
+        }
+    }
+}
+
+void img::PNGImage::put_pixel(size_t row, size_t column, const std::uint8_t* pixel,
+                              const std::uint16_t* wide) {
+    // unsigned wrap-around drops pixels above and to the left of the window too
+    row -= _window_row;
+    column -= _window_column;
+    if (row >= _window_rows || column >= _window_columns) {
+        return;
+    }
+    unsigned scale {_decode_options.scale};
+    if (scale == 1 && wide) {
+        store_wide(row, column, wide);
+        return;
+    }
+    if (scale == 1) {
+        _map.at(row, column) = Color{pixel[0], pixel[1], pixel[2],
+                                     (_channels == 4) ? pixel[3] : 255};
+        return;
+    }
+    auto sums = _box_sums.data() + ((row / scale) * _map.columns() + column / scale) * _channels;
+    for (size_t channel {0}; channel < _channels; ++channel) {
+        sums[channel] += pixel[channel];
+    }
+}
+
+void img::PNGImage::store_wide(size_t row, size_t column, const std::uint16_t* samples) {
+    bool gray {sample_size < 3};
+    _map.samples(row, column, {samples[0], samples[gray ? 0 : 1], samples[gray ? 0 : 2],
+                               (sample_size % 2) ? std::uint16_t{65535} :
+                                                   samples[sample_size - 1]});
+}
+
+void img::PNGImage::finish_boxes() {
+    unsigned scale {_decode_options.scale};
+    for (size_t row {0}; row < _map.rows(); ++row) {
+        std::uint32_t box_rows {std::min<std::uint32_t>(scale, _window_rows - row * scale)};
+        for (size_t column {0}; column < _map.columns(); ++column) {
+            std::uint32_t box_columns {std::min<std::uint32_t>(scale,
+                                                               _window_columns - column * scale)};
+            std::uint32_t count {box_rows * box_columns};
+            auto sums = _box_sums.data() + (row * _map.columns() + column) * _channels;
+            auto average = [&](size_t channel) {
+                return static_cast<int>((sums[channel] + count / 2) / count);
+            };
+            _map.at(row, column) = Color{average(0), average(1), average(2),
+                                         (_channels == 4) ? average(3) : 255};
+        }
     }
 }
 
 void img::PNGImage::assemble_8b_truecolor(std::unique_ptr<std::uint8_t[]>& buffer, size_t& size) {
-    size = _map.rows() * (_map.columns() * 3 + 1);
+    size_t rows {_map.rows()}, columns {_map.columns()};
+    size_t stride {columns * 3};
+    size = rows * (stride + 1);
+    buffer = std::make_unique<std::uint8_t[]>(size);
+    auto raw = std::make_unique<std::uint8_t[]>(rows * stride);
+    // rows are processed by bands, jobs of both passes write to disjoint parts of buffers
+    size_t band_rows {std::max<size_t>(_band_size / std::max<size_t>(stride, 1), 1)};
+    size_t bands {(rows + band_rows - 1) / band_rows};
+    // filter of a row needs raw row above it, so all pixels are unpacked first
+    parallel_for(bands, _encode_options.threads, [&](size_t band) {
+        for (size_t row {band * band_rows}; row < std::min(rows, (band + 1) * band_rows); ++row) {
+            auto line = raw.get() + row * stride;
+            for (size_t column {0}; column < columns; ++column) {
+                auto color = _map.color(row, column);
+                line[column * 3] = color.R();
+                line[column * 3 + 1] = color.G();
+                line[column * 3 + 2] = color.B();
+            }
+        }
+    });
+    filter_scanlines(raw.get(), stride, rows, buffer.get(), _encode_options.filter);
+}
+
+bool img::PNGImage::is_grayscale() {
+    size_t columns {_map.columns()};
+    if (_map.format() == PixelFormat::gray) {
+        return true;
+    }
+    if (_map.format() != PixelFormat::rgba) {
+        for (size_t row {0}; row < _map.rows(); ++row) {
+            for (size_t column {0}; column < columns; ++column) {
+                auto samples = _map.samples(row, column);
+                if (samples[0] != samples[1] || samples[1] != samples[2]) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    for (size_t row {0}; columns && row < _map.rows(); ++row) {
+        const Color* pixels {&_map.at(row, 0)};
+        // branchless over the whole row, so that the loop is vectorized
+        Color::data32_t differ {0};
+        for (size_t column {0}; column < columns; ++column) {
+            auto data = pixels[column]._data;
+            differ |= (data ^ (data >> 8)) & 0xFFFF;
+        }
+        if (differ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool img::PNGImage::has_alpha() {
+    size_t columns {_map.columns()};
+    if (_map.format() == PixelFormat::gray) {
+        return false;
+    }
+    if (_map.format() != PixelFormat::rgba) {
+        for (size_t row {0}; row < _map.rows(); ++row) {
+            for (size_t column {0}; column < columns; ++column) {
+                if (_map.samples(row, column)[3] != _map.max_sample()) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+    for (size_t row {0}; columns && row < _map.rows(); ++row) {
+        const Color* pixels {&_map.at(row, 0)};
+        Color::data32_t transparency {0};
+        for (size_t column {0}; column < columns; ++column) {
+            transparency |= pixels[column]._data & Color::alpha;
+        }
+        if (transparency) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void img::PNGImage::assemble_samples(std::unique_ptr<std::uint8_t[]>& buffer, size_t& size) {
+    size_t rows {_map.rows()}, columns {_map.columns()};
+    size_t stride {scanline_size(columns) - 1};
+    size = rows * (stride + 1);
+    buffer = std::make_unique<std::uint8_t[]>(size);
+    auto raw = std::make_unique<std::uint8_t[]>(rows * stride);
+    bool gray {!(color_type & 2)}, alpha {(color_type & 4) != 0};
+    for (size_t row {0}; row < rows; ++row) {
+        auto line = raw.get() + row * stride;
+        for (size_t column {0}; column < columns; ++column) {
+            // samples are RGBA components of 8 or 16 bits, the latter are big-endian
+            std::uint32_t samples[4];
+            if (bit_depth == 16) {
+                auto wide = _map.samples(row, column);
+                std::copy_n(wide.begin(), 4, samples);
+            } else {
+                auto color = _map.color(row, column);
+                samples[0] = color.R();
+                samples[1] = color.G();
+                samples[2] = color.B();
+                samples[3] = color.A();
+            }
+            auto put = [&](std::uint32_t value) {
+                if (bit_depth == 16) {
+                    *line++ = static_cast<std::uint8_t>(value >> 8);
+                }
+                *line++ = static_cast<std::uint8_t>(value);
+            };
+            if (gray) {
+                // ITU-R BT.601 luma, exact for gray pixels
+                put((samples[0] * 299 + samples[1] * 587 + samples[2] * 114 + 500) / 1000);
+            } else {
+                put(samples[0]);
+                put(samples[1]);
+                put(samples[2]);
+            }
+            if (alpha) {
+                put(samples[3]);
+            }
+        }
+    }
+    filter_scanlines(raw.get(), stride, rows, buffer.get(), _encode_options.filter);
+}
+
+bool img::PNGImage::build_palette(std::vector<std::uint8_t>& indices) {
+    // open addressing hash set of colors, its load factor stays below 1/4
+    constexpr size_t table_bits {10};
+    constexpr std::uint32_t empty {0xFFFFFFFF};
+    std::vector<std::uint32_t> keys(1 << table_bits, empty);
+    std::vector<std::uint8_t> values(1 << table_bits);
+    size_t rows {_map.rows()}, columns {_map.columns()};
+    indices.resize(rows * columns);
+    _palette.clear();
+    // runs of the same color are common, so the last one is checked first
+    std::uint32_t last_key {empty};
+    std::uint8_t last_index {0};
+    for (size_t row {0}; row < rows; ++row) {
+        for (size_t column {0}; column < columns; ++column) {
+            auto color = _map.color(row, column);
+            std::uint32_t key {static_cast<std::uint32_t>(color.R() << 16 | color.G() << 8 |
+                                                          color.B())};
+            if (key != last_key) {
+                size_t slot {(key * 2654435761u) >> (32 - table_bits)};
+                while (keys[slot] != empty && keys[slot] != key) {
+                    slot = (slot + 1) & ((1 << table_bits) - 1);
+                }
+                if (keys[slot] == empty) {
+                    if (_palette.size() == 256 * 3) {
+                        _palette.clear();
+                        return false;
+                    }
+                    keys[slot] = key;
+                    values[slot] = _palette.size() / 3;
+                    _palette.insert(_palette.end(), {static_cast<std::uint8_t>(color.R()),
+                                                     static_cast<std::uint8_t>(color.G()),
+                                                     static_cast<std::uint8_t>(color.B())});
+                }
+                last_key = key;
+                last_index = values[slot];
+            }
+            indices[row * columns + column] = last_index;
+        }
+    }
+    return true;
+}
+
+void img::PNGImage::assemble_indexed(const std::vector<std::uint8_t>& indices,
+                                     std::unique_ptr<std::uint8_t[]>& buffer, size_t& size) {
+    size_t rows {_map.rows()}, columns {_map.columns()};
+    size_t stride {scanline_size(columns) - 1};
+    size = rows * (stride + 1);
     buffer = std::make_unique<std::uint8_t[]>(size);
-    std::unique_ptr<std::uint8_t[]> upper {nullptr};
-    for (int row {0}; row < _map.rows(); ++row) {
-        auto line = std::make_unique<std::uint8_t[]>(_map.columns() * 3 + 1);
-        line[0] = 4; // Up filter
-        for (int column {0}; column < _map.columns(); ++column) {
-            auto color = _map.at(row, column);
-            line[1 + column * 3] = color.R();
-            line[1 + column * 3 + 1] = color.G();
-            line[1 + column * 3 + 2] = color.B();
-        }
-        auto temp_buff = std::make_unique<std::uint8_t[]>(_map.columns() * 3 + 1);
-        for (int i {0}; i < _map.columns() * 3 + 1; ++i) {
-            temp_buff[i] = line[i];
-        }
-        apply_paeth(line.get() + 1, (upper) ? upper.get() + 1 : upper.get(), _map.columns() * 3);
-        // apply_sub(line.get() + 1, _map.columns() * 3);
-        upper = std::move(temp_buff);
-        for (size_t i {row * (_map.columns() * 3 + 1)};
-             i < (row + 1) * (_map.columns() * 3 + 1);
-             ++i) {
-            buffer[i] = line[i - row * (_map.columns() * 3 + 1)];
+    // indices are packed from high bits of bytes, the rest of the last byte is zero
+    auto raw = std::make_unique<std::uint8_t[]>(rows * stride);
+    std::fill(raw.get(), raw.get() + rows * stride, 0);
+    unsigned per_byte {8u / bit_depth};
+    for (size_t row {0}; row < rows; ++row) {
+        auto line = raw.get() + row * stride;
+        auto index = indices.data() + row * columns;
+        for (size_t column {0}; column < columns; ++column) {
+            line[column / per_byte] |= index[column] <<
+                                       ((per_byte - 1 - column % per_byte) * bit_depth);
         }
     }
+    // filters rarely pay off for indexed color, so adaptive filtering means none for it
+    auto filter = _encode_options.filter;
+    filter_scanlines(raw.get(), stride, rows, buffer.get(),
+                     (filter == Filter::adaptive) ? Filter::none : filter);
+}
+
+void img::PNGImage::filter_scanlines(const std::uint8_t* raw, size_t stride, size_t rows,
+                                     std::uint8_t* buffer, Filter filter) {
+    size_t band_rows {std::max<size_t>(_band_size / std::max<size_t>(stride, 1), 1)};
+    size_t bands {(rows + band_rows - 1) / band_rows};
+    // rows are processed by bands, jobs write to disjoint parts of buffer
+    parallel_for(bands, _encode_options.threads, [&](size_t band) {
+        // candidate for adaptive filtering, one per band
+        std::vector<std::uint8_t> candidate(filter == Filter::adaptive ? stride : 0);
+        for (size_t row {band * band_rows}; row < std::min(rows, (band + 1) * band_rows); ++row) {
+            auto line = raw + row * stride;
+            auto upper_line = row ? line - stride : nullptr;
+            auto output = buffer + row * (stride + 1);
+            if (filter != Filter::adaptive) {
+                output[0] = static_cast<std::uint8_t>(filter);
+                filter_line(output[0], line, upper_line, output + 1, stride);
+                continue;
+            }
+            // minimum sum of absolute differences
+            output[0] = 0;
+            auto best = filter_line(0, line, upper_line, output + 1, stride);
+            for (int type {1}; type <= 4; ++type) {
+                auto sum = filter_line(type, line, upper_line, candidate.data(), stride);
+                if (sum < best) {
+                    best = sum;
+                    output[0] = type;
+                    std::copy(candidate.begin(), candidate.end(), output + 1);
+                }
+            }
+        }
+    });
 }
@@ -6,87 +6,340 @@
 #include <memory>
 #include <algorithm>
 #include <format>
+#include <charconv>
+#include <span>
 
-void img::PPMImage::read(std::string_view path) {
-    using byte = char;
+size_t img::PPMImage::skip_space(std::span<const char> data, size_t position) {
+    while (position < data.size()) {
+        char symbol {data[position]};
+        if (symbol == '#') {
+            // comment lasts until the end of line
+            while (position < data.size() && data[position] != '\n' && data[position] != '\r') {
+                ++position;
+            }
+        } else if (symbol == ' ' || ('\t' <= symbol && symbol <= '\r')) {
+            ++position;
+        } else {
+            break;
+        }
+    }
+    return position;
+}
 
-    std::ifstream file {path.data(), std::ios::in | std::ios::binary};
-    std::uint_fast32_t height, width, max_color;
-    std::string magic_number {};
+bool img::PPMImage::read_number(std::span<const char> data, size_t& position,
+                                std::uint32_t& value) {
+    auto [end, error] = std::from_chars(data.data() + position, data.data() + data.size(),
+                                        value);
+    if (error != std::errc{}) {
+        return false;
+    }
+    position = end - data.data();
+    return true;
+}
 
+void img::PPMImage::read_pam_header(std::span<const char> data, Header& header) {
+    size_t position {2};
+    // width, height, depth and max color are required
+    bool fields[4] {};
+    while (true) {
+        position = skip_space(data, position);
+        size_t start {position};
+        while (position < data.size() && ('A' <= data[position] && data[position] <= 'Z')) {
+            ++position;
+        }
+        std::string_view name {data.data() + start, position - start};
+        if (name == "ENDHDR") {
+            // data follows the end of line
+            while (position < data.size() && data[position] != '\n') {
+                ++position;
+            }
+            header.data = position + 1;
+            break;
+        }
+        if (name == "TUPLTYPE") {
+            // tuple type is implied by depth
+            while (position < data.size() && data[position] != '\n') {
+                ++position;
+            }
+            continue;
+        }
+        constexpr std::string_view names[4] {"WIDTH", "HEIGHT", "DEPTH", "MAXVAL"};
+        std::uint32_t* values[4] {&header.width, &header.height, &header.depth,
+                                  &header.max_color};
+        auto field = std::find(std::begin(names), std::end(names), name) - std::begin(names);
+        if (field == 4) {
+            throw DecoderError{ErrorType::BadImageData,
+                               std::format("unknown PAM header field <{}>", name)};
+        }
+        position = skip_space(data, position);
+        if (!read_number(data, position, *values[field])) {
+            throw DecoderError{ErrorType::BadImageData,
+                               std::format("PAM header field {} has no value", name)};
+        }
+        fields[field] = true;
+    }
+    if (!fields[0] || !fields[1]) {
+        throw DecoderError{ErrorType::BadImageSize,
+                           std::format("w: {}, h: {}", header.width, header.height)};
+    }
+    if (!fields[2] || !fields[3]) {
+        throw DecoderError{ErrorType::BadImageData, "PAM header has no DEPTH or MAXVAL"};
+    }
+}
+
+img::PPMImage::Header img::PPMImage::read_header(std::span<const char> data) {
+    Header header {};
+    if (data.size() < 2 || data[0] != 'P' || std::string_view{"34567"}.find(data[1]) ==
+                                             std::string_view::npos) {
+        throw DecoderError{ErrorType::BadSignature,
+                           std::string{data.data(), std::min<size_t>(data.size(), 2)}};
+    }
+    header.format = data[1];
+
+    // metadata
+    if (header.format == _arbitrary_magic_number[1]) {
+        read_pam_header(data, header);
+    } else {
+        // PBM has no max color
+        bool bitmap {header.format == _bitmap_magic_number[1]};
+        header.max_color = 1;
+        header.depth = (bitmap || header.format == _gray_magic_number[1]) ? 1 : 3;
+        size_t position {2};
+        bool good {true};
+        for (auto field : {&header.width, &header.height, &header.max_color}) {
+            if (bitmap && field == &header.max_color) {
+                break;
+            }
+            size_t start {position};
+            position = skip_space(data, position);
+            // fields are separated by whitespace
+            good = good && position > start && read_number(data, position, *field);
+        }
+        if (!good) {
+            throw DecoderError{ErrorType::BadImageSize,
+                               std::format("w: {}, h: {}", header.width, header.height)};
+        }
+        // exactly one whitespace character precedes binary data
+        if (position == data.size() || data[position] == '#' ||
+            skip_space(data, position) == position) {
+            throw DecoderError{ErrorType::BadImageData, "no whitespace after header"};
+        }
+        header.data = position + 1;
+    }
+    if (header.width > _size_limit || header.height > _size_limit) {
+        throw DecoderError{ErrorType::BadImageSize,
+                           std::format("w: {}, h: {}", header.width, header.height)};
+    }
+    if (!header.max_color || header.max_color > 255) {
+        throw DecoderError{ErrorType::BadMaxPixelValue, std::to_string(header.max_color)};
+    }
+    if (!header.depth || header.depth > 4) {
+        throw DecoderError{ErrorType::BadImageData,
+                           std::format("{} samples per pixel", header.depth)};
+    }
+    return header;
+}
+
+void img::PPMImage::read_ascii(std::span<const char> data, const Header& header) {
+    size_t position {header.data};
+    for (int row {0}; row < _map.rows(); ++row) {
+        for (int column {0}; column < _map.columns(); ++column) {
+            std::uint32_t sample[3];
+            for (auto& value : sample) {
+                position = skip_space(data, position);
+                if (!read_number(data, position, value) || value > header.max_color) {
+                    throw DecoderError{ErrorType::BadImageData,
+                                       std::format("bad sample at byte {}", position)};
+                }
+            }
+            _map.at(row, column) = Color{static_cast<int>(sample[0]), static_cast<int>(sample[1]),
+                                         static_cast<int>(sample[2])};
+        }
+    }
+}
+
+void img::PPMImage::read(std::string_view path) {
     // first the state of object must be discarded
     _status = false;
     _map.trim(img::Side::bottom, _map.rows());
+    _map.trim(img::Side::right, _map.columns());
     _max_color = 0;
 
-    file >> magic_number >> std::ws;
-    if (magic_number != _binary_magic_number) {
-        throw DecoderError{ErrorType::BadSignature, magic_number};
-    }
+    // whole file is mapped (or read at once) and parsed in place
+    Scanline scline {path, ScanMode::read};
+    auto file = scline.view_all();
+    auto header = read_header(file);
+    std::uint32_t height {header.height}, width {header.width};
+    _max_color = header.max_color;
+    // gray images without alpha take one byte per pixel
+    _map.format((header.depth == 1) ? PixelFormat::gray : PixelFormat::rgba);
 
-    // metadata
-    file >> width >> std::ws;
-    file >> height >> std::ws;
-    file >> max_color >> std::ws;
-    if (!(0 <= width && width <= _size_limit) || !(0 <= height && height <= _size_limit)) {
-        throw DecoderError{ErrorType::BadImageSize, std::format("w: {}, h: {}", width, height)};
-    }
-    if (max_color > 255) {
-        throw DecoderError{ErrorType::BadMaxPixelValue, std::to_string(max_color)};
+    if (header.format == _ascii_magic_number[1]) {
+        _map.expand(Side::bottom, height);
+        _map.expand(Side::right, width);
+        read_ascii(file, header);
+        _status = true;
+        return;
     }
 
-    // actual image data
-    _max_color = max_color;
-    std::unique_ptr<byte[]> buffer = std::make_unique<byte[]>(height * width * 3);
-    file.read(buffer.get(), height * width * 3);
-    if (file.gcount() != height * width * 3) {
+    // actual image data, rows of bitmap are padded to whole bytes
+    bool bitmap {header.format == _bitmap_magic_number[1]};
+    size_t stride {bitmap ? (width + 7) / 8 : static_cast<size_t>(width) * header.depth};
+    size_t size {height * stride};
+    size_t available {file.size() - std::min(file.size(), header.data)};
+    if (available < size) {
         throw DecoderError{ErrorType::BadImageData,
-                           std::format("only {} bytes extracted out of {}",
-                                       file.gcount(),
-                                       height * width * 3)};
+                           std::format("only {} bytes extracted out of {}", available, size)};
     }
 
     _map.expand(Side::bottom, height);
     _map.expand(Side::right, width);
-    std::uint8_t red, green, blue;
-    for (int row {0}; row < height; ++row) {
-        for (int column {0}; column < width; ++column) {
-            red = reinterpret_cast<std::uint8_t&>(buffer[row * width * 3 + column * 3]);
-            green = reinterpret_cast<std::uint8_t&>(buffer[row * width * 3 + column * 3 + 1]);
-            blue = reinterpret_cast<std::uint8_t&>(buffer[row * width * 3 + column * 3 + 2]);
-            _map.at(row, column) = Color{red, green, blue};
+    if (bitmap) {
+        read_bitmap(file, header);
+        _status = true;
+        return;
+    }
+    // gray rows are copied as they are, otherwise gray samples are spread to all components,
+    // the last of even number of samples is alpha
+    auto buffer = reinterpret_cast<const std::uint8_t*>(file.data() + header.data);
+    std::uint32_t depth {header.depth};
+    for (int row {0}; depth == 1 && width && row < height; ++row) {
+        std::copy_n(buffer + row * stride, width, &_map.gray(row, 0));
+    }
+    for (int row {0}; depth > 1 && row < height; ++row) {
+        auto pixel = buffer + row * stride;
+        for (int column {0}; column < width; ++column, pixel += depth) {
+            auto& color = _map.at(row, column);
+            color = (depth < 3) ? Color{pixel[0], pixel[0], pixel[0]} :
+                                  Color{pixel[0], pixel[1], pixel[2]};
+            if (depth % 2 == 0) {
+                color.A(pixel[depth - 1]);
+            }
         }
     }
 
     _status = true;
-    file.close();
 }
 
-void img::PPMImage::write(std::string_view path) {
-    using byte = char;
+void img::PPMImage::read_bitmap(std::span<const char> data, const Header& header) {
+    auto buffer = reinterpret_cast<const std::uint8_t*>(data.data() + header.data);
+    size_t stride {(header.width + 7) / 8};
+    for (int row {0}; row < _map.rows(); ++row) {
+        auto line = buffer + row * stride;
+        for (int column {0}; column < _map.columns(); ++column) {
+            int value {(line[column / 8] >> (7 - column % 8) & 1) ? 0 : 255};
+            _map.gray(row, column) = value;
+        }
+    }
+    // pixels are stored as 8-bit gray
+    _max_color = 255;
+}
+
+int img::PPMImage::luma(Color color) {
+    return (color.R() * 299 + color.G() * 587 + color.B() * 114 + 500) / 1000;
+}
+
+void img::PPMImage::write_samples(std::ofstream& file, std::uint32_t depth) {
+    size_t size {static_cast<size_t>(_map.rows()) * _map.columns() * depth};
+    auto buffer = std::make_unique<std::uint8_t[]>(size);
+    auto sample = buffer.get();
+    bool gray {_map.format() == PixelFormat::gray};
+    for (int row {0}; gray && depth == 1 && _map.columns() && row < _map.rows(); ++row) {
+        sample = std::copy_n(&_map.gray(row, 0), _map.columns(), sample);
+    }
+    for (int row {0}; !(gray && depth == 1) && row < _map.rows(); ++row) {
+        for (int column {0}; column < _map.columns(); ++column) {
+            auto color = _map.color(row, column);
+            if (depth < 3) {
+                *sample++ = luma(color);
+            } else {
+                *sample++ = color.R();
+                *sample++ = color.G();
+                *sample++ = color.B();
+            }
+            if (depth % 2 == 0) {
+                *sample++ = color.A();
+            }
+        }
+    }
+    file.write(reinterpret_cast<const char*>(buffer.get()), size);
+}
 
+void img::PPMImage::write(std::string_view path) {
     _status = false;
 
     std::ofstream file {path.data(), std::ios::out | std::ios::binary};
     file << _binary_magic_number << '\n';
     file << _map.columns() << ' ' << _map.rows() << '\n';
     file << _max_color << '\n';
+    write_samples(file, 3);
+
+    _status = true;
+    file.close();
+}
+
+void img::PGMImage::write(std::string_view path) {
+    _status = false;
+
+    std::ofstream file {path.data(), std::ios::out | std::ios::binary};
+    file << _gray_magic_number << '\n';
+    file << _map.columns() << ' ' << _map.rows() << '\n';
+    file << _max_color << '\n';
+    write_samples(file, 1);
 
-    auto buffer = std::make_unique<byte[]>(_map.rows() * _map.columns() * 3);
+    _status = true;
+    file.close();
+}
+
+void img::PBMImage::write(std::string_view path) {
+    _status = false;
+
+    std::ofstream file {path.data(), std::ios::out | std::ios::binary};
+    file << _bitmap_magic_number << '\n';
+    file << _map.columns() << ' ' << _map.rows() << '\n';
+
+    // rows are padded to whole bytes, 1 is black
+    size_t stride {(static_cast<size_t>(_map.columns()) + 7) / 8};
+    auto buffer = std::make_unique<std::uint8_t[]>(_map.rows() * stride);
+    std::fill_n(buffer.get(), _map.rows() * stride, 0);
+    bool gray {_map.format() == PixelFormat::gray};
     for (int row {0}; row < _map.rows(); ++row) {
+        auto line = buffer.get() + row * stride;
         for (int column {0}; column < _map.columns(); ++column) {
-            auto& color = _map.at(row, column);
-            // needed for reinterpret cast
-            std::uint8_t red = color.R();
-            std::uint8_t green = color.G();
-            std::uint8_t blue = color.B();
-            buffer[row * _map.columns() * 3 + column * 3] = reinterpret_cast<byte&>(red);
-            buffer[row * _map.columns() * 3 + column * 3 + 1] = reinterpret_cast<byte&>(green);
-            buffer[row * _map.columns() * 3 + column * 3 + 2] = reinterpret_cast<byte&>(blue);
+            int value {gray ? _map.gray(row, column) : luma(_map.color(row, column))};
+            if (value * 2 <= _max_color) {
+                line[column / 8] |= 0x80 >> (column % 8);
+            }
+        }
+    }
+    file.write(reinterpret_cast<const char*>(buffer.get()), _map.rows() * stride);
+
+    _status = true;
+    file.close();
+}
+
+void img::PAMImage::write(std::string_view path) {
+    _status = false;
+
+    // map of gray format has neither colors nor alpha
+    bool gray {true}, alpha {false};
+    for (int row {0}; _map.format() != PixelFormat::gray && row < _map.rows(); ++row) {
+        for (int column {0}; column < _map.columns(); ++column) {
+            auto color = _map.color(row, column);
+            gray = gray && color.R() == color.G() && color.G() == color.B();
+            alpha = alpha || color.A() != 255;
         }
     }
+    std::uint32_t depth {(gray ? 1u : 3u) + alpha};
+
+    std::ofstream file {path.data(), std::ios::out | std::ios::binary};
+    file << _arbitrary_magic_number << '\n';
+    file << "WIDTH " << _map.columns() << "\nHEIGHT " << _map.rows() << '\n';
+    file << "DEPTH " << depth << "\nMAXVAL " << _max_color << '\n';
+    file << "TUPLTYPE " << (gray ? "GRAYSCALE" : "RGB") << (alpha ? "_ALPHA" : "") << '\n';
+    file << "ENDHDR\n";
+    write_samples(file, depth);
 
     _status = true;
-    file.write(buffer.get(), _map.rows() * _map.columns() * 3);
     file.close();
 }
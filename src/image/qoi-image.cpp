@@ -0,0 +1,230 @@
+// std headers
+#include "image.hpp"
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <format>
+
+std::uint32_t img::QOIImage::hash(std::uint32_t r, std::uint32_t g, std::uint32_t b,
+                                  std::uint32_t a) {
+    return (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+}
+
+void img::QOIImage::read(std::string_view path) {
+    // first the state of object must be discarded
+    _status = false;
+    _map.trim(Side::bottom, _map.rows());
+    _map.trim(Side::right, _map.columns());
+
+    // whole file is mapped (or read at once) and decoded in place
+    Scanline scline {path, ScanMode::read};
+    auto file = scline.view_all();
+    if (file.size() < _header_size || !Scanline::_cmp_chunks(file.data(), 4, _signature, 4)) {
+        throw DecoderError{ErrorType::BadSignature,
+                           std::string{file.data(), std::min<size_t>(file.size(), 4)}};
+    }
+    std::uint32_t width {Scanline::_load_be32(file.data() + 4)};
+    std::uint32_t height {Scanline::_load_be32(file.data() + 8)};
+    int channels {static_cast<std::uint8_t>(file[12])};
+    int colorspace {static_cast<std::uint8_t>(file[13])};
+    std::uint64_t pixels {static_cast<std::uint64_t>(width) * height};
+    if (!width || !height || pixels > _pixels_limit) {
+        throw DecoderError{ErrorType::BadImageSize, std::format("w: {}, h: {}", width, height)};
+    }
+    if ((channels != 3 && channels != 4) || (colorspace != 0 && colorspace != 1)) {
+        throw DecoderError{ErrorType::BadImageData,
+                           std::format("channels: {}, colorspace: {}", channels, colorspace)};
+    }
+    // operations end before the end marker, every byte of them is at most 62 pixels, so that
+    // map of broken file is never allocated
+    size_t end {file.size() - std::min(file.size(), _header_size + sizeof(_end_marker))};
+    if (pixels > static_cast<std::uint64_t>(end) * 62) {
+        throw DecoderError{ErrorType::BadImageData,
+                           std::format("{} bytes of data for {} pixels", end, pixels)};
+    }
+    auto data = reinterpret_cast<const std::uint8_t*>(file.data() + _header_size);
+
+    _map.format(PixelFormat::rgba);
+    _map.expand(Side::bottom, height);
+    _map.expand(Side::right, width);
+
+    // previous pixel starts opaque black, seen pixels - transparent black
+    std::uint8_t r {0}, g {0}, b {0}, a {255};
+    Color pixel {};
+    Color index[64];
+    std::fill(std::begin(index), std::end(index), Color{0, 0, 0, 0});
+    size_t position {0};
+    unsigned run {0};
+    auto truncated = [&](size_t size) {
+        if (position + size > end) {
+            throw DecoderError{ErrorType::BadImageData,
+                               std::format("data ends at byte {}", _header_size + position)};
+        }
+    };
+    for (std::uint32_t row {0}; row < height; ++row) {
+        Color* line {&_map.at(row, 0)};
+        for (std::uint32_t column {0}; column < width; ++column) {
+            if (run) {
+                --run;
+                line[column] = pixel;
+                continue;
+            }
+            truncated(1);
+            std::uint8_t op {data[position++]};
+            if (op == _op_rgb || op == _op_rgba) {
+                truncated(op == _op_rgb ? 3 : 4);
+                r = data[position];
+                g = data[position + 1];
+                b = data[position + 2];
+                position += 3;
+                if (op == _op_rgba) {
+                    a = data[position++];
+                }
+            } else if ((op & _mask_2) == _op_index) {
+                pixel = index[op];
+                r = pixel._data >> Color::red_shift;
+                g = pixel._data >> Color::green_shift;
+                b = pixel._data;
+                a = 255 - (pixel._data >> Color::alpha_shift);
+                line[column] = pixel;
+                continue;
+            } else if ((op & _mask_2) == _op_diff) {
+                r += ((op >> 4) & 0x03) - 2;
+                g += ((op >> 2) & 0x03) - 2;
+                b += (op & 0x03) - 2;
+            } else if ((op & _mask_2) == _op_luma) {
+                truncated(1);
+                std::uint8_t second {data[position++]};
+                int dg {(op & 0x3f) - 32};
+                r += dg - 8 + (second >> 4);
+                g += dg;
+                b += dg - 8 + (second & 0x0f);
+            } else {
+                // the run includes this pixel
+                run = op & 0x3f;
+                line[column] = pixel;
+                continue;
+            }
+            pixel._data = static_cast<Color::data32_t>(255 - a) << Color::alpha_shift |
+                          static_cast<Color::data32_t>(r) << Color::red_shift |
+                          static_cast<Color::data32_t>(g) << Color::green_shift | b;
+            index[hash(r, g, b, a)] = pixel;
+            line[column] = pixel;
+        }
+    }
+
+    _status = true;
+}
+
+void img::QOIImage::write(std::string_view path) {
+    _status = false;
+
+    size_t rows {_map.rows()}, columns {_map.columns()};
+    // rows of map of other format are converted to colors one by one, the map is kept
+    std::vector<Color> converted;
+    auto colors = [&](size_t row) -> const Color* {
+        if (_map.format() == PixelFormat::rgba) {
+            return &_map.at(row, 0);
+        }
+        converted.resize(columns);
+        for (size_t column {0}; column < columns; ++column) {
+            converted[column] = _map.color(row, column);
+        }
+        return converted.data();
+    };
+    // alpha channel is only a hint for reader, data is the same
+    Color::data32_t transparency {0};
+    for (size_t row {0}; columns && row < rows; ++row) {
+        const Color* line {colors(row)};
+        for (size_t column {0}; column < columns; ++column) {
+            transparency |= line[column]._data & Color::alpha;
+        }
+    }
+
+    // operations are written through small buffer, that is flushed, when the longest one
+    // (RGBA, 5 bytes) may not fit
+    Scanline scline {path.data(), ScanMode::write};
+    std::vector<std::uint8_t> buffer(_buffer_size);
+    std::copy_n(_signature, 4, buffer.begin());
+    Scanline::_store_be32(reinterpret_cast<char*>(buffer.data()) + 4, columns);
+    Scanline::_store_be32(reinterpret_cast<char*>(buffer.data()) + 8, rows);
+    buffer[12] = transparency ? 4 : 3;
+    buffer[13] = 0;
+    auto output = buffer.data() + _header_size;
+    auto flush = [&] {
+        scline.write_bytes(reinterpret_cast<const char*>(buffer.data()), output - buffer.data());
+        output = buffer.data();
+    };
+
+    // packed colors are compared as words, opaque black is zero word
+    Color::data32_t previous {0};
+    Color::data32_t index[64];
+    std::fill(std::begin(index), std::end(index), Color{0, 0, 0, 0}._data);
+    unsigned run {0};
+    for (size_t row {0}; columns && row < rows; ++row) {
+        const Color* line {colors(row)};
+        for (size_t column {0}; column < columns; ++column) {
+            if (buffer.data() + buffer.size() - output < 5) {
+                flush();
+            }
+            Color::data32_t pixel {line[column]._data};
+            if (pixel == previous) {
+                if (++run == 62) {
+                    *output++ = _op_run | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+            if (run) {
+                *output++ = _op_run | (run - 1);
+                run = 0;
+            }
+            std::uint8_t r {static_cast<std::uint8_t>(pixel >> Color::red_shift)};
+            std::uint8_t g {static_cast<std::uint8_t>(pixel >> Color::green_shift)};
+            std::uint8_t b {static_cast<std::uint8_t>(pixel)};
+            std::uint8_t a {static_cast<std::uint8_t>(255 - (pixel >> Color::alpha_shift))};
+            auto position = hash(r, g, b, a);
+            if (index[position] == pixel) {
+                *output++ = _op_index | position;
+                previous = pixel;
+                continue;
+            }
+            index[position] = pixel;
+            if ((pixel ^ previous) & Color::alpha) {
+                *output++ = _op_rgba;
+                *output++ = r;
+                *output++ = g;
+                *output++ = b;
+                *output++ = a;
+                previous = pixel;
+                continue;
+            }
+            // differences wrap around as in decoder
+            auto dr = static_cast<std::int8_t>(r - static_cast<std::uint8_t>(previous >> 16));
+            auto dg = static_cast<std::int8_t>(g - static_cast<std::uint8_t>(previous >> 8));
+            auto db = static_cast<std::int8_t>(b - static_cast<std::uint8_t>(previous));
+            int dr_dg {dr - dg}, db_dg {db - dg};
+            if (-2 <= dr && dr <= 1 && -2 <= dg && dg <= 1 && -2 <= db && db <= 1) {
+                *output++ = _op_diff | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);
+            } else if (-32 <= dg && dg <= 31 && -8 <= dr_dg && dr_dg <= 7 &&
+                       -8 <= db_dg && db_dg <= 7) {
+                *output++ = _op_luma | (dg + 32);
+                *output++ = (dr_dg + 8) << 4 | (db_dg + 8);
+            } else {
+                *output++ = _op_rgb;
+                *output++ = r;
+                *output++ = g;
+                *output++ = b;
+            }
+            previous = pixel;
+        }
+    }
+    if (run) {
+        *output++ = _op_run | (run - 1);
+    }
+    flush();
+    scline.write_bytes(_end_marker, sizeof(_end_marker));
+    _status = true;
+}
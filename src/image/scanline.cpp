@@ -8,13 +8,32 @@
 #include <cmath>
 #include <cassert>
 #include <string_view>
+#include <cstring>
+#include <bit>
+#include <vector>
+
+// memory mapping
+#if __has_include(<sys/mman.h>)
+#define GGPEG_HAS_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
-std::unique_ptr<std::uint32_t[]> img::Image::Scanline::_crc_lookup_table {nullptr};
 char& img::Image::Scanline::operator[](size_t index) { return _buffer[index]; }
 size_t img::Image::Scanline::size() { return _buffer_size; }
-img::Image::Scanline::~Scanline() { _str.close(); }
+img::Image::Scanline::~Scanline() {
+#ifdef GGPEG_HAS_MMAP
+    if (_mapping) {
+        munmap(_mapping, _mapping_size);
+    }
+#endif
+    _str.close();
+}
 img::Image::Scanline::Scanline(std::string_view path, img::Image::ScanMode mode) {
     _mode = mode;
+    _path = path;
     if (_mode == img::Image::ScanMode::read) {
         _str.open(path.data(), std::ios::binary | std::ios::in);
     } else {
@@ -77,6 +96,42 @@ void img::Image::Scanline::call_read(size_t number) {
     }
 }
 
+void img::Image::Scanline::read_all(std::vector<char>& dest) {
+    assert(_mode == img::Image::ScanMode::read);
+    auto start = _str.tellg();
+    _str.seekg(0, std::ios::end);
+    auto end = _str.tellg();
+    _str.seekg(start);
+    dest.resize((start >= 0 && end > start) ? static_cast<size_t>(end - start) : 0);
+    _str.read(dest.data(), dest.size());
+    dest.resize(_str.gcount());
+}
+
+std::span<const char> img::Image::Scanline::view_all() {
+    assert(_mode == img::Image::ScanMode::read);
+#ifdef GGPEG_HAS_MMAP
+    if (!_mapping) {
+        int descriptor {open(_path.c_str(), O_RDONLY)};
+        struct stat status {};
+        if (descriptor >= 0 && !fstat(descriptor, &status) && status.st_size > 0) {
+            auto mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (mapping != MAP_FAILED) {
+                _mapping = mapping;
+                _mapping_size = status.st_size;
+            }
+        }
+        if (descriptor >= 0) {
+            close(descriptor);
+        }
+    }
+    if (_mapping) {
+        return {static_cast<const char*>(_mapping), _mapping_size};
+    }
+#endif
+    read_all(_file_data);
+    return _file_data;
+}
+
 void img::Image::Scanline::call_write(size_t number) {
     assert(_mode == img::Image::ScanMode::write);
     auto buff = get_chunk(0, number);
@@ -84,6 +139,30 @@ void img::Image::Scanline::call_write(size_t number) {
     reset_buffer(number);
 }
 
+void img::Image::Scanline::write_bytes(const char* data, size_t size) {
+    assert(_mode == img::Image::ScanMode::write);
+    _str.write(data, size);
+}
+
+void img::Image::Scanline::begin_chunk(const char* type, std::uint32_t size) {
+    char header[8];
+    _store_be32(header, size);
+    std::copy(type, type + 4, header + 4);
+    write_bytes(header, 8);
+    _chunk_crc = _crc_update(0xFFFFFFFF, type, 4);
+}
+
+void img::Image::Scanline::write_chunk_data(const char* data, size_t size) {
+    _chunk_crc = _crc_update(_chunk_crc, data, size);
+    write_bytes(data, size);
+}
+
+void img::Image::Scanline::end_chunk() {
+    char crc[4];
+    _store_be32(crc, _chunk_crc ^ 0xFFFFFFFF);
+    write_bytes(crc, 4);
+}
+
 bool img::Image::Scanline::_cmp_chunks(const char* chunk_1, size_t size_1,
                                        const char* chunk_2, size_t size_2) {
     if (size_1 != size_2) {
@@ -97,45 +176,39 @@ bool img::Image::Scanline::_cmp_chunks(const char* chunk_1, size_t size_1,
 }
 
 std::uint64_t img::Image::Scanline::_parse_chunk(char* bytes, size_t size) {
-    std::uint8_t mask {0x80}, curr_byte {};
-    size_t iter {0};
     std::uint64_t result {};
-    int signed_size = size * 8;
-
-    while (signed_size > 0) {
-        curr_byte = reinterpret_cast<std::uint8_t&>(*(bytes + iter++));
-        while (mask > 0) {
-            result += (curr_byte & mask) << std::max(signed_size - 8, 0);
-            mask >>= 1;
-        }
-        signed_size -= 8;
-        mask = 0x80;
+    for (size_t i {0}; i < size; ++i) {
+        result = (result << 8) | static_cast<std::uint8_t>(bytes[i]);
     }
     return result;
 }
 
 std::uint32_t img::Image::Scanline::_crc(const char* buffer, size_t size) {
-    if (!_crc_lookup_table) {
-        _crc_lookup_table = std::make_unique<std::uint32_t[]>(256);
-        std::uint32_t curr;
-        int n, k;
-        for (n = 0; n < 256; n++) {
-            curr = static_cast<std::uint32_t>(n);
-            for (k = 0; k < 8; k++) {
-                if (curr & 1)
-                    curr = 0xedb88320L ^ (curr >> 1);
-                else
-                    curr = curr >> 1;
-            }
-            _crc_lookup_table[n] = curr;
-        }
+    return _crc_update(0xFFFFFFFFL, buffer, size) ^ 0xffffffffL;
+}
+
+std::uint32_t img::Image::Scanline::_crc_update(std::uint32_t crc, const char* buffer,
+                                                size_t size) {
+    for (size_t n {0}; n < size; n++) {
+        crc = _crc_lookup_table[(crc ^ buffer[n]) & 0xff] ^ (crc >> 8);
     }
-    std::uint32_t curr {0xFFFFFFFFL};
-    int n;
-    for (n = 0; n < size; n++) {
-        curr = _crc_lookup_table[(curr ^ buffer[n]) & 0xff] ^ (curr >> 8);
+    return crc;
+}
+
+void img::Image::Scanline::_store_be32(char* dest, std::uint32_t value) {
+    dest[0] = static_cast<char>(value >> 24);
+    dest[1] = static_cast<char>(value >> 16);
+    dest[2] = static_cast<char>(value >> 8);
+    dest[3] = static_cast<char>(value);
+}
+
+std::uint32_t img::Image::Scanline::_load_be32(const char* bytes) {
+    std::uint32_t value;
+    std::memcpy(&value, bytes, 4);
+    if constexpr (std::endian::native == std::endian::little) {
+        value = __builtin_bswap32(value);
     }
-    return curr ^ 0xffffffffL;
+    return value;
 }
 
 void img::Image::Scanline::_extr_chunk(char*& buffer, char* chunk, size_t size) {
@@ -3,6 +3,11 @@
 #include <vector>
 #include <stdexcept>
 #include <format>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <algorithm>
 
 // Local headers.
 #include <clp-parser/clp-parser.hpp>
@@ -11,10 +16,81 @@
 
 
 
+// Window of image, that is left by crop with margins in percents (same rounding as
+// proc::crop). Returns false if crop leaves nothing or margins are out of range.
+bool crop_region(const img::ImageInfo& info, const std::vector<std::string>& tp_param,
+                 img::PNGImage::Region& region)
+{
+    double left_margin{std::stod(tp_param[0])};
+    double top_margin{std::stod(tp_param[1])};
+    double right_margin{std::stod(tp_param[2])};
+    double bottom_margin{std::stod(tp_param[3])};
+    long left = std::lround(left_margin / 100 * info.width);
+    long right = std::lround(right_margin / 100 * info.width);
+    long top = std::lround(top_margin / 100 * info.height);
+    long bottom = std::lround(bottom_margin / 100 * info.height);
+    if (left < 0 || right < 0 || top < 0 || bottom < 0 ||
+        left + right >= info.width || top + bottom >= info.height)
+    {
+        return false;
+    }
+    region = {static_cast<std::uint32_t>(top), static_cast<std::uint32_t>(left),
+              static_cast<std::uint32_t>(info.height - top - bottom),
+              static_cast<std::uint32_t>(info.width - left - right)};
+    return true;
+}
+
+// Extension of files of format (also the name of format for convert_to).
+std::string extension(img::ImageType file_format)
+{
+    switch (file_format)
+    {
+    case img::ImageType::PNG:
+        return "png";
+    case img::ImageType::PGM:
+        return "pgm";
+    case img::ImageType::PBM:
+        return "pbm";
+    case img::ImageType::PAM:
+        return "pam";
+    case img::ImageType::QOI:
+        return "qoi";
+    default:
+        return "ppm";
+    }
+}
+
+// Whether commands of chain leave pixels and encoding of image in format as they are (only
+// information is printed or image is converted to its own format).
+bool keeps_image(std::queue<clpp::Command> queue_of_command, img::ImageType file_format)
+{
+    const std::string own_format{extension(file_format)};
+    for (; !queue_of_command.empty(); queue_of_command.pop())
+    {
+        auto& command = queue_of_command.front();
+        switch (command.get_command())
+        {
+        case clpp::CommandType::version:
+        case clpp::CommandType::help:
+            break;
+        case clpp::CommandType::convert_to:
+            if (command.get_param()[0] != own_format)
+            {
+                return false;
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
 void img_processing(img::Image& main_image,
                     clpp::CommandType tp_command_type,
                     std::vector<std::string>& tp_param,
-                    img::ImageType& file_format)
+                    img::ImageType& file_format,
+                    std::optional<img::PNGImage::EncodeOptions>& preset)
 {
     switch(tp_command_type)
     {
@@ -57,15 +133,8 @@ void img_processing(img::Image& main_image,
         double x_ins{std::stod(tp_param[0])};
         double y_ins{std::stod(tp_param[1])};
         std::string new_img{tp_param[2]};
-        auto type = img::get_type(new_img);
-        img::Image* ins_image;
-        if (type == img::ImageType::PNG) {
-            static img::PNGImage tp_new_image;
-            ins_image = &tp_new_image;
-        } else if (type == img::ImageType::PPM) {
-            static img::PPMImage tp_new_image;
-            ins_image = &tp_new_image;
-        } else {
+        auto ins_image = img::make_image(img::get_type(new_img));
+        if (!ins_image) {
             throw std::runtime_error("File does not exist or has unsupported type");
         }
         ins_image->read(new_img);
@@ -75,19 +144,17 @@ void img_processing(img::Image& main_image,
     }
     case clpp::CommandType::convert_to:
     {
+        // pixels are written in the new format at the end of chain
         std::string new_format{tp_param[0]};
-        if (new_format == "ppm")
-        {
-            main_image = img::convert(main_image, img::ImageType::PPM);
-            file_format = img::ImageType::PPM;
-        }
-        else if (new_format == "png")
+        auto formats = {img::ImageType::PPM, img::ImageType::PNG, img::ImageType::PGM,
+                        img::ImageType::PBM, img::ImageType::PAM, img::ImageType::QOI};
+        auto format = std::find_if(formats.begin(), formats.end(), [&](img::ImageType type)
+                                   { return extension(type) == new_format; });
+        if (format == formats.end())
         {
-            main_image = img::convert(main_image, img::ImageType::PNG);
-            file_format = img::ImageType::PNG;
-        } else {
             throw std::runtime_error(std::format("Unsupported file format: {}", new_format));
         }
+        file_format = *format;
         
         break;
     }
@@ -105,6 +172,17 @@ void img_processing(img::Image& main_image,
         break;
     }
 
+    case clpp::CommandType::fast:
+    case clpp::CommandType::small:
+    {
+        // preset is applied to the image, that is written at the end of chain, so it
+        // works with conversion to PNG; other formats ignore it
+        preset = (tp_command_type == clpp::CommandType::fast) ?
+                 img::PNGImage::EncodeOptions::fast() : img::PNGImage::EncodeOptions::small();
+
+        break;
+    }
+
     case clpp::CommandType::version:
         clpp::version();
         
@@ -162,22 +240,50 @@ int main(int argc, char** argv)
         auto file_format = img::get_type(clpp::global_Path);
         img::Image* main_image;
 
-        if (file_format == img::ImageType::PPM)
+        // image, that is not changed by commands, is copied as is without decoding, if its
+        // header and structure are valid (broken one fails to decode as before)
+        if (file_format != img::ImageType::Unknown &&
+            img::probe(clpp::global_Path).type == file_format &&
+            keeps_image(queue_of_command, file_format) && img::verify(clpp::global_Path))
         {
-            static img::PPMImage tp_image;
-            tp_image.read(clpp::global_Path);
-            main_image = &tp_image;
+            for (; !queue_of_command.empty(); queue_of_command.pop())
+            {
+                if (queue_of_command.front().get_command() == clpp::CommandType::version)
+                {
+                    clpp::version();
+                }
+                else if (queue_of_command.front().get_command() == clpp::CommandType::help)
+                {
+                    clpp::help();
+                }
+            }
+            img::copy_file(clpp::global_Path, std::format("target.{}", extension(file_format)));
+            return 0;
         }
-        else if (file_format == img::ImageType::PNG)
+
+        auto image = img::make_image(file_format);
+        if (!image)
         {
-            static img::PNGImage tp_image;
-            tp_image.read(clpp::global_Path);
-            main_image = &tp_image;
+            throw std::runtime_error("File does not exist or is unsupported");
         }
-        else
+        auto png_image = dynamic_cast<img::PNGImage*>(image.get());
+        // leading crop is done by PNG decoder, so rows below the window are not inflated
+        // and pixels outside of it are not stored
+        if (png_image && !queue_of_command.empty() &&
+            queue_of_command.front().get_command() == clpp::CommandType::crop)
         {
-            throw std::runtime_error("File does not exist or is unsupported");
+            auto options = png_image->decode_options();
+            if (crop_region(img::probe(clpp::global_Path),
+                            queue_of_command.front().get_param(), options.region))
+            {
+                png_image->decode_options(options);
+                queue_of_command.pop();
+            }
         }
+        image->read(clpp::global_Path);
+        main_image = image.get();
+        const auto source_format = file_format;
+        std::optional<img::PNGImage::EncodeOptions> preset;
 
         while(!queue_of_command.empty())
         {
@@ -186,13 +292,23 @@ int main(int argc, char** argv)
             std::vector<std::string> tp_param = tp_command.get_param();
             
            
-            img_processing(*main_image, tp_command_type, tp_param, file_format);
+            img_processing(*main_image, tp_command_type, tp_param, file_format, preset);
             
             queue_of_command.pop();
         }
-        const std::string new_path{std::format("target.{}", (file_format ==
-                                                             img::ImageType::PNG) ? "png" : "ppm")};
-        main_image->write(new_path);   
+        const std::string new_path{std::format("target.{}", extension(file_format))};
+        // image converted by the chain is written by encoder of the new format
+        if (file_format != source_format)
+        {
+            image = img::convert(*main_image, file_format);
+            main_image = image.get();
+        }
+        auto png_output = dynamic_cast<img::PNGImage*>(main_image);
+        if (preset && png_output)
+        {
+            png_output->encode_options(*preset);
+        }
+        main_image->write(new_path);
     }
     catch(const std::exception& e)
     {
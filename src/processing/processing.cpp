@@ -12,13 +12,16 @@ void proc::negative(img::Image &img){
     img::PixelMap &pixel_map = img.get_map();
     int rows = pixel_map.rows();
     int columns = pixel_map.columns();
+    // samples are inverted at depth of map
+    int max = pixel_map.max_sample();
     for(int i = 0; i < rows; ++i){
         for(int j = 0; j < columns; ++j){
-            auto pixel_color = pixel_map.at(i, j);
-            int r = pixel_color.R();
-            int g = pixel_color.G();
-            int b = pixel_color.B();
-            pixel_map.at(i, j) = img::Color (255 - r, 255 - g, 255 - b);
+            auto samples = pixel_map.samples(i, j);
+            for(int channel = 0; channel < 3; ++channel){
+                samples[channel] = max - samples[channel];
+            }
+            samples[3] = max;
+            pixel_map.samples(i, j, samples);
         }
     }
 }
@@ -42,7 +45,7 @@ void proc::insert(img::Image &img, img::Image &other, int x, int y){
     for(int i = y; i < y + rows_other; ++i){
         for(int j = x; j < x + columns_other; ++j){
             if(i >= 0 && j >= 0 && i < rows && j < columns){
-                pixel_map.at(i, j) = pixel_map_other.at(i - y, j - x);
+                pixel_map.copy(i, j, pixel_map_other, i - y, j - x);
             }
         }
     }
@@ -52,11 +55,11 @@ void proc::reflect_x(img::Image &img){
     img::PixelMap &pixel_map = img.get_map();
     size_t rows = pixel_map.rows();
     size_t columns = pixel_map.columns();
-    img::PixelMap clear_pixel_map(columns, rows);
+    img::PixelMap clear_pixel_map(columns, rows, pixel_map.format());
 
     for(int i = 0; i < rows; ++i){
         for(int j = 0; j < columns; ++j){
-            clear_pixel_map.at(rows - i - 1, j) = pixel_map.at(i, j);
+            clear_pixel_map.copy(rows - i - 1, j, pixel_map, i, j);
         }
     }
 
@@ -67,11 +70,11 @@ void proc::reflect_y(img::Image &img){
     img::PixelMap &pixel_map = img.get_map();
     size_t rows = pixel_map.rows();
     size_t columns = pixel_map.columns();
-    img::PixelMap clear_pixel_map(columns, rows);
+    img::PixelMap clear_pixel_map(columns, rows, pixel_map.format());
 
     for(int i = 0; i < rows; ++i){
         for(int j = 0; j < columns; ++j){
-            clear_pixel_map.at(i, columns - j - 1) = pixel_map.at(i, j);
+            clear_pixel_map.copy(i, columns - j - 1, pixel_map, i, j);
         }
     }
 
@@ -87,7 +90,8 @@ void proc::resize(img::Image &img, double k){
     size_t rows = pixel_map.rows();
     size_t columns = pixel_map.columns();
 
-    img::PixelMap clear_pixel_map(round(columns * k), round(rows * k));
+    img::PixelMap clear_pixel_map(round(columns * k), round(rows * k), pixel_map.format());
+    std::uint16_t max = pixel_map.max_sample();
     size_t clear_rows = clear_pixel_map.rows();
     size_t clear_columns = clear_pixel_map.columns();
 
@@ -131,13 +135,15 @@ void proc::resize(img::Image &img, double k){
             for(int y = start_pixel_y; y <= end_pixel_y; ++y){
                 for(int x = start_pixel_x; x <= end_pixel_x; ++x){
                     ++counter;
-                    auto pixel_color = pixel_map.at(y, x);
-                    R += pixel_color.R();
-                    G += pixel_color.G();
-                    B += pixel_color.B();
+                    auto samples = pixel_map.samples(y, x);
+                    R += samples[0];
+                    G += samples[1];
+                    B += samples[2];
                 }
             }
-            clear_pixel_map.at(i, j) = img::Color (round(R/counter), round(G/counter), round(B/counter));
+            clear_pixel_map.samples(i, j, {static_cast<std::uint16_t>(R/counter),
+                                           static_cast<std::uint16_t>(G/counter),
+                                           static_cast<std::uint16_t>(B/counter), max});
         }
     }
     pixel_map = clear_pixel_map;
@@ -161,28 +167,28 @@ void proc::rotate(img::Image &img, double degrees){
         //well done
     }
     else if(degrees == 90){
-        img::PixelMap clear_pixel_map(rows, columns);
+        img::PixelMap clear_pixel_map(rows, columns, pixel_map.format());
         for(int i = 0; i < rows; ++i){
             for(int j = 0; j < columns; ++j){
-                clear_pixel_map.at(columns - j - 1, i) = pixel_map.at(i, j);
+                clear_pixel_map.copy(columns - j - 1, i, pixel_map, i, j);
             }
         }
         pixel_map = clear_pixel_map;
     }
     else if(degrees == 180){
-        img::PixelMap clear_pixel_map(columns, rows);
+        img::PixelMap clear_pixel_map(columns, rows, pixel_map.format());
         for(int i = 0; i < rows; ++i){
             for(int j = 0; j < columns; ++j){
-                clear_pixel_map.at(rows - i - 1, columns - j - 1) = pixel_map.at(i, j);
+                clear_pixel_map.copy(rows - i - 1, columns - j - 1, pixel_map, i, j);
             }
         }
         pixel_map = clear_pixel_map;
     }
     else if(degrees == 270){
-        img::PixelMap clear_pixel_map(rows, columns);
+        img::PixelMap clear_pixel_map(rows, columns, pixel_map.format());
         for(int i = 0; i < rows; ++i){
             for(int j = 0; j < columns; ++j){
-                clear_pixel_map.at(j, rows - i - 1) = pixel_map.at(i, j);
+                clear_pixel_map.copy(j, rows - i - 1, pixel_map, i, j);
             }
         }
         pixel_map = clear_pixel_map;
@@ -193,7 +199,14 @@ void proc::rotate(img::Image &img, double degrees){
         pixel_map.expand(img::JointSide::left_and_right, (diagonal - columns)/2 + 1, (diagonal - columns)/2 + 1);
         rows = pixel_map.rows();
         columns = pixel_map.columns();
-        img::PixelMap clear_pixel_map(columns, rows);
+        img::PixelMap clear_pixel_map(columns, rows, pixel_map.format());
+        std::uint16_t max = pixel_map.max_sample();
+        // samples of rotated pixel at depth of map
+        auto set_pixel = [&](int i, int j, double R, double G, double B){
+            clear_pixel_map.samples(i, j, {static_cast<std::uint16_t>(R),
+                                           static_cast<std::uint16_t>(G),
+                                           static_cast<std::uint16_t>(B), max});
+        };
         std::vector<std::vector<std::array<double, 4>>> pixels;
         pixels.resize(rows);
         for(int i = 0; i < rows; ++i){
@@ -216,10 +229,10 @@ void proc::rotate(img::Image &img, double degrees){
                 int x_index = new_x;
 
                 if(new_x < columns && new_x >= 0 && new_y < rows && new_y >=0){
-                    auto pixel_color = pixel_map.at(i, j);
-                    int R = pixel_color.R();
-                    int G = pixel_color.G();
-                    int B = pixel_color.B();
+                    auto samples = pixel_map.samples(i, j);
+                    int R = samples[0];
+                    int G = samples[1];
+                    int B = samples[2];
 
                     pixels[y_index][x_index][0] += 1;
                     pixels[y_index][x_index][1] = (pixels[y_index][x_index][1]*(pixels[y_index][x_index][0] - 1) + R)/pixels[y_index][x_index][0];
@@ -235,7 +248,7 @@ void proc::rotate(img::Image &img, double degrees){
                 int G = pixels[i][j][2];
                 int B = pixels[i][j][3];
                 if(pixels[i][j][0] != 0){
-                    clear_pixel_map.at(i, j) = img::Color (round(R), round(G), round(B));
+                    set_pixel(i, j, round(R), round(G), round(B));
                 }
                 else{
                     double sides = 0.0;
@@ -268,7 +281,7 @@ void proc::rotate(img::Image &img, double degrees){
                         ++sides;
                     }
 
-                    clear_pixel_map.at(i, j) = img::Color (round(R/sides), round(G/sides), round(B/sides));
+                    set_pixel(i, j, round(R/sides), round(G/sides), round(B/sides));
                 }
             }
         }
@@ -276,9 +289,9 @@ void proc::rotate(img::Image &img, double degrees){
         int find_color = 0;
         while(find_color == 0){
             for(int i = 0; i < columns; ++i){
-                find_color += clear_pixel_map.at(0, i).R();
-                find_color += clear_pixel_map.at(0, i).G();
-                find_color += clear_pixel_map.at(0, i).B();
+                find_color += clear_pixel_map.samples(0, i)[0];
+                find_color += clear_pixel_map.samples(0, i)[1];
+                find_color += clear_pixel_map.samples(0, i)[2];
             }
             if(find_color == 0){
                 clear_pixel_map.trim(img::Side::top, 1);
@@ -290,9 +303,9 @@ void proc::rotate(img::Image &img, double degrees){
 
         while(find_color == 0){
             for(int i = 0; i < columns; ++i){
-                find_color += clear_pixel_map.at(rows - 1, i).R();
-                find_color += clear_pixel_map.at(rows - 1, i).G();
-                find_color += clear_pixel_map.at(rows - 1, i).B();
+                find_color += clear_pixel_map.samples(rows - 1, i)[0];
+                find_color += clear_pixel_map.samples(rows - 1, i)[1];
+                find_color += clear_pixel_map.samples(rows - 1, i)[2];
             }
             if(find_color == 0){
                 clear_pixel_map.trim(img::Side::bottom, 1);
@@ -304,9 +317,9 @@ void proc::rotate(img::Image &img, double degrees){
 
         while(find_color == 0){
             for(int i = 0; i < rows; ++i){
-                find_color += clear_pixel_map.at(i, 0).R();
-                find_color += clear_pixel_map.at(i, 0).G();
-                find_color += clear_pixel_map.at(i, 0).B();
+                find_color += clear_pixel_map.samples(i, 0)[0];
+                find_color += clear_pixel_map.samples(i, 0)[1];
+                find_color += clear_pixel_map.samples(i, 0)[2];
             }
             if(find_color == 0){
                 clear_pixel_map.trim(img::Side::left, 1);
@@ -318,9 +331,9 @@ void proc::rotate(img::Image &img, double degrees){
 
         while(find_color == 0){
             for(int i = 0; i < rows; ++i){
-                find_color += clear_pixel_map.at(i, columns - 1).R();
-                find_color += clear_pixel_map.at(i, columns - 1).G();
-                find_color += clear_pixel_map.at(i, columns - 1).B();
+                find_color += clear_pixel_map.samples(i, columns - 1)[0];
+                find_color += clear_pixel_map.samples(i, columns - 1)[1];
+                find_color += clear_pixel_map.samples(i, columns - 1)[2];
             }
             if(find_color == 0){
                 clear_pixel_map.trim(img::Side::right, 1);
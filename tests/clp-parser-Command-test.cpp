@@ -85,6 +85,22 @@ TEST_CASE("Class Command return correct type and param of commands", "[command]"
 		CHECK(test_Command.get_command() == clpp::CommandType::help);
 		CHECK(test_Command.get_param() == param_help);
 	}
+	SECTION("fast")
+	{
+		std::string fast{ "fast" }; 
+		std::vector<std::string> param_fast{};
+		clpp::Command test_Command{fast};
+		CHECK(test_Command.get_command() == clpp::CommandType::fast);
+		CHECK(test_Command.get_param() == param_fast);
+	}
+	SECTION("small")
+	{
+		std::string small{ "small" }; 
+		std::vector<std::string> param_small{};
+		clpp::Command test_Command{small};
+		CHECK(test_Command.get_command() == clpp::CommandType::small);
+		CHECK(test_Command.get_param() == param_small);
+	}
 }
 
 TEST_CASE("Class Command return incorrect param of commands", "[command]")
@@ -66,10 +66,10 @@ TEST_CASE("The parser returns correct tokens", "[parser]")
 TEST_CASE("The parser returns correct line of commands", "[parse]")
 {
 	std::vector<std::string> correct_tokens = {"resources/clouds.png", "--crop=45/45/6/2", "--rotate=32", "--resize=0.2", 
-									"--insert=23/23#resources/clouds.png", "--convert_to=ppm", "-nxyvh"};
+									"--insert=23/23#resources/clouds.png", "--convert_to=ppm", "-nxyvh", "--fast", "--small"};
 
 	std::vector<std::string> correct_commands= {"crop=45/45/6/2", "rotate=32", "resize=0.2", "insert=23/23#resources/clouds.png", 
-									"convert_to=ppm", "negative", "reflect_x", "reflect_y", "version", "help"};
+									"convert_to=ppm", "negative", "reflect_x", "reflect_y", "version", "help", "fast", "small"};
 	std::vector<std::string> empty = {""};
 
 	clpp::Parser test_parser{correct_tokens, non_display};
@@ -5,6 +5,12 @@
 #include <iostream>
 #include <iomanip>
 #include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <thread>
+#include <vector>
+#include <string>
 
 #include <zlib.h>
 
@@ -20,74 +26,162 @@ bool check_triple(sc::triplet one, sc::triplet other) {
 
 TEST_CASE("LZ77", "[added]") {
     char buffer[] {"abacabadaba"};
-    constexpr size_t window_size {20};
-    sc::buffer_start = buffer;
-    sc::buffer_end = buffer + sizeof(buffer);
-    auto res = sc::lz77(reinterpret_cast<std::uint8_t*>(buffer), sizeof(buffer), window_size);
+    constexpr size_t window_size {32};
+    auto bytes = reinterpret_cast<std::uint8_t*>(buffer);
+    std::vector<sc::triplet> res;
+    sc::lz77(bytes, sizeof(buffer), window_size, sc::level_params[6], res);
     // Since it is required that length of match must be at least 3, result should be:
     // (a, 0, 0) - just symbol a
     // (b, 0, 0) - just symbol b
     // (a, 0, 0) - just symbol a (does not satisfy the condition)
     // (c, 0, 0) - just symbol c
-    // (d, 3, 4) - return by 4 and copy 3 symbols + symbol d
-    // (0, 3, 8) - return by 8 and copy 3 symbols + nothing (special code)
+    // (0, 4, 3) - return by 4 and copy 3 symbols
+    // (d, 0, 0) - just symbol d
+    // (0, 4, 3) - return by 4 (the most recent match) and copy 3 symbols
+    // (0, 0, 0) - terminating zero of the string
+    REQUIRE(res.size() == 8);
     bool check {true};
     auto iter = res.begin();
     check &= check_triple(*(iter++), {'a', 0, 0});
     check &= check_triple(*(iter++), {'b', 0, 0});
     check &= check_triple(*(iter++), {'a', 0, 0});
     check &= check_triple(*(iter++), {'c', 0, 0});
-    check &= check_triple(*(iter++), {'d', 4, 3});
-    check &= check_triple(*(iter++), {0, 8, 3});
+    check &= check_triple(*(iter++), {0, 4, 3});
+    check &= check_triple(*(iter++), {'d', 0, 0});
+    check &= check_triple(*(iter++), {0, 4, 3});
+    check &= check_triple(*(iter++), {0, 0, 0});
     REQUIRE(check);
 }
 
-TEST_CASE("Appending bits to the end of bitset", "[added]") {
-    std::bitset<sc::block_size * 128> bits {};
-    int pos {0};
-    sc::add_bits(bits, 0xF, pos, 4);
-    sc::add_bits(bits, 0xF0, pos, 8);
-    bool check {true};
-    CHECK(pos == 12);
-    for (int i {0}; i < pos - 4; ++i) {
-        check &= bits[i];
-    }
-    for (int i {pos - 4}; i < pos; ++i) {
-        check &= !bits[i];
-    }
-    sc::add_bits(bits, 0xF, pos, 4);
-    CHECK(pos == 16);
-    for (int i {pos - 4}; i < pos; ++i) {
-        check &= bits[i];
-    }
-    sc::add_bits(bits, 0x9, pos, 4);
-    check &= bits[pos - 4];
-    check &= !bits[pos - 3];
-    check &= !bits[pos - 2];
-    check &= bits[pos - 1];
-    REQUIRE(check);
+TEST_CASE("LZ77 lazy matching and chain limit", "[added]") {
+    // greedy parsing takes "abc" at position 9, lazy one emits 'a' and takes "bcde"
+    char lazy_buffer[] {"abcXbcdeYabcde"};
+    auto bytes = reinterpret_cast<std::uint8_t*>(lazy_buffer);
+    std::vector<sc::triplet> res;
+    sc::lz77(bytes, sizeof(lazy_buffer) - 1, 32, sc::level_params[9], res);
+    REQUIRE(res.size() == 11);
+    auto iter = res.begin();
+    std::advance(iter, 9);
+    CHECK(check_triple(*(iter++), {'a', 0, 0}));
+    CHECK(check_triple(*(iter++), {0, 6, 4}));
+    // with chain of length 1 only the most recent occurrence is checked
+    char chain_buffer[] {"abcdefabcxyzabc"};
+    bytes = reinterpret_cast<std::uint8_t*>(chain_buffer);
+    sc::match_params one_step {258, 258, 258, 1};
+    // buffer is reused
+    sc::lz77(bytes, sizeof(chain_buffer) - 1, 32, one_step, res);
+    REQUIRE(res.size() == 11);
+    CHECK(check_triple(res.back(), {0, 6, 3}));
+}
+
+TEST_CASE("LZ77 in batches", "[added]") {
+    // text with short repetitions and noise, lazy matching state crosses batch boundaries
+    std::vector<std::uint8_t> input(100000);
+    std::uint32_t state {1};
+    for (size_t i {0}; i < input.size(); ++i) {
+        state = state * 1103515245 + 12345;
+        input[i] = (i % 3000 < 1500) ? "abcde"[(state >> 16) % 5] : state >> 16;
+    }
+    std::vector<sc::triplet> whole;
+    sc::lz77(input.data(), input.size(), sc::window_size, sc::level_params[6], whole);
+    for (size_t limit : {size_t{1}, size_t{7}, sc::batch_tokens}) {
+        sc::lz77_state progress;
+        sc::lz77_reset(progress, sc::window_size);
+        std::vector<sc::triplet> batches, batch;
+        bool done {false}, bounded {true};
+        while (!done) {
+            batch.clear();
+            done = sc::lz77_run(progress, input.data(), input.size(), sc::window_size,
+                                sc::level_params[6], batch, limit);
+            bounded &= batch.size() <= limit;
+            batches.insert(batches.end(), batch.begin(), batch.end());
+        }
+        CHECK(bounded);
+        REQUIRE(batches.size() == whole.size());
+        CHECK(std::equal(whole.begin(), whole.end(), batches.begin(), check_triple));
+    }
+
+    // deflate output is made of several batches, its buffers do not grow with input
+    std::vector<std::uint8_t> large(sc::batch_tokens * 8);
+    for (auto& byte : large) {
+        state = state * 1103515245 + 12345;
+        byte = state >> 16;
+    }
+    std::vector<char> output(large.size() * 2);
+    int size_out {static_cast<int>(output.size())};
+    REQUIRE(sc::deflate(output.data(), size_out, reinterpret_cast<char*>(large.data()),
+                        large.size()) == 0);
+    std::vector<std::uint8_t> result(large.size());
+    unsigned long result_len {result.size()};
+    REQUIRE(uncompress(result.data(), &result_len,
+                       reinterpret_cast<std::uint8_t*>(output.data()), size_out) == Z_OK);
+    REQUIRE(result == large);
+}
+
+TEST_CASE("Writing bit stream", "[added]") {
+    char buffer[16] {};
+    sc::bit_writer writer {buffer, sizeof(buffer), 1};
+    // least significant bits go first
+    writer.put(0b101, 3);
+    writer.put(0b11110, 5);
+    writer.put(0xABCDEF, 24);
+    writer.put(0x1, 1);
+    writer.align();
+    CHECK(!writer.overflow());
+    REQUIRE(writer.position() == 6);
+    CHECK(static_cast<std::uint8_t>(buffer[1]) == 0b11110101);
+    CHECK(static_cast<std::uint8_t>(buffer[2]) == 0xEF);
+    CHECK(static_cast<std::uint8_t>(buffer[3]) == 0xCD);
+    CHECK(static_cast<std::uint8_t>(buffer[4]) == 0xAB);
+    CHECK(static_cast<std::uint8_t>(buffer[5]) == 0x1);
+    writer.copy("0123456789", 10);
+    CHECK(!writer.overflow());
+    REQUIRE(writer.position() == 16);
+    CHECK(buffer[15] == '9');
+    writer.put(0xFF, 8);
+    writer.align();
+    CHECK(writer.overflow());
+}
+
+TEST_CASE("Canonical Huffman codes", "[added]") {
+    // example from RFC 1951, 3.2.2: lengths (3, 3, 3, 3, 3, 2, 4, 4)
+    std::uint8_t lengths[] {3, 3, 3, 3, 3, 2, 4, 4};
+    std::uint32_t codes[8];
+    sc::huffman_codes(lengths, 8, codes);
+    // codes are bit-reversed: 010 -> 010, 011 -> 110, 00 -> 00, 1110 -> 0111
+    CHECK(codes[0] == 0b010);
+    CHECK(codes[1] == 0b110);
+    CHECK(codes[5] == 0b00);
+    CHECK(codes[6] == 0b0111);
+    CHECK(codes[7] == 0b1111);
 }
 
 TEST_CASE("Matching length to static Huffman code", "[added]") {
     int initial_length {20}, bit_len;
     CHECK((sc::match_length(initial_length, bit_len) & 0x1FF) == 269);
     CHECK(bit_len == 2);
-    CHECK((sc::match_length(initial_length, bit_len) >> 9) == 2);
+    CHECK((sc::match_length(initial_length, bit_len) >> 9) == 1);
     initial_length = 200;
     CHECK((sc::match_length(initial_length, bit_len) & 0x1FF) == 283);
     CHECK(bit_len == 5);
-    CHECK((sc::match_length(initial_length, bit_len) >> 9) == 20);
+    CHECK((sc::match_length(initial_length, bit_len) >> 9) == 5);
+    initial_length = 258;
+    CHECK((sc::match_length(initial_length, bit_len) & 0x1FF) == 285);
+    CHECK(bit_len == 0);
 }
 
 TEST_CASE("Matching offset to static Huffman code", "[added]") {
     int initial_offset {11}, bit_len;
     CHECK((sc::match_offset(initial_offset, bit_len) & 0x1F) == 6);
     CHECK(bit_len == 2);
-    CHECK((sc::match_offset(initial_offset, bit_len) >> 5) == 1);
+    CHECK((sc::match_offset(initial_offset, bit_len) >> 5) == 2);
     initial_offset = 2060;
     CHECK((sc::match_offset(initial_offset, bit_len) & 0x1F) == 22);
     CHECK(bit_len == 10);
-    CHECK((sc::match_offset(initial_offset, bit_len) >> 5) == 832);
+    CHECK((sc::match_offset(initial_offset, bit_len) >> 5) == 11);
+    initial_offset = 32768;
+    CHECK((sc::match_offset(initial_offset, bit_len) & 0x1F) == 29);
+    CHECK(bit_len == 13);
 }
 
 TEST_CASE("Deflate compression", "[added]") {
@@ -115,13 +209,356 @@ TEST_CASE("Deflate compression", "[added]") {
                                 54, 255, 255,
                                 153, 0, 255};
     int size_in {sizeof(array_in)};
-    int size_out = {static_cast<int>(std::ceil(1.1 * size_in))};
-    auto array_out = std::make_unique<char[]>(static_cast<int>(std::ceil(1.1 * size_in)));
-    sc::deflate(array_out.get(), size_out, reinterpret_cast<char*>(array_in), sizeof(array_in));
+    // fixed Huffman codes take up to 9 bits per literal
+    int size_out = {static_cast<int>(std::ceil(1.2 * size_in)) + 16};
+    auto array_out = std::make_unique<char[]>(size_out);
+    REQUIRE(sc::deflate(array_out.get(), size_out, reinterpret_cast<char*>(array_in),
+                        sizeof(array_in)) == 0);
+    // output that does not fit is reported
+    int small_size {size_in / 2};
+    auto small_out = std::make_unique<char[]>(small_size);
+    CHECK(sc::deflate(small_out.get(), small_size, reinterpret_cast<char*>(array_in),
+                      sizeof(array_in)) != 0);
 
-    auto new_buff = std::make_unique<std::uint8_t[]>(static_cast<int>(std::ceil(1.1 * size_out)));
     unsigned long buff_len {static_cast<unsigned long>(std::ceil(1.1 * size_in))};
+    auto new_buff = std::make_unique<std::uint8_t[]>(buff_len);
     auto res = uncompress(new_buff.get(), &buff_len,
                           reinterpret_cast<std::uint8_t*>(array_out.get()), size_out);
     REQUIRE(!res);
 }
+
+// Run under -DGGPEG_SANITIZE=thread to prove that compressions do not share mutable state.
+TEST_CASE("Concurrent deflate compression", "[added]") {
+    constexpr int size_in {2048};
+    constexpr int workers_count {4};
+    std::vector<std::uint8_t> input(size_in);
+    for (int i {0}; i < size_in; ++i) {
+        input[i] = static_cast<std::uint8_t>((i * i) % 251);
+    }
+    std::vector<char> expected(size_in * 2);
+    int expected_size {static_cast<int>(expected.size())};
+    sc::deflate(expected.data(), expected_size, reinterpret_cast<char*>(input.data()), size_in);
+
+    std::vector<std::vector<char>> outputs(workers_count, std::vector<char>(size_in * 2));
+    std::vector<int> sizes(workers_count);
+    std::vector<std::thread> workers;
+    for (int w {0}; w < workers_count; ++w) {
+        workers.emplace_back([&, w] {
+            auto data = input;
+            sizes[w] = outputs[w].size();
+            sc::deflate(outputs[w].data(), sizes[w], reinterpret_cast<char*>(data.data()), size_in);
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (int w {0}; w < workers_count; ++w) {
+        REQUIRE(sizes[w] == expected_size);
+        REQUIRE(std::equal(expected.begin(), expected.begin() + expected_size, outputs[w].begin()));
+    }
+}
+
+TEST_CASE("Parallel deflate compression", "[added]") {
+    const size_t sizes[] {0, 1000, sc::parallel_block_size, 3 * sc::parallel_block_size + 12345};
+    for (auto size_in : sizes) {
+        std::vector<std::uint8_t> input(size_in);
+        for (size_t i {0}; i < size_in; ++i) {
+            // repeated pattern with noise, so that matches cross block boundaries
+            input[i] = static_cast<std::uint8_t>((i % 1021) ^ ((i * 7919) >> 13));
+        }
+        std::vector<std::uint8_t> single, multiple;
+        REQUIRE(sc::parallel_deflate(single, input.data(), size_in, 1, {}) == Z_OK);
+        REQUIRE(sc::parallel_deflate(multiple, input.data(), size_in, 4, {}) == Z_OK);
+        // output does not depend on number of threads
+        REQUIRE(single == multiple);
+
+        std::vector<std::uint8_t> result(size_in + 1);
+        unsigned long result_len {result.size()};
+        REQUIRE(uncompress(result.data(), &result_len, multiple.data(), multiple.size()) == Z_OK);
+        REQUIRE(result_len == size_in);
+        result.resize(result_len);
+        REQUIRE(result == input);
+    }
+}
+
+TEST_CASE("Deflate compression for every level", "[added]") {
+    constexpr int size_in {200000};
+    std::vector<std::uint8_t> input(size_in);
+    for (int i {0}; i < size_in; ++i) {
+        // runs, repetitions with long distance and noise
+        input[i] = static_cast<std::uint8_t>((i / 300) % 2 ? (i % 700) * 13 : (i * i) >> 7);
+    }
+    for (int level {0}; level <= 9; ++level) {
+        std::vector<char> output(size_in * 2);
+        int size_out {static_cast<int>(output.size())};
+        REQUIRE(sc::deflate(output.data(), size_out, reinterpret_cast<char*>(input.data()),
+                            size_in, level) == 0);
+        std::vector<std::uint8_t> result(size_in);
+        unsigned long result_len {size_in};
+        auto res = uncompress(result.data(), &result_len,
+                              reinterpret_cast<std::uint8_t*>(output.data()), size_out);
+        REQUIRE(res == Z_OK);
+        REQUIRE(result == input);
+        if (level == 0) {
+            // level 0 only stores data: header, LEN/NLEN of every 65535 byte block, checksum
+            CHECK(size_out == 2 + size_in + 5 * ((size_in + 65534) / 65535) + 4);
+            CHECK((output[2] & 0b110) == 0);
+        }
+    }
+}
+
+TEST_CASE("Length-limited Huffman codes", "[added]") {
+    // fibonacci frequencies give the deepest possible tree, lengths must be limited
+    std::uint32_t freq[sc::litlen_symbols] {};
+    std::uint32_t a {1}, b {1};
+    for (int s {0}; s < 30; ++s) {
+        freq[s] = a;
+        b = a + b;
+        a = b - a;
+    }
+    std::uint8_t lengths[sc::litlen_symbols];
+    sc::huffman_lengths(freq, sc::litlen_symbols, sc::max_code_length, lengths);
+    double kraft {0};
+    for (int s {0}; s < sc::litlen_symbols; ++s) {
+        REQUIRE(lengths[s] <= sc::max_code_length);
+        REQUIRE((lengths[s] != 0) == (freq[s] != 0));
+        if (lengths[s]) {
+            kraft += std::ldexp(1.0, -lengths[s]);
+        }
+    }
+    REQUIRE(kraft == 1.0);
+    // single used symbol still gets a code
+    std::uint32_t single[sc::dist_symbols] {};
+    single[3] = 10;
+    std::uint8_t single_lengths[sc::dist_symbols];
+    sc::huffman_lengths(single, sc::dist_symbols, sc::max_code_length, single_lengths);
+    REQUIRE(single_lengths[3] == 1);
+}
+
+TEST_CASE("Deflate block types", "[added]") {
+    constexpr int size_in {100000};
+    auto compress = [](const std::vector<std::uint8_t>& input, int& size_out) {
+        std::vector<char> output(input.size() * 2 + 64);
+        size_out = static_cast<int>(output.size());
+        REQUIRE(sc::deflate(output.data(), size_out,
+                            const_cast<char*>(reinterpret_cast<const char*>(input.data())),
+                            static_cast<int>(input.size()), 6) == 0);
+        std::vector<std::uint8_t> result(input.size());
+        unsigned long result_len {input.size()};
+        REQUIRE(uncompress(result.data(), &result_len,
+                           reinterpret_cast<std::uint8_t*>(output.data()), size_out) == Z_OK);
+        REQUIRE(result == input);
+        return output;
+    };
+    // noise can not be compressed, so stored blocks must be chosen
+    std::vector<std::uint8_t> noise(size_in);
+    std::uint32_t state {12345};
+    for (auto& byte : noise) {
+        state = state * 1103515245 + 12345;
+        byte = static_cast<std::uint8_t>(state >> 16);
+    }
+    int size_out;
+    compress(noise, size_out);
+    REQUIRE(size_out <= size_in + (size_in / sc::block_size + 1) * 5 + 6);
+    // skewed alphabet without repetitions is cheaper with dynamic codes than with fixed ones
+    std::vector<std::uint8_t> skewed(size_in);
+    for (auto& byte : skewed) {
+        state = state * 1103515245 + 12345;
+        byte = static_cast<std::uint8_t>('a' + (state >> 16) % 4);
+    }
+    auto output = compress(skewed, size_out);
+    REQUIRE(size_out < size_in / 3);
+    // first block is dynamic
+    REQUIRE(((static_cast<std::uint8_t>(output[2]) >> 1) & 0b11) == 2);
+}
+
+TEST_CASE("Inflate decompression", "[added]") {
+    constexpr size_t row_size {1001}, rows {300};
+    std::vector<std::uint8_t> input(row_size * rows);
+    for (size_t i {0}; i < input.size(); ++i) {
+        input[i] = static_cast<std::uint8_t>((i / 300) % 2 ? (i % 700) * 13 : (i * i) >> 7);
+    }
+    auto check = [&](const std::vector<std::uint8_t>& stream) {
+        size_t next {0};
+        bool matches {true};
+        auto done = sc::inflate(stream.data(), stream.size(), row_size, rows,
+                                [&](const std::uint8_t* row, size_t index) {
+            matches &= index == next++;
+            matches &= std::equal(row, row + row_size, input.data() + index * row_size);
+            return true;
+        });
+        REQUIRE(done);
+        REQUIRE(next == rows);
+        REQUIRE(matches);
+    };
+    SECTION("zlib streams") {
+        for (int strategy : {Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED}) {
+            for (int level {0}; level <= 9; ++level) {
+                z_stream stream {};
+                REQUIRE(deflateInit2(&stream, level, Z_DEFLATED, 15, 8, strategy) == Z_OK);
+                std::vector<std::uint8_t> output(deflateBound(&stream, input.size()));
+                stream.next_in = input.data();
+                stream.avail_in = input.size();
+                stream.next_out = output.data();
+                stream.avail_out = output.size();
+                REQUIRE(::deflate(&stream, Z_FINISH) == Z_STREAM_END);
+                output.resize(stream.total_out);
+                deflateEnd(&stream);
+                check(output);
+            }
+        }
+    }
+    SECTION("built-in deflate streams") {
+        for (int level {0}; level <= 9; level += 3) {
+            std::vector<std::uint8_t> output(input.size() * 2);
+            int size_out {static_cast<int>(output.size())};
+            REQUIRE(sc::deflate(reinterpret_cast<char*>(output.data()), size_out,
+                                reinterpret_cast<char*>(input.data()), input.size(), level) == 0);
+            output.resize(size_out);
+            check(output);
+        }
+    }
+    SECTION("early stop and corrupted streams") {
+        std::vector<std::uint8_t> output(compressBound(input.size()));
+        unsigned long output_len {output.size()};
+        REQUIRE(compress(output.data(), &output_len, input.data(), input.size()) == Z_OK);
+        output.resize(output_len);
+        size_t calls {0};
+        REQUIRE_FALSE(sc::inflate(output.data(), output.size(), row_size, rows,
+                                  [&](const std::uint8_t*, size_t index) {
+            ++calls;
+            return index < 9;
+        }));
+        REQUIRE(calls == 10);
+        auto accept = [](const std::uint8_t*, size_t) { return true; };
+        // image data must have exactly the expected size
+        REQUIRE_THROWS(sc::inflate(output.data(), output.size(), row_size, rows - 1, accept));
+        REQUIRE_THROWS(sc::inflate(output.data(), output.size(), row_size, rows + 1, accept));
+        // truncated stream
+        REQUIRE_THROWS(sc::inflate(output.data(), output.size() / 2, row_size, rows, accept));
+        // checksum mismatch
+        auto broken = output;
+        broken.back() ^= 1;
+        REQUIRE_THROWS(sc::inflate(broken.data(), broken.size(), row_size, rows, accept));
+        // bad header
+        broken = output;
+        broken[0] = 0;
+        REQUIRE_THROWS(sc::inflate(broken.data(), broken.size(), row_size, rows, accept));
+    }
+    SECTION("rows shorter and longer than the window") {
+        // only the window and the current row are kept, so rows are checked as they come
+        for (size_t size : {2, 7, 40000, 100003}) {
+            std::vector<std::uint8_t> data(1 << 20);
+            for (size_t i {0}; i < data.size(); ++i) {
+                data[i] = static_cast<std::uint8_t>((i / 5000) % 3 ? (i % 30000) * 7 : i * i >> 9);
+            }
+            data.resize(data.size() / size * size);
+            for (int level : {0, 1, 9}) {
+                std::vector<std::uint8_t> output(compressBound(data.size()));
+                unsigned long output_len {output.size()};
+                REQUIRE(compress2(output.data(), &output_len, data.data(), data.size(), level) ==
+                        Z_OK);
+                bool matches {true};
+                REQUIRE(sc::inflate(output.data(), output_len, size, data.size() / size,
+                                    [&](const std::uint8_t* row, size_t index) {
+                    matches &= std::equal(row, row + size, data.data() + index * size);
+                    return true;
+                }));
+                REQUIRE(matches);
+            }
+        }
+    }
+}
+
+TEST_CASE("PNG automatic compression strategy", "[added]") {
+    using img_t = img::PNGImage;
+    img_t image {};
+    constexpr size_t row_size {3 * 500 + 1}, rows {200};
+    std::vector<std::uint8_t> data(row_size * rows);
+    sc::zlib_params params {};
+
+    // noise is stored
+    std::uint32_t state {1};
+    for (auto& byte : data) {
+        state = state * 1103515245 + 12345;
+        byte = static_cast<std::uint8_t>(state >> 16);
+    }
+    image.select_strategy(data.data(), data.size(), row_size, params);
+    CHECK(params.level == 0);
+
+    // flat image is compressed with RLE
+    params = {};
+    std::fill(data.begin(), data.end(), 0);
+    for (size_t row {0}; row < rows; ++row) {
+        data[row * row_size + 700] = 1;
+    }
+    image.select_strategy(data.data(), data.size(), row_size, params);
+    CHECK(params.level == 6);
+    CHECK(params.strategy == Z_RLE);
+
+    // repeating text-like content needs string matching
+    params = {};
+    const std::string words {"the quick brown fox jumps over the lazy dog "};
+    for (size_t i {0}; i < data.size(); ++i) {
+        state = state * 1103515245 + 12345;
+        data[i] = words[(i + (state >> 16) % 3 * (i % 97 == 0)) % words.size()];
+    }
+    image.select_strategy(data.data(), data.size(), row_size, params);
+    CHECK(params.level == 6);
+    CHECK(params.strategy == Z_DEFAULT_STRATEGY);
+
+    // automatic strategy keeps images intact
+    img_t original {};
+    original.read("resources/bumblebee.png");
+    auto options = img_t::EncodeOptions{};
+    options.strategy = img_t::Strategy::automatic;
+    original.encode_options(options);
+    original.write("resources/result_automatic.png");
+    img_t result {};
+    result.read("resources/result_automatic.png");
+    auto& exp_map {original.get_map()};
+    auto& res_map = result.get_map();
+    REQUIRE(exp_map.rows() == res_map.rows());
+    REQUIRE(exp_map.columns() == res_map.columns());
+    bool check {1};
+    for (int row {0}; row < exp_map.rows(); ++row) {
+        for (int column {0}; column < exp_map.columns(); ++column) {
+            check &= exp_map.at(row, column) == res_map.at(row, column);
+        }
+    }
+    REQUIRE(check);
+}
+
+TEST_CASE("PNG compression failure", "[added]") {
+    img::PNGImage image {};
+    image.read("resources/bumblebee.png");
+    // options are validated on assignment, invalid memory level can only be forced
+    image._encode_options.mem_level = 0;
+    REQUIRE_THROWS_AS(image.write("resources/result_failed.png"), std::runtime_error);
+}
+
+// Hidden (run with "[benchmark]"), compares built-in deflate with zlib on filtered image data.
+TEST_CASE("Deflate benchmark against zlib", "[.][benchmark]") {
+    img::PNGImage image {};
+    image.read("resources/bumblebee.png");
+    std::unique_ptr<std::uint8_t[]> data;
+    size_t size;
+    image.assemble_8b_truecolor(data, size);
+    for (int level : {1, 6}) {
+        std::vector<char> output(size * 2);
+        int size_out {static_cast<int>(output.size())};
+        auto start = std::chrono::steady_clock::now();
+        sc::deflate(output.data(), size_out, reinterpret_cast<char*>(data.get()), size, level);
+        std::chrono::duration<double> builtin_time {std::chrono::steady_clock::now() - start};
+
+        unsigned long zlib_size {compressBound(size)};
+        std::vector<std::uint8_t> zlib_output(zlib_size);
+        start = std::chrono::steady_clock::now();
+        compress2(zlib_output.data(), &zlib_size, data.get(), size, level);
+        std::chrono::duration<double> zlib_time {std::chrono::steady_clock::now() - start};
+
+        std::cout << "level " << level << ": built-in " << size_out << " bytes, "
+                  << builtin_time.count() << " s; zlib " << zlib_size << " bytes, "
+                  << zlib_time.count() << " s" << std::endl;
+    }
+}
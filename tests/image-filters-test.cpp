@@ -1,6 +1,8 @@
 #include <catch2/catch_all.hpp>
 #include <memory>
 #include <cstddef>
+#include <algorithm>
+#include <cstdlib>
 
 #define private public
 #define protected public
@@ -86,3 +88,44 @@ TEST_CASE("<sub>, <up> and <avg> filters", "[base]") {
     }
 }
 
+
+TEST_CASE("Filtering lines without changing them", "[added]") {
+    using img = img::PNGImage;
+    img test_img;
+    test_img.bit_depth = 8;
+    test_img.sample_size = 3;
+    constexpr size_t magic_size {30};
+    BYTE line[magic_size], upper[magic_size], expected[magic_size], filtered[magic_size];
+    for (size_t i {0}; i < magic_size; ++i) {
+        line[i] = static_cast<BYTE>(i * 37 + 11);
+        upper[i] = static_cast<BYTE>(i * 91 + 200);
+    }
+    for (BYTE* upper_line : {static_cast<BYTE*>(nullptr), upper}) {
+        for (int filter {0}; filter <= 4; ++filter) {
+            std::copy(line, line + magic_size, expected);
+            switch (filter) {
+            case 1:
+                test_img.apply_sub(expected, magic_size);
+                break;
+            case 2:
+                test_img.apply_up(expected, upper_line, magic_size);
+                break;
+            case 3:
+                test_img.apply_avg(expected, upper_line, magic_size);
+                break;
+            case 4:
+                test_img.apply_paeth(expected, upper_line, magic_size);
+                break;
+            }
+            auto sum = test_img.filter_line(filter, line, upper_line, filtered, magic_size);
+            REQUIRE(std::equal(filtered, filtered + magic_size, expected));
+            std::uint64_t expected_sum {0};
+            for (auto byte : expected) {
+                expected_sum += std::abs(static_cast<std::int8_t>(byte));
+            }
+            REQUIRE(sum == expected_sum);
+            // source line stays the same
+            REQUIRE(line[5] == static_cast<BYTE>(5 * 37 + 11));
+        }
+    }
+}
@@ -1,13 +1,114 @@
 // std
 #include <catch2/catch_all.hpp>
+#include <cmath>
 #include <string>
 #include <memory>
+#include <thread>
+#include <vector>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <zlib.h>
 #include <processing/processing.hpp>
 
 #define private public
 #define protected public
 #include <image/image.hpp>
 
+namespace {
+// Chunk with big-endian length and CRC
+std::string png_chunk(const std::string& type, const std::string& data) {
+    std::string chunk;
+    auto put_be32 = [&](std::uint32_t value) {
+        for (int b {0}; b < 4; ++b) {
+            chunk += static_cast<char>(value >> (24 - 8 * b));
+        }
+    };
+    put_be32(data.size());
+    chunk += type + data;
+    put_be32(crc32(0, reinterpret_cast<const std::uint8_t*>(chunk.data()) + 4, chunk.size() - 4));
+    return chunk;
+}
+
+// Writes PNG with given header, raw (filtered) scanlines and chunks, that go before IDAT
+void write_png(const std::string& path, const std::string& ihdr, const std::string& raw,
+               const std::string& chunks = "") {
+    std::vector<std::uint8_t> compressed(compressBound(raw.size()));
+    uLongf compressed_size {compressed.size()};
+    compress2(compressed.data(), &compressed_size,
+              reinterpret_cast<const std::uint8_t*>(raw.data()), raw.size(), 6);
+    std::ofstream file {path, std::ios::binary};
+    file << std::string{"\x89PNG\r\n\x1a\n"} << png_chunk("IHDR", ihdr) << chunks
+         << png_chunk("IDAT", std::string(compressed.begin(),
+                                          compressed.begin() + compressed_size))
+         << png_chunk("IEND", "");
+}
+
+bool equal(img::PixelMap& expected, img::PixelMap& result) {
+    bool check {expected.rows() == result.rows() && expected.columns() == result.columns()};
+    for (int row {0}; check && row < expected.rows(); ++row) {
+        for (int column {0}; column < expected.columns(); ++column) {
+            check &= expected.at(row, column) == result.at(row, column);
+        }
+    }
+    return check;
+}
+
+size_t file_size(const std::string& path) {
+    std::ifstream file {path, std::ios::binary | std::ios::ate};
+    return static_cast<size_t>(file.tellg());
+}
+
+std::string contents(const std::string& path) {
+    std::ifstream file {path, std::ios::binary};
+    return std::string{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+}
+
+// Writes map as Adam7 interlaced PNG, filter types of scanlines go round 0 - 4
+void write_adam7(img::PixelMap& map, const std::string& path) {
+    const int adam7[7][4] {{0, 0, 8, 8}, {0, 4, 8, 8}, {4, 0, 8, 4}, {0, 2, 4, 4},
+                           {2, 0, 4, 2}, {0, 1, 2, 2}, {1, 0, 2, 1}};
+    int rows = map.rows(), columns = map.columns();
+    std::vector<std::uint8_t> raw;
+    int filter {0};
+    for (auto [first_row, first_column, row_step, column_step] : adam7) {
+        std::vector<std::uint8_t> upper;
+        for (int row {first_row}; row < rows; row += row_step) {
+            std::vector<std::uint8_t> line;
+            for (int column {first_column}; column < columns; column += column_step) {
+                auto& color = map.at(row, column);
+                line.insert(line.end(), {static_cast<std::uint8_t>(color.R()),
+                                         static_cast<std::uint8_t>(color.G()),
+                                         static_cast<std::uint8_t>(color.B())});
+            }
+            if (line.empty()) {
+                break;
+            }
+            raw.push_back(filter);
+            for (size_t i {0}; i < line.size(); ++i) {
+                int a {i >= 3 ? line[i - 3] : 0}, b {upper.empty() ? 0 : upper[i]};
+                int c {(i >= 3 && !upper.empty()) ? upper[i - 3] : 0};
+                int p {a + b - c}, pa {std::abs(p - a)}, pb {std::abs(p - b)}, pc {std::abs(p - c)};
+                int predictor[5] {0, a, b, (a + b) / 2,
+                                  (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c)};
+                raw.push_back(static_cast<std::uint8_t>(line[i] - predictor[filter]));
+            }
+            upper = line;
+            filter = (filter + 1) % 5;
+        }
+    }
+    std::string ihdr(13, '\0');
+    for (int b {0}; b < 4; ++b) {
+        ihdr[b] = static_cast<char>(columns >> (24 - 8 * b));
+        ihdr[4 + b] = static_cast<char>(rows >> (24 - 8 * b));
+    }
+    ihdr[8] = 8;
+    ihdr[9] = 2;
+    ihdr[12] = 1;
+    write_png(path, ihdr, std::string(raw.begin(), raw.end()));
+}
+}
+
 TEST_CASE("PPM reading and writing in <Image> class", "[base]") {
     using img_t = img::PPMImage;
     const std::string files[] {
@@ -97,9 +198,1112 @@ TEST_CASE("Convert image to new type", "[added]") {
     img::PNGImage img_png {};
     img_png.read("resources/simple.png");
     auto new_ppm = img::convert(img_png, img::ImageType::PPM);
-    new_ppm.write("resources/result.ppm");
+    new_ppm->write("resources/result.ppm");
     REQUIRE(img::get_type("resources/result.ppm") == img::ImageType::PPM);
-    auto new_png = img::convert(new_ppm, img::ImageType::PNG);
-    new_png.write("resources/result.png");
+    auto new_png = img::convert(*new_ppm, img::ImageType::PNG);
+    new_png->write("resources/result.png");
     REQUIRE(img::get_type("resources/result.png") == img::ImageType::PNG);
+    // encoder of the new type is used, not the one of base class
+    auto new_qoi = img::convert(*new_png, img::ImageType::QOI);
+    REQUIRE(dynamic_cast<img::QOIImage*>(new_qoi.get()));
+    new_qoi->write("resources/result_convert.qoi");
+    REQUIRE(img::get_type("resources/result_convert.qoi") == img::ImageType::QOI);
+    REQUIRE_THROWS_AS(img::convert(*new_png, img::ImageType::Unknown), std::runtime_error);
+}
+
+// Run under -DGGPEG_SANITIZE=thread to prove that codecs do not share mutable state.
+TEST_CASE("Concurrent PNG decoding and encoding", "[added]") {
+    using img_t = img::PNGImage;
+    const std::string files[] {
+        "clouds.png",
+        "bumblebee.png",
+        "clouds.png",
+        "bumblebee.png"
+    };
+    constexpr size_t count {sizeof(files) / sizeof(files[0])};
+
+    img_t expected[count];
+    for (size_t i {0}; i < count; ++i) {
+        expected[i].read(std::string{"resources/"}.append(files[i]));
+    }
+
+    img_t decoded[count], reread[count];
+    std::vector<std::thread> workers;
+    for (size_t i {0}; i < count; ++i) {
+        workers.emplace_back([&, i] {
+            auto output = std::format("resources/concurrent_{}.png", i);
+            decoded[i].read(std::string{"resources/"}.append(files[i]));
+            decoded[i].write(output);
+            reread[i].read(output);
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    for (size_t i {0}; i < count; ++i) {
+        REQUIRE((decoded[i].good() && reread[i].good()));
+        img::PixelMap& exp_map {expected[i].get_map()}, res_map {reread[i].get_map()};
+        REQUIRE(exp_map.rows() == res_map.rows());
+        REQUIRE(exp_map.columns() == res_map.columns());
+        bool check {1};
+        for (int row {0}; row < exp_map.rows(); ++row) {
+            for (int column {0}; column < exp_map.columns(); ++column) {
+                check &= exp_map.at(row, column) == res_map.at(row, column);
+            }
+        }
+        REQUIRE(check);
+    }
+}
+
+TEST_CASE("PNG encoding options", "[added]") {
+    using img_t = img::PNGImage;
+    img_t original {};
+    original.read("resources/bumblebee.png");
+    REQUIRE(original.good());
+
+    auto check_round_trip = [&](const img_t::EncodeOptions& options, const std::string& path) {
+        original.encode_options(options);
+        original.write(path);
+        img_t result {};
+        result.read(path);
+        REQUIRE(result.good());
+        img::PixelMap& exp_map {original.get_map()}, res_map {result.get_map()};
+        REQUIRE(exp_map.rows() == res_map.rows());
+        REQUIRE(exp_map.columns() == res_map.columns());
+        bool check {1};
+        for (int row {0}; row < exp_map.rows(); ++row) {
+            for (int column {0}; column < exp_map.columns(); ++column) {
+                check &= exp_map.at(row, column) == res_map.at(row, column);
+            }
+        }
+        REQUIRE(check);
+        std::ifstream file {path, std::ios::binary | std::ios::ate};
+        return static_cast<size_t>(file.tellg());
+    };
+
+    check_round_trip(img_t::EncodeOptions::fast(), "resources/result_fast.png");
+    auto level_1 = img_t::EncodeOptions{};
+    level_1.level = 1;
+    auto level_1_size = check_round_trip(level_1, "resources/result_level_1.png");
+    auto small_size = check_round_trip(img_t::EncodeOptions::small(), "resources/result_small.png");
+    CHECK(small_size <= level_1_size);
+
+    auto chunked = img_t::EncodeOptions::fast();
+    chunked.idat_chunk_size = 1000;
+    chunked.strategy = img_t::Strategy::huffman_only;
+    chunked.window_bits = 9;
+    chunked.mem_level = 1;
+    check_round_trip(chunked, "resources/result_chunked.png");
+
+    for (auto filter : {img_t::Filter::none, img_t::Filter::sub, img_t::Filter::up,
+                        img_t::Filter::average, img_t::Filter::paeth}) {
+        auto filtered = img_t::EncodeOptions::fast();
+        filtered.filter = filter;
+        filtered.threads = 3;
+        check_round_trip(filtered, "resources/result_filter.png");
+    }
+    auto adaptive = img_t::EncodeOptions{};
+    adaptive.threads = 1;
+    auto adaptive_size = check_round_trip(adaptive, "resources/result_adaptive.png");
+    auto paeth = adaptive;
+    paeth.filter = img_t::Filter::paeth;
+    CHECK(adaptive_size <= check_round_trip(paeth, "resources/result_paeth.png") * 1.02);
+
+    auto bad = img_t::EncodeOptions{};
+    bad.level = 10;
+    CHECK_THROWS_AS(original.encode_options(bad), std::runtime_error);
+}
+
+TEST_CASE("Pipelined PNG decoding", "[added]") {
+    using img_t = img::PNGImage;
+    for (auto file : {"bumblebee.png", "large_sample.png", "simple.png"}) {
+        img_t expected {};
+        expected.read(std::string{"resources/"}.append(file));
+        for (size_t ring_rows : {1, 3, 64}) {
+            img_t result {};
+            result.decode_options({true, ring_rows});
+            result.read(std::string{"resources/"}.append(file));
+            REQUIRE(result.good());
+            img::PixelMap& exp_map {expected.get_map()}, res_map {result.get_map()};
+            REQUIRE(exp_map.rows() == res_map.rows());
+            REQUIRE(exp_map.columns() == res_map.columns());
+            bool check {1};
+            for (int row {0}; row < exp_map.rows(); ++row) {
+                for (int column {0}; column < exp_map.columns(); ++column) {
+                    check &= exp_map.at(row, column) == res_map.at(row, column);
+                }
+            }
+            REQUIRE(check);
+        }
+    }
+
+    // errors of inflate thread are reported by read()
+    img_t original {};
+    original.read("resources/bumblebee.png");
+    original.encode_options(img_t::EncodeOptions::fast());
+    original.write("resources/result_pipeline.png");
+    std::fstream file {"resources/result_pipeline.png",
+                       std::ios::binary | std::ios::in | std::ios::out | std::ios::ate};
+    auto size = static_cast<long>(file.tellg());
+    // flip a byte of IDAT data and fix its CRC, so that only the deflate stream is broken
+    std::vector<char> content(size);
+    file.seekg(0);
+    file.read(content.data(), size);
+    content[33 + 8 + 100] ^= 0x55;
+    std::uint32_t idat_size {static_cast<std::uint32_t>(
+        static_cast<std::uint8_t>(content[33]) << 24 | static_cast<std::uint8_t>(content[34]) << 16 |
+        static_cast<std::uint8_t>(content[35]) << 8 | static_cast<std::uint8_t>(content[36]))};
+    auto crc = crc32(0, reinterpret_cast<std::uint8_t*>(content.data()) + 37, idat_size + 4);
+    for (int b {0}; b < 4; ++b) {
+        content[41 + idat_size + b] = static_cast<char>(crc >> (24 - 8 * b));
+    }
+    file.seekp(0);
+    file.write(content.data(), size);
+    file.close();
+    img_t broken {};
+    broken.decode_options({true, 4});
+    CHECK_THROWS_AS(broken.read("resources/result_pipeline.png"), img_t::DecoderError);
+    // errors of unfiltering stop inflate thread, while ring is full
+    std::string raw;
+    for (int row {0}; row < 64; ++row) {
+        raw += std::string{'\0', '\0', static_cast<char>(row == 1 ? 5 : 1), '\0', '\1'};
+    }
+    std::string ihdr {'\0', '\0', '\0', '\4', '\0', '\0', '\0', '\x40', 8, 3, '\0', '\0', '\0'};
+    write_png("resources/result_pipeline.png", ihdr, raw,
+              png_chunk("PLTE", std::string{'\0', '\0', '\0', '\xff', '\xff', '\xff'}));
+    img_t bad_index {};
+    bad_index.decode_options({true, 4});
+    CHECK_THROWS_AS(bad_index.read("resources/result_pipeline.png"), img_t::DecoderError);
+    img_t bad {};
+    CHECK_THROWS_AS(bad.decode_options({true, 0}), std::runtime_error);
+}
+
+TEST_CASE("Ancillary chunk policy", "[added]") {
+    using img_t = img::PNGImage;
+    img_t original {};
+    original.read("resources/simple.png");
+    original.write("resources/result_ancillary.png");
+    std::vector<char> content;
+    {
+        std::ifstream file {"resources/result_ancillary.png", std::ios::binary};
+        content.assign(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+    }
+    auto make_chunk = [](std::string type, std::string data) {
+        std::string chunk(4, '\0');
+        for (int b {0}; b < 4; ++b) {
+            chunk[b] = static_cast<char>(data.size() >> (24 - 8 * b));
+        }
+        chunk += type + data;
+        auto crc = crc32(0, reinterpret_cast<const std::uint8_t*>(chunk.data()) + 4,
+                         chunk.size() - 4);
+        for (int b {0}; b < 4; ++b) {
+            chunk += static_cast<char>(crc >> (24 - 8 * b));
+        }
+        return chunk;
+    };
+    // tEXt and prIV before image data (prIV is not safe to copy), iTXt after it
+    auto text = make_chunk("tEXt", std::string{"Comment\0ancillary", 17});
+    auto international = make_chunk("iTXt", std::string{"Date\0\0\0\0\02026", 13});
+    std::string with_chunks {content.begin(), content.begin() + 33};
+    with_chunks += text + make_chunk("prIV", std::string(1000, 'x'));
+    with_chunks.append(content.begin() + 33, content.end() - 12);
+    with_chunks += international;
+    with_chunks.append(content.end() - 12, content.end());
+    auto save = [](const std::string& data) {
+        std::ofstream file {"resources/result_ancillary.png", std::ios::binary};
+        file.write(data.data(), data.size());
+    };
+    save(with_chunks);
+
+    img_t skipped {};
+    skipped.read("resources/result_ancillary.png");
+    REQUIRE(skipped.good());
+    REQUIRE(skipped.ancillary_chunks().empty());
+    REQUIRE(skipped.get_map().rows() == original.get_map().rows());
+
+    img_t retained {};
+    retained.decode_options({false, 64, img_t::Ancillary::retain});
+    retained.read("resources/result_ancillary.png");
+    REQUIRE(retained.good());
+    auto& chunks = retained.ancillary_chunks();
+    REQUIRE(chunks.size() == 3);
+    REQUIRE(std::string(chunks[0].type.data(), 4) == "tEXt");
+    REQUIRE(std::string(chunks[0].data.begin(), chunks[0].data.end()) ==
+            std::string{"Comment\0ancillary", 17});
+    REQUIRE_FALSE(chunks[0].after_idat);
+    REQUIRE(std::string(chunks[1].type.data(), 4) == "prIV");
+    REQUIRE(chunks[1].data.size() == 1000);
+    REQUIRE(std::string(chunks[2].type.data(), 4) == "iTXt");
+    REQUIRE(chunks[2].after_idat);
+
+    // passthrough keeps only safe-to-copy chunks, each on its side of image data
+    retained.write("resources/result_ancillary_copy.png");
+    img_t copy {};
+    copy.decode_options({false, 64, img_t::Ancillary::retain});
+    copy.read("resources/result_ancillary_copy.png");
+    REQUIRE(copy.ancillary_chunks().size() == 2);
+    REQUIRE(std::string(copy.ancillary_chunks()[0].type.data(), 4) == "tEXt");
+    REQUIRE_FALSE(copy.ancillary_chunks()[0].after_idat);
+    REQUIRE(std::string(copy.ancillary_chunks()[1].type.data(), 4) == "iTXt");
+    REQUIRE(copy.ancillary_chunks()[1].after_idat);
+
+    // broken CRC of ancillary chunk matters only if it is verified
+    with_chunks[33 + 12] ^= 1;
+    save(with_chunks);
+    img_t lenient {};
+    lenient.read("resources/result_ancillary.png");
+    REQUIRE(lenient.good());
+    img_t strict {};
+    strict.decode_options({false, 64, img_t::Ancillary::verify});
+    CHECK_THROWS_AS(strict.read("resources/result_ancillary.png"), img_t::DecoderError);
+}
+
+TEST_CASE("Probing image headers", "[added]") {
+    for (auto file : {"simple.png", "bumblebee.png", "boxes.ppm", "west.ppm"}) {
+        std::string path {std::string{"resources/"}.append(file)};
+        auto info = img::probe(path);
+        REQUIRE(info.type == img::get_type(path));
+        std::unique_ptr<img::Image> image;
+        if (info.type == img::ImageType::PNG) {
+            image = std::make_unique<img::PNGImage>();
+        } else {
+            image = std::make_unique<img::PPMImage>();
+        }
+        image->read(path);
+        REQUIRE(info.width == image->get_map().columns());
+        REQUIRE(info.height == image->get_map().rows());
+        REQUIRE(info.bit_depth == 8);
+        REQUIRE(info.color_type == 2);
+        REQUIRE_FALSE(info.interlaced);
+    }
+    // header is reported as is, even if the decoder does not support it
+    auto info = img::probe("resources/bad_ihdr_bit_depth.png");
+    REQUIRE(info.type == img::ImageType::PNG);
+    REQUIRE(info.bit_depth != 8);
+    REQUIRE(img::probe("resources/bad_signature.png").type == img::ImageType::Unknown);
+    REQUIRE(img::probe("resources/missing.png").type == img::ImageType::Unknown);
+}
+
+TEST_CASE("Scaled PNG decoding", "[added]") {
+    using img_t = img::PNGImage;
+    for (auto file : {"simple.png", "bumblebee.png"}) {
+        img_t full {};
+        full.read(std::string{"resources/"}.append(file));
+        auto& full_map = full.get_map();
+        for (unsigned scale : {2u, 4u, 8u}) {
+            img_t scaled {};
+            scaled.decode_options({scale == 4, 64, img_t::Ancillary::skip, scale});
+            scaled.read(std::string{"resources/"}.append(file));
+            REQUIRE(scaled.good());
+            auto& map = scaled.get_map();
+            REQUIRE(map.rows() == (full_map.rows() + scale - 1) / scale);
+            REQUIRE(map.columns() == (full_map.columns() + scale - 1) / scale);
+            // every pixel is a rounded average of its box (partial at the edges)
+            bool check {1};
+            for (int row {0}; row < map.rows(); ++row) {
+                for (int column {0}; column < map.columns(); ++column) {
+                    int r {0}, g {0}, b {0}, count {0};
+                    for (int y = row * scale;
+                         y < std::min<int>((row + 1) * scale, full_map.rows()); ++y) {
+                        for (int x = column * scale;
+                             x < std::min<int>((column + 1) * scale, full_map.columns()); ++x) {
+                            r += full_map.at(y, x).R();
+                            g += full_map.at(y, x).G();
+                            b += full_map.at(y, x).B();
+                            ++count;
+                        }
+                    }
+                    auto& color = map.at(row, column);
+                    check &= color.R() == (r + count / 2) / count &&
+                             color.G() == (g + count / 2) / count &&
+                             color.B() == (b + count / 2) / count;
+                }
+            }
+            REQUIRE(check);
+        }
+    }
+    img_t bad {};
+    CHECK_THROWS_AS(bad.decode_options({false, 64, img_t::Ancillary::skip, 3}), std::runtime_error);
+}
+
+TEST_CASE("Region of interest PNG decoding", "[added]") {
+    using img_t = img::PNGImage;
+    img_t full {};
+    full.read("resources/bumblebee.png");
+    auto& full_map = full.get_map();
+    int rows = full_map.rows(), columns = full_map.columns();
+    struct window_t { std::uint32_t row, column, rows, columns; };
+    for (auto window : {window_t{0, 0, 10, 10}, window_t{7, 3, 20, 0},
+                        window_t{static_cast<std::uint32_t>(rows - 5), 11, 0, 17}}) {
+        for (bool pipeline : {false, true}) {
+            img_t region {};
+            region.decode_options({pipeline, 4, img_t::Ancillary::skip, 1,
+                                   {window.row, window.column, window.rows, window.columns}});
+            region.read("resources/bumblebee.png");
+            REQUIRE(region.good());
+            auto& map = region.get_map();
+            REQUIRE(map.rows() == (window.rows ? window.rows : rows - window.row));
+            REQUIRE(map.columns() == (window.columns ? window.columns : columns - window.column));
+            bool check {1};
+            for (int row {0}; row < map.rows(); ++row) {
+                for (int column {0}; column < map.columns(); ++column) {
+                    check &= map.at(row, column) ==
+                             full_map.at(window.row + row, window.column + column);
+                }
+            }
+            REQUIRE(check);
+        }
+    }
+    // window is clamped to the image
+    img_t clamped {};
+    clamped.decode_options({false, 64, img_t::Ancillary::skip, 2,
+                            {static_cast<std::uint32_t>(rows - 3), 0, 100, 5}});
+    clamped.read("resources/bumblebee.png");
+    REQUIRE(clamped.get_map().rows() == 2);
+    REQUIRE(clamped.get_map().columns() == 3);
+
+    // inflate stops after the last row of the window: data below it is never checked
+    full.encode_options({0});
+    full.write("resources/result_region.png");
+    std::fstream file {"resources/result_region.png",
+                       std::ios::binary | std::ios::in | std::ios::out | std::ios::ate};
+    std::vector<char> content(static_cast<long>(file.tellg()));
+    file.seekg(0);
+    file.read(content.data(), content.size());
+    // last pixel byte of stored IDAT data, CRC of the chunk is fixed
+    size_t idat_end {content.size() - 12 - 4};
+    content[idat_end - 4 - 1] ^= 0x55;
+    auto crc = crc32(0, reinterpret_cast<std::uint8_t*>(content.data()) + 37, idat_end - 37);
+    for (int b {0}; b < 4; ++b) {
+        content[idat_end + b] = static_cast<char>(crc >> (24 - 8 * b));
+    }
+    file.seekp(0);
+    file.write(content.data(), content.size());
+    file.close();
+    img_t broken {};
+    CHECK_THROWS_AS(broken.read("resources/result_region.png"), img_t::DecoderError);
+    img_t top {};
+    top.decode_options({false, 64, img_t::Ancillary::skip, 1, {0, 0, 16, 0}});
+    top.read("resources/result_region.png");
+    REQUIRE(top.good());
+    REQUIRE(top.get_map().at(15, 0) == full_map.at(15, 0));
+}
+
+TEST_CASE("Adam7 interlaced PNG decoding", "[added]") {
+    using img_t = img::PNGImage;
+    img_t source {};
+    source.read("resources/bumblebee.png");
+    std::vector<img::PixelMap> maps {source.get_map()};
+    // sizes, that leave some passes empty or partial
+    for (auto [rows, columns] : {std::pair{1, 1}, {1, 7}, {5, 3}, {9, 10}, {13, 17}}) {
+        img::PixelMap map(columns, rows);
+        for (int row {0}; row < rows; ++row) {
+            for (int column {0}; column < columns; ++column) {
+                map.at(row, column) = img::Color{row * 17 % 256, column * 29 % 256,
+                                                 (row * column) % 256};
+            }
+        }
+        maps.push_back(map);
+    }
+    for (auto& map : maps) {
+        write_adam7(map, "resources/result_adam7.png");
+        img_t interlaced {};
+        interlaced.read("resources/result_adam7.png");
+        REQUIRE(interlaced.good());
+        REQUIRE(equal(map, interlaced.get_map()));
+
+        // scaled and windowed decoding match the ones of non-interlaced image
+        img_t plain {};
+        plain.get_map() = map;
+        plain.write("resources/result_adam7_plain.png");
+        img_t::DecodeOptions options {false, 64, img_t::Ancillary::skip, 2, {1, 2, 0, 5}};
+        img_t expected {}, result {};
+        expected.decode_options(options);
+        expected.read("resources/result_adam7_plain.png");
+        result.decode_options(options);
+        result.read("resources/result_adam7.png");
+        REQUIRE(equal(expected.get_map(), result.get_map()));
+
+        // preview copies pixels of the passes decoded to the blocks of the rest
+        const int blocks[6][2] {{7, 7}, {7, 3}, {3, 3}, {3, 1}, {1, 1}, {1, 0}};
+        for (unsigned passes {1}; passes < 7; ++passes) {
+            img_t preview {};
+            preview.decode_options({false, 64, img_t::Ancillary::skip, 1, {}, passes});
+            preview.read("resources/result_adam7.png");
+            auto [row_mask, column_mask] = blocks[passes - 1];
+            bool check {1};
+            for (int row {0}; row < map.rows(); ++row) {
+                for (int column {0}; column < map.columns(); ++column) {
+                    check &= preview.get_map().at(row, column) ==
+                             map.at(row & ~row_mask, column & ~column_mask);
+                }
+            }
+            REQUIRE(check);
+        }
+    }
+    img_t bad {};
+    CHECK_THROWS_AS(bad.decode_options({false, 64, img_t::Ancillary::skip, 1, {}, 0}),
+                    std::runtime_error);
+}
+
+TEST_CASE("Indexed color PNG", "[added]") {
+    using img_t = img::PNGImage;
+    for (int colors : {1, 2, 3, 10, 200, 256, 257}) {
+        img::PixelMap map(37, 23);
+        for (int row {0}; row < map.rows(); ++row) {
+            for (int column {0}; column < map.columns(); ++column) {
+                int i {static_cast<int>((row * map.columns() + column) % colors)};
+                map.at(row, column) = img::Color{i % 256, i / 256 * 50, i * 7 % 256};
+            }
+        }
+        int expected_depth {(colors <= 2) ? 1 : (colors <= 4) ? 2 : (colors <= 16) ? 4 : 8};
+        for (auto filter : {img_t::Filter::none, img_t::Filter::sub, img_t::Filter::paeth,
+                            img_t::Filter::adaptive}) {
+            img_t image {};
+            image.get_map() = map;
+            auto options = img_t::EncodeOptions::small();
+            options.filter = filter;
+            image.encode_options(options);
+            image.write("resources/result_indexed.png");
+            auto info = img::probe("resources/result_indexed.png");
+            if (colors <= 256) {
+                REQUIRE(info.color_type == 3);
+                REQUIRE(info.bit_depth == expected_depth);
+            } else {
+                REQUIRE(info.color_type == 2);
+                REQUIRE(info.bit_depth == 8);
+            }
+            img_t result {};
+            result.read("resources/result_indexed.png");
+            REQUIRE(result.good());
+            bool check {1};
+            for (int row {0}; row < map.rows(); ++row) {
+                for (int column {0}; column < map.columns(); ++column) {
+                    check &= result.get_map().at(row, column) == map.at(row, column);
+                }
+            }
+            REQUIRE(check);
+            // window of indexed image starts in the middle of a byte
+            img_t region {};
+            region.decode_options({false, 64, img_t::Ancillary::skip, 1, {3, 5, 4, 11}});
+            region.read("resources/result_indexed.png");
+            for (int row {0}; row < 4; ++row) {
+                for (int column {0}; column < 11; ++column) {
+                    check &= region.get_map().at(row, column) == map.at(row + 3, column + 5);
+                }
+            }
+            REQUIRE(check);
+        }
+    }
+
+    // indexed image is smaller than true color one
+    img_t image {};
+    image.read("resources/bumblebee.png");
+    img::PixelMap& map {image.get_map()};
+    for (int row {0}; row < map.rows(); ++row) {
+        for (int column {0}; column < map.columns(); ++column) {
+            auto& color = map.at(row, column);
+            color = img::Color{color.R() & 0xC0, color.G() & 0xC0, color.B() & 0x80};
+        }
+    }
+    auto options = img_t::EncodeOptions::small();
+    options.palette = false;
+    image.encode_options(options);
+    image.write("resources/result_truecolor.png");
+    image.encode_options(img_t::EncodeOptions::small());
+    image.write("resources/result_indexed.png");
+    REQUIRE(file_size("resources/result_indexed.png") <
+            file_size("resources/result_truecolor.png"));
+
+    // IDAT of indexed image without PLTE
+    std::string content {contents("resources/result_indexed.png")};
+    REQUIRE(std::string(content.begin() + 37, content.begin() + 41) == "PLTE");
+    size_t plte_size {static_cast<std::uint8_t>(content[35]) * 256u +
+                      static_cast<std::uint8_t>(content[36])};
+    content.erase(content.begin() + 33, content.begin() + 33 + 12 + plte_size);
+    {
+        std::ofstream file {"resources/result_indexed.png", std::ios::binary};
+        file.write(content.data(), content.size());
+    }
+    img_t broken {};
+    CHECK_THROWS_AS(broken.read("resources/result_indexed.png"), img_t::DecoderError);
+}
+
+TEST_CASE("Grayscale PNG output", "[added]") {
+    using img_t = img::PNGImage;
+    img_t image {};
+    image.read("resources/bumblebee.png");
+    img::PixelMap colored {image.get_map()}, gray {image.get_map()};
+    for (int row {0}; row < gray.rows(); ++row) {
+        for (int column {0}; column < gray.columns(); ++column) {
+            int value {gray.at(row, column).G()};
+            gray.at(row, column) = img::Color{value, value, value};
+        }
+    }
+    auto write_read = [](img::PixelMap& map, img_t::Grayscale mode, img::ImageInfo& info) {
+        img_t output {};
+        output.get_map() = map;
+        auto options = output.encode_options();
+        options.grayscale = mode;
+        output.encode_options(options);
+        output.write("resources/result_gray.png");
+        info = img::probe("resources/result_gray.png");
+        img_t input {};
+        input.read("resources/result_gray.png");
+        return input.get_map();
+    };
+    img::ImageInfo info;
+    // gray image is detected
+    auto result = write_read(gray, img_t::Grayscale::automatic, info);
+    REQUIRE(info.color_type == 0);
+    REQUIRE(info.bit_depth == 8);
+    REQUIRE(equal(gray, result));
+    size_t gray_size {file_size("resources/result_gray.png")};
+    result = write_read(gray, img_t::Grayscale::forbid, info);
+    REQUIRE(info.color_type == 2);
+    REQUIRE(equal(gray, result));
+    REQUIRE(gray_size < file_size("resources/result_gray.png"));
+    // colored image is written as is, unless grayscale is forced
+    result = write_read(colored, img_t::Grayscale::automatic, info);
+    REQUIRE(info.color_type == 2);
+    REQUIRE(equal(colored, result));
+    result = write_read(colored, img_t::Grayscale::force, info);
+    REQUIRE(info.color_type == 0);
+    bool check {1};
+    for (int row {0}; row < colored.rows(); ++row) {
+        for (int column {0}; column < colored.columns(); ++column) {
+            auto& color = colored.at(row, column);
+            int luma {(color.R() * 299 + color.G() * 587 + color.B() * 114 + 500) / 1000};
+            check &= result.at(row, column) == img::Color{luma, luma, luma};
+        }
+    }
+    REQUIRE(check);
+
+    // gray image with few levels is written as indexed one of lower depth
+    img::PixelMap levels(20, 10);
+    for (int row {0}; row < levels.rows(); ++row) {
+        for (int column {0}; column < levels.columns(); ++column) {
+            int value {(row + column) % 4 * 85};
+            levels.at(row, column) = img::Color{value, value, value};
+        }
+    }
+    img_t output {};
+    output.get_map() = levels;
+    output.encode_options(img_t::EncodeOptions::small());
+    output.write("resources/result_gray.png");
+    info = img::probe("resources/result_gray.png");
+    REQUIRE(info.color_type == 3);
+    REQUIRE(info.bit_depth == 2);
+}
+
+TEST_CASE("Low bit depth grayscale PNG decoding", "[added]") {
+    // 5x3 images, samples go round all levels of bit depth
+    for (int depth : {1, 2, 4}) {
+        int columns {5}, rows {3}, levels {1 << depth};
+        std::string raw;
+        for (int row {0}; row < rows; ++row) {
+            std::string line((columns * depth + 7) / 8, '\0');
+            for (int column {0}; column < columns; ++column) {
+                int sample {(row + column) % levels};
+                line[column * depth / 8] |= sample << (8 - depth - column * depth % 8);
+            }
+            raw += '\0' + line;
+        }
+        std::string ihdr {'\0', '\0', '\0', static_cast<char>(columns),
+                          '\0', '\0', '\0', static_cast<char>(rows),
+                          static_cast<char>(depth), '\0', '\0', '\0', '\0'};
+        write_png("resources/result_gray_low.png", ihdr, raw);
+        img::PNGImage image {};
+        image.read("resources/result_gray_low.png");
+        REQUIRE(image.good());
+        bool check {1};
+        for (int row {0}; row < rows; ++row) {
+            for (int column {0}; column < columns; ++column) {
+                int value {(row + column) % levels * 255 / (levels - 1)};
+                check &= image.get_map().at(row, column) == img::Color{value, value, value};
+            }
+        }
+        REQUIRE(check);
+    }
+}
+
+TEST_CASE("Alpha and 16-bit PNG", "[added]") {
+    using img_t = img::PNGImage;
+    img_t image {};
+    image.read("resources/bumblebee.png");
+    img::PixelMap map {image.get_map()};
+    for (int row {0}; row < map.rows(); ++row) {
+        for (int column {0}; column < map.columns(); ++column) {
+            map.at(row, column).A((row * 7 + column) % 256);
+        }
+    }
+    auto write_read = [](img::PixelMap& map, int bit_depth, img::ImageInfo& info) {
+        img_t output {};
+        output.get_map() = map;
+        auto options = output.encode_options();
+        options.bit_depth = bit_depth;
+        output.encode_options(options);
+        output.write("resources/result_alpha.png");
+        info = img::probe("resources/result_alpha.png");
+        img_t input {};
+        input.read("resources/result_alpha.png");
+        return input.get_map();
+    };
+    img::ImageInfo info;
+    // colors are opaque by default
+    REQUIRE(img::Color{1, 2, 3}.A() == 255);
+    REQUIRE(img::Color{1, 2, 3} == img::Color(1, 2, 3, 255));
+    // RGBA8, 8-bit samples are not written as 16-bit ones
+    for (int bit_depth : {0, 8}) {
+        auto result = write_read(map, bit_depth, info);
+        REQUIRE(info.color_type == 6);
+        REQUIRE(info.bit_depth == 8);
+        REQUIRE(equal(map, result));
+    }
+    REQUIRE_THROWS(write_read(map, 16, info));
+    // gray with alpha and scaled decoding of alpha
+    img::PixelMap gray {map};
+    for (int row {0}; row < gray.rows(); ++row) {
+        for (int column {0}; column < gray.columns(); ++column) {
+            auto& color = gray.at(row, column);
+            color = img::Color{color.G(), color.G(), color.G(), 255 - color.A()};
+        }
+    }
+    auto result = write_read(gray, 8, info);
+    REQUIRE(info.color_type == 4);
+    REQUIRE(equal(gray, result));
+    img_t scaled {};
+    auto options = scaled.decode_options();
+    options.scale = 2;
+    scaled.decode_options(options);
+    scaled.read("resources/result_alpha.png");
+    int sum {0};
+    for (int y {0}; y < 2; ++y) {
+        for (int x {0}; x < 2; ++x) {
+            sum += gray.at(y, x).A();
+        }
+    }
+    REQUIRE(scaled.get_map().at(0, 0).A() == (sum + 2) / 4);
+    auto encode = image.encode_options();
+    encode.bit_depth = 12;
+    REQUIRE_THROWS(image.encode_options(encode));
+}
+
+TEST_CASE("16-bit PNG decoding and encoding", "[added]") {
+    using img_t = img::PNGImage;
+    // 7x2 images, samples are not multiples of 257, so that they are rounded in map
+    int columns {7}, rows {2};
+    // zlib stream of IDAT chunks of file, decompressed
+    auto image_data = [](const std::string& path, size_t size) {
+        auto file = contents(path);
+        std::string stream;
+        for (size_t position {8}; position + 12 <= file.size();) {
+            size_t length {0};
+            for (int b {0}; b < 4; ++b) {
+                length = length << 8 | static_cast<std::uint8_t>(file[position + b]);
+            }
+            if (file.compare(position + 4, 4, "IDAT") == 0) {
+                stream += file.substr(position + 8, length);
+            }
+            position += length + 12;
+        }
+        std::string data(size, '\0');
+        uLongf data_size {size};
+        uncompress(reinterpret_cast<std::uint8_t*>(data.data()), &data_size,
+                   reinterpret_cast<const std::uint8_t*>(stream.data()), stream.size());
+        return data;
+    };
+    for (int color_type : {0, 2, 4, 6}) {
+        int channels {(color_type & 2 ? 3 : 1) + (color_type & 4 ? 1 : 0)};
+        std::string raw;
+        std::vector<int> samples;
+        for (int row {0}; row < rows; ++row) {
+            raw += '\0';
+            for (int sample {0}; sample < columns * channels; ++sample) {
+                int value {(row * 40503 + sample * 3119 + color_type * 1001) % 65536};
+                samples.push_back(value);
+                raw += static_cast<char>(value >> 8);
+                raw += static_cast<char>(value & 0xFF);
+            }
+        }
+        std::string ihdr {'\0', '\0', '\0', static_cast<char>(columns),
+                          '\0', '\0', '\0', static_cast<char>(rows),
+                          16, static_cast<char>(color_type), '\0', '\0', '\0'};
+        write_png("resources/result_png16.png", ihdr, raw);
+        img_t image {};
+        image.read("resources/result_png16.png");
+        REQUIRE(image.good());
+        bool check {1};
+        auto narrow = [&](int index) {
+            return static_cast<int>(std::lround(samples[index] * 255.0 / 65535.0));
+        };
+        for (int row {0}; row < rows; ++row) {
+            for (int column {0}; column < columns; ++column) {
+                int index {(row * columns + column) * channels};
+                int gray {narrow(index)};
+                img::Color expected {(channels < 3) ? img::Color{gray, gray, gray} :
+                                     img::Color{gray, narrow(index + 1), narrow(index + 2)}};
+                if (color_type & 4) {
+                    expected.A(narrow(index + channels - 1));
+                }
+                check &= image.get_map().color(row, column) == expected;
+            }
+        }
+        REQUIRE(check);
+
+        // samples are written back as they are
+        auto options = image.encode_options();
+        options.filter = img_t::Filter::none;
+        image.encode_options(options);
+        image.write("resources/result_png16_copy.png");
+        auto info = img::probe("resources/result_png16_copy.png");
+        REQUIRE(info.bit_depth == 16);
+        REQUIRE(info.color_type == color_type);
+        REQUIRE(image_data("resources/result_png16_copy.png", raw.size()) == raw);
+        // changed pixel is written from its samples
+        image.get_map().samples(0, 0, {257, 257, 257, 65535});
+        image.write("resources/result_png16_copy.png");
+        auto data = image_data("resources/result_png16_copy.png", raw.size());
+        REQUIRE(data.substr(0, 3) == std::string{'\0', '\1', '\1'});
+        REQUIRE(data.substr(1 + channels * 2) == raw.substr(1 + channels * 2));
+        // 8-bit output on request
+        options.bit_depth = 8;
+        image.encode_options(options);
+        image.write("resources/result_png16_copy.png");
+        REQUIRE(img::probe("resources/result_png16_copy.png").bit_depth == 8);
+    }
+    // samples are not kept for scaled image
+    img_t scaled {};
+    auto decode = scaled.decode_options();
+    decode.scale = 2;
+    scaled.decode_options(decode);
+    scaled.read("resources/result_png16.png");
+    scaled.write("resources/result_png16_copy.png");
+    REQUIRE(img::probe("resources/result_png16_copy.png").bit_depth == 8);
+    auto options = scaled.encode_options();
+    options.bit_depth = 16;
+    scaled.encode_options(options);
+    REQUIRE_THROWS(scaled.write("resources/result_png16_copy.png"));
+}
+
+TEST_CASE("Processing of 16-bit PNG", "[added]") {
+    using img_t = img::PNGImage;
+    // 4x1 RGB16 row, pixel k is (1000 + k, 2000 + k, 3000 + k)
+    std::string raw {'\0'};
+    for (int column {0}; column < 4; ++column) {
+        for (int channel {0}; channel < 3; ++channel) {
+            int value {(channel + 1) * 1000 + column};
+            raw += static_cast<char>(value >> 8);
+            raw += static_cast<char>(value & 0xFF);
+        }
+    }
+    std::string ihdr {'\0', '\0', '\0', '\4', '\0', '\0', '\0', '\1', 16, '\2', '\0', '\0', '\0'};
+    write_png("resources/result_png16.png", ihdr, raw);
+    auto pixel = [](int k) {
+        return img::PixelMap::samples_t{static_cast<std::uint16_t>(1000 + k),
+                                        static_cast<std::uint16_t>(2000 + k),
+                                        static_cast<std::uint16_t>(3000 + k), 65535};
+    };
+    // pixels of map in row-major order, after writing and reading it back
+    auto pixels = [](img_t& image) {
+        image.write("resources/result_png16_copy.png");
+        REQUIRE(img::probe("resources/result_png16_copy.png").bit_depth == 16);
+        img_t copy {};
+        copy.read("resources/result_png16_copy.png");
+        auto& map = copy.get_map();
+        REQUIRE(map.format() == img::PixelFormat::rgba16);
+        std::vector<img::PixelMap::samples_t> result;
+        for (int row {0}; row < map.rows(); ++row) {
+            for (int column {0}; column < map.columns(); ++column) {
+                result.push_back(map.samples(row, column));
+            }
+        }
+        return result;
+    };
+    std::vector<img::PixelMap::samples_t> straight {pixel(0), pixel(1), pixel(2), pixel(3)};
+    std::vector<img::PixelMap::samples_t> reversed {pixel(3), pixel(2), pixel(1), pixel(0)};
+
+    img_t image {};
+    image.read("resources/result_png16.png");
+    REQUIRE(pixels(image) == straight);
+    proc::reflect_x(image);
+    proc::reflect_y(image);
+    REQUIRE(pixels(image) == reversed);
+    proc::rotate(image, 180);
+    REQUIRE(pixels(image) == straight);
+    proc::rotate(image, 90);
+    REQUIRE(image.get_map().rows() == 4);
+    REQUIRE(pixels(image) == reversed);
+    proc::rotate(image, 270);
+    REQUIRE(pixels(image) == straight);
+    // 16-bit pixels are inserted as they are, 8-bit ones are scaled by 257
+    img_t other {};
+    other.read("resources/result_png16.png");
+    proc::reflect_y(other);
+    proc::insert(image, other, 2, 0);
+    REQUIRE(pixels(image) == std::vector{pixel(0), pixel(1), pixel(3), pixel(2)});
+    img::PPMImage narrow {};
+    narrow.get_map().expand(img::Side::bottom, 1);
+    narrow.get_map().expand(img::Side::right, 1);
+    narrow.get_map().at(0, 0) = img::Color{1, 2, 3};
+    proc::insert(image, narrow, 0, 0);
+    REQUIRE(pixels(image)[0] == img::PixelMap::samples_t{257, 514, 771, 65535});
+    // negative at depth of 16 bits
+    proc::negative(image);
+    REQUIRE(pixels(image)[1] == img::PixelMap::samples_t{64534, 63534, 62534, 65535});
+}
+
+TEST_CASE("Copying files without decoding", "[added]") {
+    img::copy_file("resources/bumblebee.png", "resources/result_copy.png");
+    REQUIRE(contents("resources/result_copy.png") == contents("resources/bumblebee.png"));
+    // existing file is overwritten, copy to itself keeps it
+    img::copy_file("resources/simple.png", "resources/result_copy.png");
+    REQUIRE(contents("resources/result_copy.png") == contents("resources/simple.png"));
+    img::copy_file("resources/result_copy.png", "resources/result_copy.png");
+    REQUIRE(contents("resources/result_copy.png") == contents("resources/simple.png"));
+    REQUIRE_THROWS(img::copy_file("resources/missing.png", "resources/result_copy.png"));
+
+    // structure is checked before copying, truncated files are broken
+    img::QOIImage qoi {};
+    qoi.get_map() = img::PixelMap(3, 2);
+    qoi.write("resources/result_copy.qoi");
+    img::PAMImage pam {};
+    pam.get_map() = qoi.get_map();
+    pam.write("resources/result_copy.pam");
+    std::ofstream {"resources/result_copy_ascii.ppm"} << "P3\n2 1\n255\n1 2 3\n4 5 6\n";
+    for (auto path : {"resources/bumblebee.png", "resources/west.ppm", "resources/result_copy.qoi",
+                      "resources/result_copy.pam", "resources/result_copy_ascii.ppm"}) {
+        REQUIRE(img::verify(path));
+        auto data = contents(path);
+        std::ofstream {"resources/result_copy_broken", std::ios::binary}
+            << data.substr(0, data.size() - 2);
+        REQUIRE_FALSE(img::verify("resources/result_copy_broken"));
+    }
+    auto data = contents("resources/bumblebee.png");
+    data[data.size() / 2] ^= 1;
+    std::ofstream {"resources/result_copy_broken", std::ios::binary} << data;
+    REQUIRE_FALSE(img::verify("resources/result_copy_broken"));
+    REQUIRE_FALSE(img::verify("resources/missing.png"));
+
+    // intact framing with IHDR fields, that decoder rejects: bit depth, color type,
+    // compression, filter and interlace method and size
+    const std::string ihdr {"\0\0\0\1\0\0\0\1\x08\0\0\0\0", 13};
+    write_png("resources/result_copy_broken", ihdr, std::string{"\0\0", 2});
+    REQUIRE(img::verify("resources/result_copy_broken"));
+    for (auto [index, value] : {std::pair{8, 3}, {9, 1}, {9, 7}, {10, 1}, {11, 1}, {12, 2},
+                                {1, 1}}) {
+        auto broken = ihdr;
+        broken[index] = static_cast<char>(value);
+        write_png("resources/result_copy_broken", broken, std::string{"\0\0", 2});
+        REQUIRE_FALSE(img::verify("resources/result_copy_broken"));
+    }
+}
+
+TEST_CASE("ASCII PPM and PPM header parsing", "[added]") {
+    img::PPMImage binary {};
+    binary.read("resources/boxes.ppm");
+    auto& expected = binary.get_map();
+    {
+        // P3 with comments, lines of different length and extra whitespace
+        std::ofstream file {"resources/result_ascii.ppm"};
+        file << "P3\n# written by test\n" << expected.columns() << "  " << expected.rows()
+             << " # dimensions\n255\n";
+        for (int row {0}; row < expected.rows(); ++row) {
+            for (int column {0}; column < expected.columns(); ++column) {
+                auto& color = expected.at(row, column);
+                file << color.R() << ' ' << color.G() << "\t" << color.B()
+                     << ((column % 5 == 4) ? "\n" : "  ");
+            }
+        }
+    }
+    REQUIRE(img::get_type("resources/result_ascii.ppm") == img::ImageType::PPM);
+    auto info = img::probe("resources/result_ascii.ppm");
+    REQUIRE(info.type == img::ImageType::PPM);
+    REQUIRE(info.width == expected.columns());
+    REQUIRE(info.height == expected.rows());
+    img::PPMImage ascii {};
+    ascii.read("resources/result_ascii.ppm");
+    REQUIRE(ascii.good());
+    bool check {ascii.get_map().rows() == expected.rows() &&
+                ascii.get_map().columns() == expected.columns()};
+    for (int row {0}; check && row < expected.rows(); ++row) {
+        for (int column {0}; column < expected.columns(); ++column) {
+            check &= ascii.get_map().at(row, column) == expected.at(row, column);
+        }
+    }
+    REQUIRE(check);
+    // binary data starting with whitespace byte after comment in header
+    {
+        std::ofstream file {"resources/result_header.ppm", std::ios::binary};
+        file << "P6 2#comment\n1\n255\n" << std::string{"\n\t \x01\x02\x03", 6};
+    }
+    binary.read("resources/result_header.ppm");
+    REQUIRE(binary.get_map().at(0, 0) == img::Color{'\n', '\t', ' '});
+    REQUIRE(binary.get_map().at(0, 1) == img::Color{1, 2, 3});
+    // broken files
+    auto write_read = [](std::string contents) {
+        {
+            std::ofstream file {"resources/result_broken.ppm", std::ios::binary};
+            file << contents;
+        }
+        img::PPMImage image {};
+        image.read("resources/result_broken.ppm");
+    };
+    REQUIRE_THROWS(write_read("P3\n1 1\n255\n1 2"));
+    REQUIRE_THROWS(write_read("P3\n1 1\n255\n1 2 256"));
+    REQUIRE_THROWS(write_read("P3\n1 1\n255\n1 x 3"));
+    REQUIRE_THROWS(write_read("P6\n1 1\n256\n123"));
+    REQUIRE_THROWS(write_read("P6\n1\n255\n123"));
+    REQUIRE_THROWS(write_read("P6\n2 1\n255\n123"));
+    REQUIRE_THROWS(write_read("P8\n1 1\n255\n1"));
+    REQUIRE_NOTHROW(write_read("P6\n1 1\n255\n123"));
+}
+
+TEST_CASE("PGM, PBM and PAM images", "[added]") {
+    img::PPMImage source {};
+    source.read("resources/boxes.ppm");
+    img::PixelMap colored {source.get_map()}, gray {source.get_map()};
+    for (int row {0}; row < gray.rows(); ++row) {
+        for (int column {0}; column < gray.columns(); ++column) {
+            int value {gray.at(row, column).G()};
+            gray.at(row, column) = img::Color{value, value, value};
+        }
+    }
+    size_t pixels {static_cast<size_t>(gray.rows()) * gray.columns()};
+    // gray samples take one byte per pixel
+    img::PGMImage pgm {};
+    pgm.get_map() = gray;
+    pgm.write("resources/result.pgm");
+    REQUIRE(img::get_type("resources/result.pgm") == img::ImageType::PGM);
+    REQUIRE(file_size("resources/result.pgm") < pixels + 32);
+    auto info = img::probe("resources/result.pgm");
+    REQUIRE(info.type == img::ImageType::PGM);
+    REQUIRE(info.color_type == 0);
+    img::PGMImage pgm_input {};
+    pgm_input.read("resources/result.pgm");
+    REQUIRE(equal(gray, pgm_input.get_map()));
+    // bitmap keeps black and white
+    img::PixelMap bitmap {gray};
+    for (int row {0}; row < bitmap.rows(); ++row) {
+        for (int column {0}; column < bitmap.columns(); ++column) {
+            int value {(gray.at(row, column).G() > 127) ? 255 : 0};
+            bitmap.at(row, column) = img::Color{value, value, value};
+        }
+    }
+    img::PBMImage pbm {};
+    pbm.get_map() = gray;
+    pbm.write("resources/result.pbm");
+    REQUIRE(img::get_type("resources/result.pbm") == img::ImageType::PBM);
+    REQUIRE(file_size("resources/result.pbm") <
+            (gray.columns() + 7) / 8 * static_cast<size_t>(gray.rows()) + 32);
+    REQUIRE(img::probe("resources/result.pbm").bit_depth == 1);
+    img::PBMImage pbm_input {};
+    pbm_input.read("resources/result.pbm");
+    REQUIRE(equal(bitmap, pbm_input.get_map()));
+    // tuples of PAM follow the image
+    img::PixelMap transparent {colored};
+    transparent.at(0, 0).A(17);
+    for (auto map : {&gray, &colored, &transparent}) {
+        img::PAMImage pam {};
+        pam.get_map() = *map;
+        pam.write("resources/result.pam");
+        REQUIRE(img::get_type("resources/result.pam") == img::ImageType::PAM);
+        img::PAMImage pam_input {};
+        pam_input.read("resources/result.pam");
+        REQUIRE(equal(*map, pam_input.get_map()));
+    }
+    REQUIRE(img::probe("resources/result.pam").color_type == 6);
+    // PPM reader accepts the whole family
+    source.read("resources/result.pgm");
+    REQUIRE(equal(gray, source.get_map()));
+    // gray images are read into maps of one byte per pixel, processing keeps them gray
+    img::PGMImage pgm_gray {};
+    pgm_gray.read("resources/result.pgm");
+    auto& gray_map = pgm_gray.get_map();
+    REQUIRE(gray_map.format() == img::PixelFormat::gray);
+    int last {static_cast<int>(gray.columns()) - 1};
+    REQUIRE(gray_map.gray(1, 0) == gray.at(1, last).G());
+    proc::reflect_y(pgm_gray);
+    proc::negative(pgm_gray);
+    REQUIRE(gray_map.format() == img::PixelFormat::gray);
+    REQUIRE(gray_map.gray(1, 0) == 255 - gray.at(1, 0).G());
+    pgm_gray.write("resources/result.pgm");
+    pgm_input.read("resources/result.pgm");
+    REQUIRE(pgm_input.get_map().gray(1, 0) == 255 - gray.at(1, 0).G());
+    pbm_input.read("resources/result.pbm");
+    REQUIRE(pbm_input.get_map().format() == img::PixelFormat::gray);
+    img::PAMImage pam_gray {};
+    pam_gray.get_map() = gray_map;
+    pam_gray.write("resources/result.pam");
+    REQUIRE(img::probe("resources/result.pam").color_type == 0);
+    pam_gray.read("resources/result.pam");
+    REQUIRE(pam_gray.get_map().format() == img::PixelFormat::gray);
+    REQUIRE(equal(gray_map, pam_gray.get_map()));
+    // broken headers
+    auto write_read = [](std::string contents) {
+        {
+            std::ofstream file {"resources/result_broken.pam", std::ios::binary};
+            file << contents;
+        }
+        img::PAMImage image {};
+        image.read("resources/result_broken.pam");
+    };
+    REQUIRE_NOTHROW(write_read("P7\nWIDTH 1\nHEIGHT 1\nDEPTH 2\nMAXVAL 255\n"
+                               "TUPLTYPE GRAYSCALE_ALPHA\nENDHDR\n12"));
+    REQUIRE_THROWS(write_read("P7\nWIDTH 1\nHEIGHT 1\nMAXVAL 255\nENDHDR\n12"));
+    REQUIRE_THROWS(write_read("P7\nWIDTH 1\nHEIGHT 1\nDEPTH 5\nMAXVAL 255\nENDHDR\n12345"));
+    REQUIRE_THROWS(write_read("P7\nWIDTH 1\nCOLORS 1\nDEPTH 1\nMAXVAL 255\nENDHDR\n1"));
+    REQUIRE_THROWS(write_read("P7\nWIDTH 2\nHEIGHT 1\nDEPTH 1\nMAXVAL 255\nENDHDR\n1"));
+    REQUIRE_THROWS(write_read("P4\n9 1\n\x01"));
+}
+
+TEST_CASE("QOI reading and writing", "[added]") {
+    // every operation once: run, diff, run, diff, index, luma and RGBA
+    img::QOIImage image {};
+    auto& map = image.get_map();
+    map.expand(img::Side::bottom, 1);
+    map.expand(img::Side::right, 7);
+    map.at(0, 1) = map.at(0, 2) = map.at(0, 4) = img::Color{1, 1, 1};
+    map.at(0, 5) = img::Color{21, 26, 20};
+    map.at(0, 6) = img::Color{21, 26, 20, 128};
+    image.write("resources/result.qoi");
+    std::string expected {"qoif\0\0\0\x07\0\0\0\x01\x04\0"
+                          "\xc0\x7f\xc0\x55\x04\xb9\x32\xff\x15\x1a\x14\x80"
+                          "\0\0\0\0\0\0\0\x01", 34};
+    REQUIRE(contents("resources/result.qoi") == expected);
+    REQUIRE(img::get_type("resources/result.qoi") == img::ImageType::QOI);
+    auto info = img::probe("resources/result.qoi");
+    REQUIRE(info.type == img::ImageType::QOI);
+    REQUIRE(info.width == 7);
+    REQUIRE(info.color_type == 6);
+    img::QOIImage input {};
+    input.read("resources/result.qoi");
+    REQUIRE(equal(map, input.get_map()));
+    // real images and long runs
+    for (auto file : {"bumblebee.png", "hut.png"}) {
+        img::PNGImage png {};
+        png.read(std::string{"resources/"}.append(file));
+        image.get_map() = png.get_map();
+        for (int column {0}; column < 200; ++column) {
+            image.get_map().at(0, column) = img::Color{7, 7, 7};
+        }
+        image.write("resources/result.qoi");
+        REQUIRE(img::probe("resources/result.qoi").color_type == 2);
+        input.read("resources/result.qoi");
+        REQUIRE(input.good());
+        REQUIRE(equal(image.get_map(), input.get_map()));
+    }
+    // truncated data
+    auto data = contents("resources/result.qoi");
+    {
+        std::ofstream file {"resources/result_broken.qoi", std::ios::binary};
+        file << data.substr(0, data.size() / 2);
+    }
+    REQUIRE_THROWS(input.read("resources/result_broken.qoi"));
+    {
+        std::ofstream file {"resources/result_broken.qoi", std::ios::binary};
+        file << data.substr(0, 12) << '\x05' << data.substr(13);
+    }
+    REQUIRE_THROWS(input.read("resources/result_broken.qoi"));
 }
@@ -100,3 +100,37 @@ TEST_CASE("Trimming class <PixelMap>", "[base]") {
     }
 
 }
+
+TEST_CASE("Formats of class <PixelMap>", "[added]") {
+    using img::PixelFormat;
+    img::PixelMap map {3, 2, PixelFormat::rgba16};
+    REQUIRE(map.max_sample() == 65535);
+    REQUIRE(map.color(1, 2) == img::Color{});
+    map.samples(0, 0, {1000, 2000, 3000, 65535});
+    map.samples(0, 1, {257, 514, 771, 0});
+    // 16-bit samples are rounded to 8 bits
+    REQUIRE(map.color(0, 0) == img::Color{4, 8, 12});
+    REQUIRE(map.color(0, 1) == img::Color{1, 2, 3, 0});
+    // joint expansion keeps counts of both sides, rows are padded with opaque black
+    map.expand(img::JointSide::left_and_right, 1, 2);
+    REQUIRE(check_map_size(map, 2, 6));
+    REQUIRE(map.samples(0, 1) == img::PixelMap::samples_t{1000, 2000, 3000, 65535});
+    REQUIRE(map.samples(0, 0) == img::PixelMap::samples_t{0, 0, 0, 65535});
+    map.trim(img::JointSide::left_and_right, 1, 2);
+    // pixels of other format are scaled, gray keeps luma of them and drops alpha
+    img::PixelMap gray {3, 2, PixelFormat::gray};
+    gray.copy(0, 1, map, 0, 1);
+    REQUIRE(gray.samples(0, 1) == img::PixelMap::samples_t{2, 2, 2, 255});
+    gray.gray(1, 1) = 200;
+    map.copy(1, 1, gray, 1, 1);
+    REQUIRE(map.samples(1, 1) == img::PixelMap::samples_t{51400, 51400, 51400, 65535});
+    // conversion keeps size, at() converts to 8-bit colors
+    map.format(PixelFormat::gray);
+    REQUIRE(map.format() == PixelFormat::gray);
+    REQUIRE(check_map_size(map, 2, 3));
+    REQUIRE(map.gray(1, 1) == 200);
+    REQUIRE(map.at(1, 1) == img::Color{200, 200, 200});
+    REQUIRE(map.format() == PixelFormat::rgba);
+    map.format(PixelFormat::rgba16);
+    REQUIRE(map.samples(1, 1) == img::PixelMap::samples_t{51400, 51400, 51400, 65535});
+}
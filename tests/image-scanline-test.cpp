@@ -1,6 +1,8 @@
 #include <catch2/catch_all.hpp>
 #include <memory>
 #include <string>
+#include <vector>
+#include <span>
 
 #define private public
 #define protected public
@@ -96,3 +98,79 @@ TEST_CASE("Scanline helper functions", "[base]") {
 
   
 }
+
+TEST_CASE("Writing chunks with running CRC", "[added]") {
+    using Scanline = img::Image::Scanline;
+    const char type[] {'t', 'E', 'X', 't'};
+    const char payload[] {"Comment\0written in two parts"};
+    {
+        Scanline file {"resources/test_chunk_file.bin", img::Image::ScanMode::write};
+        file.begin_chunk(type, sizeof(payload));
+        file.write_chunk_data(payload, 10);
+        file.write_chunk_data(payload + 10, sizeof(payload) - 10);
+        file.end_chunk();
+        file.begin_chunk("IEND", 0);
+        file.end_chunk();
+    }
+    Scanline file {"resources/test_chunk_file.bin", img::Image::ScanMode::read};
+    file.call_read(8 + sizeof(payload) + 4 + 12);
+    auto bytes = file.get_chunk(0, file.size());
+    REQUIRE(Scanline::_parse_chunk(bytes.get(), 4) == sizeof(payload));
+    REQUIRE(Scanline::_cmp_chunks(bytes.get() + 4, 4, type, 4));
+    REQUIRE(Scanline::_cmp_chunks(bytes.get() + 8, sizeof(payload), payload, sizeof(payload)));
+    // CRC covers type and payload
+    REQUIRE(Scanline::_parse_chunk(bytes.get() + 8 + sizeof(payload), 4) ==
+            Scanline::_crc(bytes.get() + 4, 4 + sizeof(payload)));
+    auto iend = bytes.get() + 12 + sizeof(payload);
+    REQUIRE(Scanline::_parse_chunk(iend, 4) == 0);
+    // well-known CRC of IEND chunk
+    REQUIRE(Scanline::_parse_chunk(iend + 8, 4) == 0xAE426082);
+    REQUIRE(Scanline::_load_be32(iend + 8) == 0xAE426082);
+}
+
+TEST_CASE("Reading chunks in place", "[added]") {
+    using Scanline = img::Image::Scanline;
+    using PNG = img::PNGImage;
+    const char payload[] {"zero-copy"};
+    {
+        Scanline file {"resources/test_chunk_view.bin", img::Image::ScanMode::write};
+        file.begin_chunk("IDAT", sizeof(payload));
+        file.write_chunk_data(payload, sizeof(payload));
+        file.end_chunk();
+        file.begin_chunk("tEXt", 0);
+        file.end_chunk();
+        file.begin_chunk("IEND", 0);
+        file.end_chunk();
+    }
+    std::vector<char> data;
+    Scanline file {"resources/test_chunk_view.bin", img::Image::ScanMode::read};
+    file.read_all(data);
+    REQUIRE(data.size() == 36 + sizeof(payload));
+
+    PNG::ChunkReader reader {data};
+    PNG::ChunkView view;
+    REQUIRE(reader.next(view));
+    REQUIRE(view.chunk == PNG::Chunk::IDAT);
+    // payload is a view into the buffer, not a copy
+    REQUIRE(view.payload.data() == data.data() + 8);
+    REQUIRE(view.payload.size() == sizeof(payload));
+    REQUIRE(PNG::check_crc(view));
+    REQUIRE(reader.next(view));
+    REQUIRE(view.chunk == PNG::Chunk::Unknown);
+    REQUIRE(view.payload.empty());
+    REQUIRE(PNG::check_crc(view));
+    REQUIRE(reader.next(view));
+    REQUIRE(view.chunk == PNG::Chunk::IEND);
+    REQUIRE(view.crc == 0xAE426082);
+    REQUIRE_FALSE(reader.next(view));
+
+    // corrupted CRC and truncated chunks
+    data[10] ^= 1;
+    PNG::ChunkReader corrupted {data};
+    REQUIRE(corrupted.next(view));
+    REQUIRE_FALSE(PNG::check_crc(view));
+    PNG::ChunkReader truncated {std::span<const char>{data}.first(sizeof(payload) + 11)};
+    REQUIRE_THROWS_AS(truncated.next(view), PNG::DecoderError);
+    PNG::ChunkReader short_header {std::span<const char>{data}.first(5)};
+    REQUIRE_THROWS_AS(short_header.next(view), PNG::DecoderError);
+}